@@ -0,0 +1,97 @@
+//
+// Created by henryco on 2/25/24.
+//
+
+/*
+ * Batched vs sequential inference of the pose landmark model.
+ *
+ * For N = 1..4 crops compares N sequential Invoke calls of the regular interpreter ([1, 256, 256, 3])
+ * with a single Invoke of the interpreter resized to [N, 256, 256, 3].
+ * Input tensors are filled with noise once. Reports mean time of all N crops and time per crop.
+ *
+ * Usage: batch_bench [models directory] [iterations] [threads] [backend: gpu, xnnpack, reference]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+
+#include "../src/aux/dnn/dnn_runtime.h"
+
+namespace {
+
+    const size_t WARMUP = 5;
+    const size_t MAX_BATCH = 4;
+
+    void fill(eox::dnn::DnnRuntime &runtime) {
+        auto *input = runtime.get()->input_tensor(0);
+        std::mt19937 random(42);
+        std::uniform_real_distribution<float> noise(0.f, 1.f);
+        for (size_t i = 0; i < input->bytes / sizeof(float); i++)
+            input->data.f[i] = noise(random);
+    }
+
+    template<typename F>
+    double measure(size_t iterations, F &&func) {
+        for (size_t i = 0; i < WARMUP; i++)
+            func();
+
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++)
+            func();
+        const auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count() / (double) iterations;
+    }
+
+}
+
+int main(int argc, char **argv) {
+    const std::string dir = argc > 1 ? argv[1] : "./../models";
+    const size_t iterations = std::max<size_t>(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 50, 1);
+    const int threads = argc > 3 ? std::max(std::atoi(argv[3]), 1) : 4;
+    const std::string backend = argc > 4 ? argv[4] : "xnnpack";
+
+    const auto inference = backend == "gpu"
+                           ? eox::data::Inference::GPU
+                           : backend == "reference"
+                             ? eox::data::Inference::REFERENCE
+                             : eox::data::Inference::XNNPACK;
+    const eox::data::inference_config config = {.backend = inference, .threads = threads};
+    const std::string file = dir + "/blazepose_heavy_float32.tflite";
+
+    eox::dnn::DnnRuntime single;
+    single.load(file, config);
+    fill(single);
+
+    std::printf("backend: %s, threads: %d\n",
+                eox::dnn::DnnRuntime::backendName(single.getBackend()).c_str(), threads);
+
+    for (size_t n = 1; n <= MAX_BATCH; n++) {
+        const auto sequential = measure(iterations, [&]() {
+            for (size_t i = 0; i < n; i++)
+                single.invoke();
+        });
+
+        eox::dnn::DnnRuntime batched;
+        batched.load(file, config, (int) n);
+        fill(batched);
+
+        if (batched.getBackend() != single.getBackend()) {
+            std::printf("N=%zu  batched interpreter fell back to %s, skipped\n",
+                        n, eox::dnn::DnnRuntime::backendName(batched.getBackend()).c_str());
+            continue;
+        }
+
+        const auto batch = measure(iterations, [&]() {
+            batched.invoke();
+        });
+
+        std::printf("N=%zu  sequential %9.3f ms (%7.3f ms/crop)   batched %9.3f ms (%7.3f ms/crop)   speedup %5.2fx\n",
+                    n, sequential, sequential / (double) n, batch, batch / (double) n, sequential / batch);
+    }
+
+    return 0;
+}
@@ -0,0 +1,107 @@
+//
+// Created by henryco on 2/21/24.
+//
+
+/*
+ * Latency of pose models (detector and landmark) on every inference backend.
+ *
+ * Every model is loaded on every backend (without fallback, unavailable backends are reported as such),
+ * input tensor is filled with noise once, then interpreter is invoked repeatedly.
+ * Reports mean, p50, p99 and max latency of Invoke.
+ *
+ * Usage: dnn_bench [models directory] [iterations] [detector threads] [landmark threads]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+
+#include "../src/aux/dnn/dnn_runtime.h"
+
+namespace {
+
+    const size_t WARMUP = 10;
+
+    typedef struct {
+        const char *name;
+        std::string file;
+        int threads;
+    } model_case;
+
+    void measure(const model_case &model, eox::data::Inference inference, size_t iterations) {
+        const auto backend = eox::dnn::DnnRuntime::backendName(inference);
+
+        eox::dnn::DnnRuntime runtime;
+        try {
+            runtime.load(model.file, {.backend = inference, .threads = model.threads});
+        } catch (const std::exception &e) {
+            std::printf("%-10s %-10s %s\n", model.name, backend.c_str(), "not available");
+            return;
+        }
+
+        // fallback would measure another backend
+        if (runtime.getBackend() != inference) {
+            std::printf("%-10s %-10s %s\n", model.name, backend.c_str(), "not available");
+            return;
+        }
+
+        auto *input = runtime.get()->input_tensor(0);
+        std::mt19937 random(42);
+        std::uniform_real_distribution<float> noise(0.f, 1.f);
+        for (size_t i = 0; i < input->bytes / sizeof(float); i++)
+            input->data.f[i] = noise(random);
+
+        for (size_t i = 0; i < WARMUP; i++)
+            runtime.invoke();
+
+        std::vector<double> samples;
+        samples.reserve(iterations);
+        for (size_t i = 0; i < iterations; i++) {
+            const auto start = std::chrono::steady_clock::now();
+            runtime.invoke();
+            const auto end = std::chrono::steady_clock::now();
+            samples.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        }
+
+        std::sort(samples.begin(), samples.end());
+        double sum = 0;
+        for (const auto s: samples)
+            sum += s;
+
+        std::printf("%-10s %-10s %3d threads %9.3f ms mean %9.3f ms p50 %9.3f ms p99 %9.3f ms max\n",
+                    model.name,
+                    backend.c_str(),
+                    model.threads,
+                    sum / (double) samples.size(),
+                    samples[samples.size() / 2],
+                    samples[std::min(samples.size() - 1, samples.size() * 99 / 100)],
+                    samples.back());
+    }
+
+}
+
+int main(int argc, char **argv) {
+    const std::string dir = argc > 1 ? argv[1] : "./../models";
+    const size_t iterations = std::max<size_t>(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100, 1);
+    const int detector_threads = argc > 3 ? std::atoi(argv[3]) : 2;
+    const int landmark_threads = argc > 4 ? std::atoi(argv[4]) : 4;
+
+    const std::vector<model_case> models = {
+            {.name = "detector", .file = dir + "/blazepose_detection_float32.tflite", .threads = detector_threads},
+            {.name = "landmark", .file = dir + "/blazepose_heavy_float32.tflite", .threads = landmark_threads},
+    };
+
+    for (const auto &model: models) {
+        for (const auto inference: {eox::data::Inference::GPU,
+                                    eox::data::Inference::XNNPACK,
+                                    eox::data::Inference::REFERENCE}) {
+            measure(model, inference, iterations);
+        }
+    }
+
+    return 0;
+}
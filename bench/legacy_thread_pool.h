@@ -0,0 +1,277 @@
+//
+// Created by henryco on 2/16/24.
+//
+
+/*
+ * eox::util::ThreadPool as it was before TaskState/Future (baseline of thread_pool_bench).
+ *
+ * Copied from src/aux/utils/tp/thread_pool.{h,cpp}, only moved into header and into its own namespace,
+ * logging is left out (spdlog logger "thread_pool" is already registered by the current pool).
+ * Submission: std::function<T()> wrapped into lambda with shared std::promise,
+ * stored as heap allocated std::function<void()> in the work-stealing queues.
+ */
+
+#ifndef STEREOX_LEGACY_THREAD_POOL_H
+#define STEREOX_LEGACY_THREAD_POOL_H
+
+#include <mutex>
+#include <deque>
+#include <random>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <future>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+#include "../src/aux/utils/tp/work_deque.h"
+#include "../src/aux/utils/globals/eox_globals.h"
+
+namespace eox::bench::legacy {
+
+    class ThreadPool {
+    public:
+
+        explicit ThreadPool(size_t size) {
+            start(size);
+        }
+
+        ThreadPool() = default;
+
+        ~ThreadPool() {
+            shutdown();
+        }
+
+        void shutdown() {
+            {
+                std::lock_guard<std::mutex> lock(idle_mutex);
+                stop = true;
+                for (auto &w: workers) {
+                    w->flag.notify_all();
+                }
+            }
+
+            for (auto &thread: threads) {
+                if (thread.joinable()) {
+                    thread.join();
+                }
+            }
+            threads.clear();
+
+            // tasks never executed, their futures get broken promise
+            for (auto &w: workers) {
+                while (auto t = w->deque.pop())
+                    delete t;
+            }
+            workers.clear();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto t: injected)
+                    delete t;
+                injected.clear();
+                injected_size = 0;
+            }
+
+            idle.clear();
+            sleeping = 0;
+        }
+
+        template<typename T>
+        std::future<T> execute(std::function<T()> func) {
+            auto le_promise = std::make_shared<std::promise<T>>();
+            auto le_future = le_promise->get_future();
+
+            submit([p = le_promise, func = std::move(func)]() mutable {
+                try {
+                    p->set_value(func());
+                } catch (...) {
+                    p->set_exception(std::current_exception());
+                }
+            });
+
+            return le_future;
+        }
+
+        void start(size_t size) {
+            size_t n_cores = std::clamp(size,
+                                        std::size_t(1),
+                                        eox::globals::THREAD_POOL_CORES_MAX);
+            shutdown();
+
+            workers.reserve(n_cores);
+            for (int i = 0; i < n_cores; ++i) {
+                workers.push_back(std::unique_ptr<worker_state>(new worker_state{
+                        .deque = eox::util::WorkDeque<task *>(DEQUE_CAPACITY),
+                        .flag = {},
+                        .woken = false
+                }));
+            }
+
+            stop = false;
+            threads.reserve(n_cores);
+            for (int i = 0; i < n_cores; ++i) {
+                threads.emplace_back(&ThreadPool::worker, this, i);
+            }
+        }
+
+    private:
+        static inline const size_t DEQUE_CAPACITY = 1024;
+        static inline const size_t SPIN_ROUNDS = 64;
+
+        using task = std::function<void()>;
+
+        using worker_state = struct {
+            eox::util::WorkDeque<task *> deque;
+            std::condition_variable flag;
+            bool woken;
+        };
+
+        // pool and index of the worker running on current thread (if any)
+        static inline thread_local ThreadPool *current = nullptr;
+        static inline thread_local size_t current_index = 0;
+
+        std::vector<std::unique_ptr<worker_state>> workers;
+        std::vector<std::thread> threads;
+
+        std::deque<task *> injected;
+        std::atomic<size_t> injected_size = 0;
+        std::mutex mutex;
+
+        // indexes of sleeping workers
+        std::vector<size_t> idle;
+        std::atomic<size_t> sleeping = 0;
+        std::mutex idle_mutex;
+
+        std::atomic<bool> stop = true;
+
+        void worker(size_t index) {
+            current = this;
+            current_index = index;
+
+            while (!stop) {
+                if (auto t = next(index)) {
+                    if (*t)
+                        (*t)();
+                    delete t;
+                    continue;
+                }
+
+                // spin for a while, next task usually comes very soon (next stage of the same frame)
+                bool found = false;
+                for (size_t i = 0; i < SPIN_ROUNDS && !found && !stop; i++) {
+                    std::this_thread::yield();
+                    found = pending();
+                }
+
+                if (!found)
+                    park(index);
+            }
+
+            current = nullptr;
+        }
+
+        void submit(task func) {
+            auto t = new task(std::move(func));
+
+            // task spawned by the worker goes to its own deque
+            if (current == this && workers[current_index]->deque.push(t)) {
+                wake();
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                injected.push_back(t);
+                injected_size.fetch_add(1, std::memory_order_seq_cst);
+            }
+
+            wake();
+        }
+
+        task *next(size_t index) {
+            if (auto t = workers[index]->deque.pop())
+                return t;
+
+            if (injected_size.load(std::memory_order_acquire) > 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!injected.empty()) {
+                    auto t = injected.front();
+                    injected.pop_front();
+                    injected_size.fetch_sub(1, std::memory_order_relaxed);
+                    return t;
+                }
+            }
+
+            // start with random victim, so thieves do not fight over the same deque
+            static thread_local std::minstd_rand random(std::random_device{}());
+            const size_t n = workers.size();
+            const size_t offset = random();
+            for (size_t k = 0; k < n; k++) {
+                const size_t victim = (offset + k) % n;
+                if (victim == index)
+                    continue;
+                if (auto t = workers[victim]->deque.steal())
+                    return t;
+            }
+
+            return nullptr;
+        }
+
+        [[nodiscard]] bool pending() const {
+            if (injected_size.load(std::memory_order_seq_cst) > 0)
+                return true;
+            for (const auto &w: workers) {
+                if (!w->deque.empty())
+                    return true;
+            }
+            return false;
+        }
+
+        void park(size_t index) {
+            auto &self = *workers[index];
+            std::unique_lock<std::mutex> lock(idle_mutex);
+
+            // announce sleeping BEFORE the last check, so submitter either sees sleeper or we see the task
+            sleeping.fetch_add(1, std::memory_order_seq_cst);
+            if (stop || pending()) {
+                sleeping.fetch_sub(1, std::memory_order_seq_cst);
+                return;
+            }
+
+            self.woken = false;
+            idle.push_back(index);
+            self.flag.wait(lock, [this, &self]() {
+                return self.woken || stop;
+            });
+
+            if (!self.woken) {
+                // shutdown
+                idle.erase(std::find(idle.begin(), idle.end(), index));
+                sleeping.fetch_sub(1, std::memory_order_seq_cst);
+            }
+        }
+
+        void wake() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (sleeping.load(std::memory_order_seq_cst) == 0)
+                return;
+
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            if (idle.empty())
+                return;
+
+            const auto index = idle.back();
+            idle.pop_back();
+            sleeping.fetch_sub(1, std::memory_order_seq_cst);
+
+            auto &w = *workers[index];
+            w.woken = true;
+            w.flag.notify_one();
+        }
+    };
+
+}
+
+#endif //STEREOX_LEGACY_THREAD_POOL_H
@@ -0,0 +1,79 @@
+//
+// Created by henryco on 2/22/24.
+//
+
+/*
+ * Preprocessing of the camera frame into the input tensor of pose models.
+ *
+ * Compares the chain used before (convert_to_squared_blob: canvas, resize, cvtColor, convertTo,
+ * followed by memcpy into the tensor) with fused letterbox_to_tensor writing into the tensor directly.
+ * Detector: 640x480 letterboxed into 224x224, landmark: 640x480 stretched into 256x256.
+ * Also reports maximum difference of the outputs (bicubic vs bilinear interpolation).
+ *
+ * Usage: preprocess_bench [iterations]
+ */
+
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <opencv2/core.hpp>
+
+#include "../src/aux/dnn/dnn_common.h"
+#include "../src/aux/dnn/dnn_preprocess.h"
+
+namespace {
+
+    template<typename F>
+    double measure(size_t iterations, F &&func) {
+        for (size_t i = 0; i < 10; i++)
+            func();
+
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++)
+            func();
+        const auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::micro>(end - start).count() / (double) iterations;
+    }
+
+    void compare(const char *name, const cv::Mat &frame, int size, bool keep_aspect_ratio, size_t iterations) {
+        std::vector<float> chain_tensor((size_t) size * size * 3);
+        std::vector<float> fused_tensor((size_t) size * size * 3);
+
+        const auto chain = measure(iterations, [&]() {
+            cv::Mat blob = eox::dnn::convert_to_squared_blob(frame, size, keep_aspect_ratio);
+            std::memcpy(chain_tensor.data(), blob.ptr<float>(0), chain_tensor.size() * sizeof(float));
+        });
+
+        const auto fused = measure(iterations, [&]() {
+            eox::dnn::letterbox_to_tensor(frame.data, frame.cols, frame.rows, frame.step[0], frame.channels(),
+                                          size, keep_aspect_ratio, fused_tensor.data());
+        });
+
+        float diff = 0;
+        for (size_t i = 0; i < chain_tensor.size(); i++)
+            diff = std::max(diff, std::abs(chain_tensor[i] - fused_tensor[i]));
+
+        std::printf("%-10s chain %9.1f us   fused %9.1f us   speedup %5.2fx   max diff %.4f\n",
+                    name, chain, fused, chain / fused, diff);
+    }
+
+}
+
+int main(int argc, char **argv) {
+    const size_t iterations = std::max<size_t>(argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000, 1);
+
+    cv::Mat frame(480, 640, CV_8UC3);
+    cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    compare("detector", frame, 224, true, iterations);
+    compare("landmark", frame, 256, false, iterations);
+
+    // roi of the frame, as cropped by the pose pipeline (not continuous)
+    compare("roi", frame(cv::Rect(100, 40, 300, 400)), 256, false, iterations);
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+//
+// Created by henryco on 2/16/24.
+//
+
+/*
+ * Per-task overhead of eox::util::ThreadPool submission.
+ *
+ * Emulates per-frame usage of the pool (StereoCamera, calibration): few small tasks are submitted
+ * from the main thread, then all of their results are collected, repeated for many frames.
+ * Compares the pool as it was before TaskState (see legacy_thread_pool.h: std::function + shared std::promise
+ * + std::future, heap allocated tasks) with TaskState/Future, reports time and number of heap allocations per task.
+ */
+
+#include <new>
+#include <chrono>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <vector>
+#include <functional>
+
+#include "../src/aux/utils/tp/thread_pool.h"
+#include "legacy_thread_pool.h"
+
+namespace {
+    std::atomic<size_t> allocations = 0;
+}
+
+// not inlined, so the compiler does not pair malloc/free with new/delete of call sites (-Wmismatched-new-delete)
+[[gnu::noinline]] void *operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+    const size_t FRAMES = 100000;
+    const size_t WARMUP = 1000;
+    const size_t TASKS_PER_FRAME = 4;
+
+    template<typename Frame>
+    void measure(const char *name, Frame &&frame) {
+        for (size_t i = 0; i < WARMUP; i++)
+            frame();
+
+        const auto allocated = allocations.load();
+        const auto start = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < FRAMES; i++)
+            frame();
+
+        const auto end = std::chrono::steady_clock::now();
+        const auto tasks = (double) (FRAMES * TASKS_PER_FRAME);
+        const auto ns = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+        std::printf("%-10s %10.1f ns/task %8.2f allocations/task\n",
+                    name, ns / tasks, (double) (allocations.load() - allocated) / tasks);
+    }
+
+}
+
+int main(int argc, char **argv) {
+    const size_t threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4;
+
+    // captures similar to StereoCamera::readStreams (does not fit into std::function small buffer)
+    std::vector<int> in(TASKS_PER_FRAME, 1);
+    std::vector<int> scale(TASKS_PER_FRAME, 2);
+    std::vector<int> out(TASKS_PER_FRAME, 0);
+
+    std::vector<std::future<int>> legacy;
+    legacy.reserve(TASKS_PER_FRAME);
+
+    std::vector<eox::util::Future<int>> pooled;
+    pooled.reserve(TASKS_PER_FRAME);
+
+    // one pool at a time, idle workers of the other one do not compete for cpus
+    {
+        eox::bench::legacy::ThreadPool legacy_pool(threads);
+        measure("legacy", [&]() {
+            legacy.clear();
+            for (size_t k = 0; k < TASKS_PER_FRAME; k++) {
+                legacy.push_back(legacy_pool.execute<int>([&in, &scale, &out, k]() -> int {
+                    return out[k] += in[k] * scale[k];
+                }));
+            }
+            for (auto &f: legacy)
+                f.get();
+        });
+    }
+
+    {
+        eox::util::ThreadPool pool(threads);
+        measure("pooled", [&]() {
+            pooled.clear();
+            for (size_t k = 0; k < TASKS_PER_FRAME; k++) {
+                pooled.push_back(pool.execute<int>([&in, &scale, &out, k]() -> int {
+                    return out[k] += in[k] * scale[k];
+                }));
+            }
+            for (auto &f: pooled)
+                f.get();
+        });
+    }
+
+    return 0;
+}
@@ -17,6 +17,50 @@ namespace eox::data {
         BM
     } Algorithm;
 
+    typedef enum {
+        OCV,
+        MMAP,
+        PLAYBACK
+    } Backend;
+
+    typedef enum {
+        GPU,
+        XNNPACK,
+        REFERENCE
+    } Inference;
+
+    typedef enum {
+        /**
+         * relative sleep (condition variable) with drift compensation
+         */
+        DRIFT,
+
+        /**
+         * sleep until absolute deadline (clock_nanosleep with TIMER_ABSTIME), deadlines never accumulate error
+         */
+        DEADLINE
+    } Pacing;
+
+    /**
+     * What to do when iteration takes longer than frame (DEADLINE pacing)
+     */
+    typedef enum {
+        /**
+         * drop missed deadlines, next iteration starts at next deadline of the original schedule (keeps phase)
+         */
+        SKIP,
+
+        /**
+         * run missed iterations back to back until schedule is caught up (at most CATCH_UP_MAX of them)
+         */
+        CATCH_UP,
+
+        /**
+         * shift the schedule, next iteration starts immediately and following deadlines are counted from it
+         */
+        SLIP
+    } Overrun;
+
     typedef struct {
         uint id;
         uint index;
@@ -30,6 +74,19 @@ namespace eox::data {
         bool fast;
         bool homogeneous;
         int api;
+        Backend backend;
+        float tolerance;
+        bool async;
+        std::string session;
+        bool realtime;
+        bool loop;
+        std::string record;
+        int segment_size;
+        int ring_size;
+        bool gray;
+
+        // region of interest in capture resolution: x, y, width, height (empty - whole frame)
+        int roi[4];
     } camera_properties;
 
     typedef struct {
@@ -45,8 +102,41 @@ namespace eox::data {
     typedef struct {
         Algorithm algorithm;
         bool confidence;
+
+        // queue depth in front of each pipeline stage: rectify, match, reproject, render
+        int depth[4];
     } stereo_config;
 
+    typedef struct {
+        // preferred backend, falls back to the next one (gpu -> xnnpack -> reference) if not available
+        Inference backend;
+
+        // cpu threads of xnnpack and reference kernels
+        int threads;
+    } inference_config;
+
+    typedef struct {
+        inference_config detector;
+        inference_config landmark;
+
+        // maximum number of tracked people
+        int poses;
+
+        // number of landmark interpreters (landmarks of tracked people run in parallel)
+        int landmark_instances;
+
+        // segmentation is computed (and shown) only if requested
+        bool segmentation;
+    } pose_config;
+
+    typedef struct {
+        Pacing pacing;
+        Overrun overrun;
+
+        // 0 - as fast as possible
+        int fps;
+    } loop_config;
+
     typedef struct {
         bool denoise;
         float scale;
@@ -55,9 +145,11 @@ namespace eox::data {
         std::vector<camera_properties> camera;
         std::map<uint, std::vector<uint>> groups;
         std::string module;
+        loop_config loop;
         union {
             calibration_config calibration;
             stereo_config stereo;
+            pose_config pose;
         };
     } basic_config;
 }
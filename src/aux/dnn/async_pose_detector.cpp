@@ -0,0 +1,108 @@
+//
+// Created by henryco on 2/23/24.
+//
+
+#include "async_pose_detector.h"
+#include "../utils/sched/thread_sched.h"
+#include "../utils/trace/trace.h"
+
+namespace eox::dnn {
+
+    AsyncPoseDetector::~AsyncPoseDetector() {
+        stop();
+    }
+
+    void AsyncPoseDetector::setInference(const eox::data::inference_config &inference) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (thread) {
+            log->warn("inference backend cannot be changed after start");
+            return;
+        }
+        detector.setInference(inference);
+    }
+
+    void AsyncPoseDetector::setMaxDetections(size_t max) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (thread) {
+            log->warn("number of detections cannot be changed after start");
+            return;
+        }
+        detector.setMaxDetections(max);
+    }
+
+    void AsyncPoseDetector::submit(const cv::Mat &frame, uint64_t id) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!thread) {
+                log->debug("start");
+                running = true;
+                thread = std::make_unique<std::thread>(&AsyncPoseDetector::worker, this);
+            }
+
+            // buffer is reused as long as frame size does not change
+            frame.copyTo(pending);
+            pending_id = id;
+            has_pending = true;
+        }
+        condition.notify_one();
+    }
+
+    bool AsyncPoseDetector::update() {
+        return results.update();
+    }
+
+    const PoseDetections &AsyncPoseDetector::front() {
+        return results.front();
+    }
+
+    void AsyncPoseDetector::worker() {
+        eox::util::apply_thread_sched(eox::util::thread_class::DNN, "detector");
+
+        // owned by the worker, swapped with the pending one
+        cv::Mat current;
+
+        while (true) {
+            uint64_t id;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]() {
+                    return !running || has_pending;
+                });
+                if (!running)
+                    break;
+
+                std::swap(current, pending);
+                id = pending_id;
+                has_pending = false;
+            }
+
+            auto &out = results.back();
+            out.frame = id;
+            try {
+                EOX_TRACE_SPAN("pose::detector");
+                out.poses = detector.inference(current);
+            } catch (const std::exception &e) {
+                log->error("detection of frame {} failed: {}", id, e.what());
+                out.poses.clear();
+            }
+            results.publish();
+        }
+    }
+
+    void AsyncPoseDetector::stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!thread)
+                return;
+            running = false;
+        }
+        condition.notify_all();
+
+        log->debug("wait join");
+        if (thread->joinable())
+            thread->join();
+        thread.reset();
+        log->debug("stopped");
+    }
+
+} // eox
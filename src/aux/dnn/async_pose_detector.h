@@ -0,0 +1,120 @@
+//
+// Created by henryco on 2/23/24.
+//
+
+#ifndef STEREOX_ASYNC_POSE_DETECTOR_H
+#define STEREOX_ASYNC_POSE_DETECTOR_H
+
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <spdlog/logger.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <opencv2/core/mat.hpp>
+
+#include "pose_detector.h"
+#include "../utils/mailbox/triple_buffer.h"
+
+namespace eox::dnn {
+
+    using PoseDetections = struct {
+
+        /**
+         * id of the frame detections come from (see AsyncPoseDetector::submit)
+         */
+        uint64_t frame = 0;
+
+        /**
+         * detections, coordinates normalized to the frame
+         */
+        std::vector<eox::dnn::DetectedPose> poses;
+    };
+
+    /**
+     * @class AsyncPoseDetector
+     * @brief PoseDetector running on its own thread.
+     *
+     * Caller submits frames without waiting, detector always takes the newest submitted frame
+     * (frames submitted while it is busy replace each other) and publishes detections into "latest value" mailbox.
+     * So detection of frame N runs in parallel with whatever caller does with frame N (i.e. landmark inference)
+     * and is picked up with one of the following frames.
+     * Interpreter is created (lazily) on the detector thread, which is required by GPU delegate.
+     *
+     * Example Usage:
+     * @code
+     * detector.submit(frame, id);
+     * if (detector.update())
+     *     use(detector.front());
+     * @endcode
+     */
+    class AsyncPoseDetector {
+        static inline const auto log =
+                spdlog::stdout_color_mt("async_pose_detector");
+
+    private:
+        eox::dnn::PoseDetector detector;
+        eox::util::TripleBuffer<PoseDetections> results;
+
+        std::unique_ptr<std::thread> thread;
+        std::mutex mutex;
+        std::condition_variable condition;
+
+        // guarded by mutex
+        cv::Mat pending;
+        uint64_t pending_id = 0;
+        bool has_pending = false;
+        bool running = false;
+
+        void worker();
+
+    public:
+        AsyncPoseDetector() = default;
+
+        AsyncPoseDetector(const AsyncPoseDetector &other) = delete;
+
+        AsyncPoseDetector &operator=(const AsyncPoseDetector &other) = delete;
+
+        ~AsyncPoseDetector();
+
+        /**
+         * @brief Selects inference backend and number of cpu threads, must be called before the first submit()
+         */
+        void setInference(const eox::data::inference_config &inference);
+
+        /**
+         * @brief Maximum number of detected poses (see PoseDetector::setMaxDetections), before the first submit()
+         */
+        void setMaxDetections(size_t max);
+
+        /**
+         * @brief Hands the frame over to the detector thread (frame is copied), never waits for detection.
+         * Starts detector thread on the first call.
+         * @param frame BGR image (ie. cv::Mat of CV_8UC3)
+         * @param id id of the frame, returned with detections
+         */
+        void submit(const cv::Mat &frame, uint64_t id);
+
+        /**
+         * @brief Takes the newest published detections (if any) into front()
+         * @return true if front() was updated
+         */
+        bool update();
+
+        /**
+         * @return the newest detections taken with update()
+         */
+        [[nodiscard]] const PoseDetections &front();
+
+        /**
+         * Stops and joins the detector thread, pending frame is discarded
+         */
+        void stop();
+    };
+
+} // eox
+
+#endif //STEREOX_ASYNC_POSE_DETECTOR_H
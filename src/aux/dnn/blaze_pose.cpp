@@ -3,31 +3,33 @@
 //
 
 #include "blaze_pose.h"
+#include "dnn_preprocess.h"
 
+#include <cstring>
 #include <filesystem>
 
-#include "tensorflow/lite/delegates/gpu/delegate.h"
+#include "../utils/metrics/metrics.h"
 
 namespace eox::dnn {
 
-    const float *lm_3d_1x195(const tflite::Interpreter &interpreter) {
-        return interpreter.output_tensor(0)->data.f;
+    const float *lm_3d_1x195(const tflite::Interpreter &interpreter, size_t b) {
+        return interpreter.output_tensor(0)->data.f + b * 195;
     }
 
-    const float *lm_world_1x117(const tflite::Interpreter &interpreter) {
-        return interpreter.output_tensor(1)->data.f;
+    const float *lm_world_1x117(const tflite::Interpreter &interpreter, size_t b) {
+        return interpreter.output_tensor(1)->data.f + b * 117;
     }
 
-    const float *heatmap_1x64x64x39(const tflite::Interpreter &interpreter) {
-        return interpreter.output_tensor(2)->data.f;
+    const float *heatmap_1x64x64x39(const tflite::Interpreter &interpreter, size_t b) {
+        return interpreter.output_tensor(2)->data.f + b * 64 * 64 * 39;
     }
 
-    const float *segmentation_1x128x128x1(const tflite::Interpreter &interpreter) {
-        return interpreter.output_tensor(3)->data.f;
+    const float *segmentation_1x128x128x1(const tflite::Interpreter &interpreter, size_t b) {
+        return interpreter.output_tensor(3)->data.f + b * 128 * 128;
     }
 
-    const float *pose_flag_1x1(const tflite::Interpreter &interpreter) {
-        return interpreter.output_tensor(4)->data.f;
+    const float *pose_flag_1x1(const tflite::Interpreter &interpreter, size_t b) {
+        return interpreter.output_tensor(4)->data.f + b;
     }
 
     const std::vector<std::string> BlazePose::outputs = {
@@ -45,11 +47,7 @@ namespace eox::dnn {
         }
     }
 
-    BlazePose::~BlazePose() {
-        if (gpu_delegate) {
-            TfLiteGpuDelegateV2Delete(gpu_delegate);
-        }
-    }
+    BlazePose::~BlazePose() = default;
 
     void BlazePose::init() {
         if (initialized)
@@ -57,31 +55,8 @@ namespace eox::dnn {
 
         log->info("INIT");
 
-        model = std::move(tflite::FlatBufferModel::BuildFromFile(file.c_str()));
-        if (!model) {
-            log->error("Failed to load tflite model");
-            throw std::runtime_error("Failed to load tflite model");
-        }
-
-        tflite::ops::builtin::BuiltinOpResolver resolver;
-        tflite::InterpreterBuilder(*model, resolver)(&interpreter);
-        if (!interpreter) {
-            log->error("Failed to create tflite interpreter");
-            throw std::runtime_error("Failed to create tflite interpreter");
-        }
-
-        TfLiteGpuDelegateOptionsV2 options = TfLiteGpuDelegateOptionsV2Default();
-        gpu_delegate = TfLiteGpuDelegateV2Create(&options);
-
-        if (interpreter->ModifyGraphWithDelegate(gpu_delegate) != kTfLiteOk) {
-            log->error("Failed to modify graph with GPU delegate");
-            throw std::runtime_error("Failed to modify graph with GPU delegate");
-        }
-
-        if (interpreter->AllocateTensors() != kTfLiteOk) {
-            log->error("Failed to allocate tensors for tflite interpreter");
-            throw std::runtime_error("Failed to allocate tensors for tflite interpreter");
-        }
+        runtime.load(file, config);
+        interpreter = runtime.get();
 
         int i = 0;
         for (const auto &item: interpreter->outputs()) {
@@ -95,11 +70,72 @@ namespace eox::dnn {
         initialized = true;
     }
 
+    void BlazePose::setInference(const eox::data::inference_config &inference) {
+        if (initialized) {
+            log->warn("inference backend cannot be changed after init");
+            return;
+        }
+        config = inference;
+    }
+
+    eox::data::Inference BlazePose::getBackend() const {
+        return runtime.getBackend();
+    }
+
+    void BlazePose::setSegmentation(bool enabled) {
+        segmentation = enabled;
+    }
+
+    bool BlazePose::isSegmentation() const {
+        return segmentation;
+    }
+
     PoseOutput BlazePose::inference(cv::InputArray &frame) {
-        cv::Mat blob = eox::dnn::convert_to_squared_blob(frame.getMat(), in_resolution);
+        auto ref = frame.getMat();
+        if (ref.depth() != CV_8U) {
+            cv::Mat blob = eox::dnn::convert_to_squared_blob(ref, in_resolution);
+            return inference(blob.ptr<float>(0));
+        }
+
+        init();
+
+        {
+            // resize, BGR -> RGB and normalization straight into the input tensor [1, 256, 256, 3]
+            EOX_STAGE_LATENCY("preprocess_landmark");
+            eox::dnn::letterbox_to_tensor(ref.data, ref.cols, ref.rows, ref.step[0], ref.channels(),
+                                          in_resolution, false, interpreter->input_tensor(0)->data.f);
+        }
+
+        return run();
+    }
+
+    PoseOutput BlazePose::inference(cv::InputArray &frame, const RoI &roi) {
+        auto ref = frame.getMat();
+
+        float matrix[6];
+        eox::dnn::roi_transform(roi.c.x, roi.c.y, roi.w, roi.h, roi.r, in_resolution, matrix);
+
+        if (ref.depth() != CV_8U) {
+            // tensor -> frame transform is an inverse map for the warp
+            float centers[6];
+            eox::dnn::pixel_centers_transform(matrix, centers);
+            const cv::Mat m(2, 3, CV_32F, centers);
+            cv::Mat warped;
+            cv::warpAffine(ref, warped, m, cv::Size(in_resolution, in_resolution),
+                           cv::INTER_LINEAR | cv::WARP_INVERSE_MAP, cv::BORDER_CONSTANT);
+            return inference(warped);
+        }
+
+        init();
+
+        {
+            // rotated crop, resize, BGR -> RGB and normalization straight into the input tensor [1, 256, 256, 3]
+            EOX_STAGE_LATENCY("preprocess_landmark");
+            eox::dnn::warp_to_tensor(ref.data, ref.cols, ref.rows, ref.step[0], ref.channels(),
+                                     matrix, in_resolution, interpreter->input_tensor(0)->data.f);
+        }
 
-        // [1, 3, 256, 256]
-        return inference(blob.ptr<float>(0));
+        return run();
     }
 
     PoseOutput BlazePose::inference(const float *frame) {
@@ -108,23 +144,121 @@ namespace eox::dnn {
         auto input = interpreter->input_tensor(0)->data.f;
         std::memcpy(input, frame, in_resolution * in_resolution * 3 * 4); // 256*256*3*4 = 786432
 
-        if (interpreter->Invoke() != kTfLiteOk) {
-            log->error("Failed to invoke interpreter");
-            throw std::runtime_error("Failed to invoke interpreter");
+        return run();
+    }
+
+    std::vector<PoseOutput> BlazePose::inference(const std::vector<cv::Mat> &frames, const std::vector<RoI> &rois) {
+        if (frames.size() != rois.size()) {
+            log->error("Number of frames ({}) and regions ({}) differs", frames.size(), rois.size());
+            throw std::runtime_error("Number of frames and regions differs");
+        }
+
+        std::vector<PoseOutput> outputs;
+        if (frames.empty())
+            return outputs;
+
+        init();
+
+        // single one is the regular interpreter, so is a batch not supported by the backend
+        auto *batched_model = frames.size() == 1 ? nullptr : batch(frames.size());
+        const size_t slot = in_resolution * in_resolution * 3;
+
+        const auto fill = [&frames, &rois](float *input, size_t b) {
+            const auto &ref = frames[b];
+            const auto &roi = rois[b];
+
+            float matrix[6];
+            eox::dnn::roi_transform(roi.c.x, roi.c.y, roi.w, roi.h, roi.r, in_resolution, matrix);
+
+            if (ref.depth() != CV_8U) {
+                float centers[6];
+                eox::dnn::pixel_centers_transform(matrix, centers);
+                cv::Mat warped;
+                cv::warpAffine(ref, warped, cv::Mat(2, 3, CV_32F, centers), cv::Size(in_resolution, in_resolution),
+                               cv::INTER_LINEAR | cv::WARP_INVERSE_MAP, cv::BORDER_CONSTANT);
+                cv::Mat blob = eox::dnn::convert_to_squared_blob(warped, in_resolution);
+                std::memcpy(input, blob.ptr<float>(0), in_resolution * in_resolution * 3 * sizeof(float));
+                return;
+            }
+
+            eox::dnn::warp_to_tensor(ref.data, ref.cols, ref.rows, ref.step[0], ref.channels(),
+                                     matrix, in_resolution, input);
+        };
+
+        outputs.reserve(frames.size());
+
+        if (!batched_model) {
+            // one by one on the regular interpreter
+            auto *input = interpreter->input_tensor(0)->data.f;
+            for (size_t b = 0; b < frames.size(); b++) {
+                {
+                    EOX_STAGE_LATENCY("preprocess_landmark");
+                    fill(input, b);
+                }
+                {
+                    EOX_STAGE_LATENCY("invoke_landmark");
+                    runtime.invoke();
+                }
+                outputs.push_back(process(*interpreter, 0, segmentation));
+            }
+            return outputs;
+        }
+
+        auto *input = batched_model->get()->input_tensor(0)->data.f;
+        {
+            EOX_STAGE_LATENCY("preprocess_landmark");
+            for (size_t b = 0; b < frames.size(); b++)
+                fill(input + b * slot, b);
+        }
+
+        {
+            EOX_STAGE_LATENCY("invoke_landmark");
+            batched_model->invoke();
+        }
+
+        for (size_t b = 0; b < frames.size(); b++)
+            outputs.push_back(process(*batched_model->get(), b, segmentation));
+        return outputs;
+    }
+
+    eox::dnn::DnnRuntime *BlazePose::batch(size_t size) {
+        if (const auto it = batched.find(size); it != batched.end())
+            return it->second.get();
+
+        auto cached = std::make_unique<eox::dnn::DnnRuntime>();
+        cached->load(file, config, (int) size);
+
+        // delegate rejected the batched shape, do not let several people run on slower backend than single one
+        if (cached->getBackend() != runtime.getBackend()) {
+            log->warn("batch of {} fell back to {} (regular interpreter runs on {}), regions are inferred one by one",
+                      size, eox::dnn::DnnRuntime::backendName(cached->getBackend()),
+                      eox::dnn::DnnRuntime::backendName(runtime.getBackend()));
+            cached.reset();
+        } else {
+            log->info("batch of {}", size);
+        }
+
+        return (batched[size] = std::move(cached)).get();
+    }
+
+    PoseOutput BlazePose::run() {
+        {
+            EOX_STAGE_LATENCY("invoke_landmark");
+            runtime.invoke();
         }
 
-        return process();
+        return process(*interpreter, 0, segmentation);
     }
 
 
-    PoseOutput BlazePose::process() {
+    PoseOutput BlazePose::process(const tflite::Interpreter &interpreter, size_t b, bool segmentation) {
         PoseOutput output;
 
-        const auto presence = *pose_flag_1x1(*interpreter);
+        const auto presence = *pose_flag_1x1(interpreter, b);
         output.score = presence;
 
-        const float *land_marks_3d = lm_3d_1x195(*interpreter);
-        const float *land_marks_wd = lm_world_1x117(*interpreter);
+        const float *land_marks_3d = lm_3d_1x195(interpreter, b);
+        const float *land_marks_wd = lm_world_1x117(interpreter, b);
 
         for (int i = 0; i < 39; i++) {
             const int j = i * 3;
@@ -146,9 +280,10 @@ namespace eox::dnn {
             };
         }
 
-        const float *s = segmentation_1x128x128x1(*interpreter);
-        for (int i = 0; i < 128 * 128; i++) {
-            output.segmentation[i] = eox::dnn::sigmoid(s[i]);
+        // raw logits, thresholds are compared in logit space (sigmoid(x) > 0.5 <=> x > 0)
+        if (segmentation) {
+            const float *s = segmentation_1x128x128x1(interpreter, b);
+            std::memcpy(output.segmentation, s, 128 * 128 * sizeof(float));
         }
         return output;
     }
@@ -5,6 +5,9 @@
 #ifndef STEREOX_BLAZE_POSE_H
 #define STEREOX_BLAZE_POSE_H
 
+#include <map>
+#include <memory>
+#include <vector>
 #include <opencv2/dnn/dnn.hpp>
 #include <opencv2/imgproc.hpp>
 
@@ -15,6 +18,7 @@
 #include <tensorflow/lite/kernels/register.h>
 
 #include "dnn_common.h"
+#include "dnn_runtime.h"
 
 namespace eox::dnn {
 
@@ -28,14 +32,31 @@ namespace eox::dnn {
 
         static const std::vector<std::string> outputs;
 
-        std::unique_ptr<tflite::FlatBufferModel> model;
-        std::unique_ptr<tflite::Interpreter> interpreter;
-        TfLiteDelegate* gpu_delegate = nullptr;
+        eox::dnn::DnnRuntime runtime;
+        eox::data::inference_config config = {.backend = eox::data::Inference::GPU, .threads = 4};
+        tflite::Interpreter *interpreter = nullptr;
+
+        // interpreters with input resized to [N, 256, 256, 3], by N (created on demand),
+        // null if the backend could not take the batch (fell back to another backend than regular interpreter)
+        std::map<size_t, std::unique_ptr<eox::dnn::DnnRuntime>> batched;
 
         bool initialized = false;
+        bool segmentation = false;
 
     protected:
-        PoseOutput process();
+        PoseOutput run();
+
+        /**
+         * @param segmentation copy segmentation logits as well
+         * @return output of the b-th element of the batch
+         */
+        static PoseOutput process(const tflite::Interpreter &interpreter, size_t b, bool segmentation);
+
+        /**
+         * @return runtime with batch of the size (created on the first use),
+         *         nullptr if it would not run on the same backend as regular interpreter
+         */
+        eox::dnn::DnnRuntime *batch(size_t size);
 
     public:
         BlazePose();
@@ -44,11 +65,44 @@ namespace eox::dnn {
 
         void init();
 
+        /**
+         * @brief Selects inference backend and number of cpu threads, must be called before init()
+         */
+        void setInference(const eox::data::inference_config &inference);
+
+        [[nodiscard]] eox::data::Inference getBackend() const;
+
+        /**
+         * @brief Segmentation (logits) is copied into the output only if requested, disabled by default
+         */
+        void setSegmentation(bool enabled);
+
+        [[nodiscard]] bool isSegmentation() const;
+
         /**
          * @param frame BGR image (ie. cv::Mat of CV_8UC3)
          */
         PoseOutput inference(cv::InputArray &frame);
 
+        /**
+         * @brief Warps rotated region of the frame straight into the input tensor (no crop, no resize)
+         * @param frame BGR image (ie. cv::Mat of CV_8UC3), whole frame
+         * @param roi region of the frame in pixels: center, width, height and rotation
+         * @return landmarks normalized to the region, see roi_transform() to project them back into the frame
+         */
+        PoseOutput inference(cv::InputArray &frame, const RoI &roi);
+
+        /**
+         * @brief Batched inference: every region is warped into its own slot of [N, 256, 256, 3] input tensor
+         * and the model is invoked once (fixed overhead of Invoke is paid once, cpu kernels get bigger GEMMs).
+         * Interpreter of every batch size is created on the first use and cached (memory grows with each size).
+         * If the backend rejects the batch (i.e. GPU delegate), regions are inferred one by one instead.
+         * @param frames BGR images (ie. cv::Mat of CV_8UC3), one per region (i.e. several cameras, or the same frame)
+         * @param rois regions of the frames in pixels, same number as frames
+         * @return output of every region, in order
+         */
+        std::vector<PoseOutput> inference(const std::vector<cv::Mat> &frames, const std::vector<RoI> &rois);
+
         /**
          * @param frame pointer to 256x256 row-oriented 1D array representation of 256x256x3 RGB image
          */
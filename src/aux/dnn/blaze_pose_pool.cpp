@@ -0,0 +1,158 @@
+//
+// Created by henryco on 2/24/24.
+//
+
+#include "blaze_pose_pool.h"
+#include "../utils/sched/thread_sched.h"
+
+namespace eox::dnn {
+
+    BlazePosePool::~BlazePosePool() {
+        stop();
+    }
+
+    void BlazePosePool::setInference(const eox::data::inference_config &inference, size_t _instances) {
+        if (!instances.empty()) {
+            log->warn("inference backend cannot be changed after start");
+            return;
+        }
+        config = inference;
+        size = std::max<size_t>(_instances, 1);
+    }
+
+    void BlazePosePool::start() {
+        log->info("start, instances: {}", size);
+
+        for (size_t i = 0; i < size; i++) {
+            instances.push_back(std::make_unique<eox::dnn::BlazePose>());
+            instances.back()->setInference(config);
+        }
+
+        running = true;
+        for (size_t i = 1; i < size; i++) {
+            threads.emplace_back(&BlazePosePool::worker, this, i);
+        }
+    }
+
+    void BlazePosePool::run(size_t _count, const job_func &_job) {
+        if (instances.empty())
+            start();
+
+        if (_count == 0)
+            return;
+
+        // single job (or instance) is not worth waking anybody up
+        if (_count == 1 || size == 1) {
+            for (size_t i = 0; i < _count; i++)
+                _job(*instances[0], i);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &_job;
+            count = _count;
+            used = std::min(size, _count);
+            remaining = used - 1;
+            error = nullptr;
+            generation++;
+        }
+        started.notify_all();
+
+        // calling thread takes the first instance
+        process(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this]() {
+            return remaining == 0;
+        });
+        job = nullptr;
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    void BlazePosePool::inference(const cv::Mat &frame, const std::vector<RoI> &rois, std::vector<PoseOutput> &out,
+                                  bool segmentation) {
+        out.resize(rois.size());
+        if (rois.empty())
+            return;
+
+        // contiguous and as even as possible
+        const size_t batches = std::min(std::max<size_t>(size, 1), rois.size());
+        run(batches, [&frame, &rois, &out, batches, segmentation](eox::dnn::BlazePose &model, size_t b) {
+            const size_t begin = rois.size() * b / batches;
+            const size_t end = rois.size() * (b + 1) / batches;
+
+            const std::vector<cv::Mat> frames(end - begin, frame);
+            const std::vector<RoI> regions(rois.begin() + (long) begin, rois.begin() + (long) end);
+
+            model.setSegmentation(segmentation);
+            auto outputs = model.inference(frames, regions);
+            for (size_t i = 0; i < outputs.size(); i++)
+                out[begin + i] = outputs[i];
+        });
+    }
+
+    void BlazePosePool::process(size_t index) {
+        for (size_t i = index; i < count; i += used) {
+            try {
+                (*job)(*instances[index], i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                // first exception wins
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+    }
+
+    void BlazePosePool::worker(size_t index) {
+        eox::util::apply_thread_sched(eox::util::thread_class::DNN, "landmark-" + std::to_string(index));
+
+        uint64_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                started.wait(lock, [this, &seen]() {
+                    return !running || generation != seen;
+                });
+                if (!running)
+                    break;
+                seen = generation;
+
+                // not needed for this run
+                if (index >= used)
+                    continue;
+            }
+
+            process(index);
+
+            bool last;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                last = --remaining == 0;
+            }
+            if (last)
+                finished.notify_one();
+        }
+    }
+
+    void BlazePosePool::stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!running)
+                return;
+            running = false;
+        }
+        started.notify_all();
+
+        for (auto &thread: threads) {
+            if (thread.joinable())
+                thread.join();
+        }
+        threads.clear();
+        log->debug("stopped");
+    }
+
+} // eox
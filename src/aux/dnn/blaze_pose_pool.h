@@ -0,0 +1,111 @@
+//
+// Created by henryco on 2/24/24.
+//
+
+#ifndef STEREOX_BLAZE_POSE_POOL_H
+#define STEREOX_BLAZE_POSE_POOL_H
+
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+#include <spdlog/logger.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include "blaze_pose.h"
+
+namespace eox::dnn {
+
+    /**
+     * @class BlazePosePool
+     * @brief Several landmark models (interpreters), each of them bound to its own thread.
+     *
+     * Jobs of run() (i.e. landmarks of every tracked person) are spread across the instances and run in parallel,
+     * first instance runs on the calling thread, others on threads of the pool.
+     * Instance is always invoked by the same thread (required by GPU delegate),
+     * its interpreter is created lazily by that thread.
+     *
+     * Example Usage:
+     * @code
+     * pool.run(tracks.size(), [&](eox::dnn::BlazePose &pose, size_t i) {
+     *     results[i] = pose.inference(frame, tracks[i].roi);
+     * });
+     * @endcode
+     */
+    class BlazePosePool {
+        static inline const auto log =
+                spdlog::stdout_color_mt("blaze_pose_pool");
+
+    public:
+        using job_func = std::function<void(eox::dnn::BlazePose &, size_t)>;
+
+    private:
+        eox::data::inference_config config = {.backend = eox::data::Inference::GPU, .threads = 4};
+        size_t size = 1;
+
+        std::vector<std::unique_ptr<eox::dnn::BlazePose>> instances;
+        std::vector<std::thread> threads;
+
+        // current job, guarded by mutex
+        std::mutex mutex;
+        std::condition_variable started;
+        std::condition_variable finished;
+        const job_func *job = nullptr;
+        size_t count = 0;
+        size_t used = 0;
+        size_t remaining = 0;
+        uint64_t generation = 0;
+        bool running = false;
+        std::exception_ptr error;
+
+        void start();
+
+        void worker(size_t index);
+
+        /**
+         * Runs jobs index, index + used, index + 2 * used ... on the instance
+         */
+        void process(size_t index);
+
+    public:
+        BlazePosePool() = default;
+
+        BlazePosePool(const BlazePosePool &other) = delete;
+
+        BlazePosePool &operator=(const BlazePosePool &other) = delete;
+
+        ~BlazePosePool();
+
+        /**
+         * @brief Selects inference backend of every instance and number of instances, before the first run()
+         */
+        void setInference(const eox::data::inference_config &inference, size_t instances);
+
+        /**
+         * @brief Runs job(instance, i) for every i in [0, count) and waits for all of them.
+         * Exception thrown by any job is rethrown (after all jobs are done).
+         */
+        void run(size_t count, const job_func &job);
+
+        /**
+         * @brief Landmarks of every region of the frame: regions are split into contiguous batches,
+         * one per instance, each batch is a single batched inference (see BlazePose::inference)
+         * @param out output of every region, in order (resized as needed)
+         * @param segmentation segmentation logits are copied into the output as well
+         */
+        void inference(const cv::Mat &frame, const std::vector<RoI> &rois, std::vector<PoseOutput> &out,
+                       bool segmentation = false);
+
+        /**
+         * Stops and joins threads of the pool
+         */
+        void stop();
+    };
+
+} // eox
+
+#endif //STEREOX_BLAZE_POSE_POOL_H
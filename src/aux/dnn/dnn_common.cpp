@@ -168,5 +168,16 @@ namespace eox::dnn {
         return roi;
     }
 
+    float iou(const RoI &a, const RoI &b) {
+        const float w = std::min(a.x + a.w, b.x + b.w) - std::max(a.x, b.x);
+        const float h = std::min(a.y + a.h, b.y + b.h) - std::max(a.y, b.y);
+        if (w <= 0 || h <= 0)
+            return 0;
+
+        const float intersection = w * h;
+        const float total = a.w * a.h + b.w * b.h - intersection;
+        return total > 0 ? intersection / total : 0;
+    }
+
 
 }
\ No newline at end of file
@@ -22,8 +22,19 @@ namespace eox::dnn {
     };
 
     using RoI = struct {
+        /**
+         * axis aligned box (top left corner, width and height)
+         */
         float x, y, w, h;
+
+        /**
+         * center of the (rotated) region
+         */
         Point c;
+
+        /**
+         * rotation of the region around the center, radians
+         */
         float r;
     };
 
@@ -85,7 +96,8 @@ namespace eox::dnn {
         eox::dnn::Coord3d landmarks_3d[39];
 
         /**
-         * 1D 128x128 float32 array
+         * 1D 128x128 float32 array of raw logits (sigmoid gives probability),
+         * filled only if segmentation was requested (see BlazePose::setSegmentation)
          */
         float segmentation[128 * 128];
 
@@ -132,6 +144,11 @@ namespace eox::dnn {
     cv::Mat convert_to_squared_blob(const cv::Mat &in, int size, bool keep_aspect_ratio = false);
 
     RoI clamp_roi(const eox::dnn::RoI &roi, int width, int height);
+
+    /**
+     * @return intersection over union of axis aligned boxes (x, y, w, h) of the regions
+     */
+    float iou(const eox::dnn::RoI &a, const eox::dnn::RoI &b);
 }
 
 #endif //STEREOX_DNN_COMMON_H
\ No newline at end of file
@@ -0,0 +1,301 @@
+//
+// Created by henryco on 2/22/24.
+//
+
+#include "dnn_preprocess.h"
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EOX_PREPROCESS_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define EOX_PREPROCESS_NEON
+#endif
+
+namespace eox::dnn {
+
+    namespace {
+
+        /**
+         * out[i] = a[i] + w * (b[i] - a[i]), vertical interpolation of two source rows
+         */
+        using blend_func = void (*)(const uint8_t *a, const uint8_t *b, float w, float *out, size_t n);
+
+        void blend_rows_scalar(const uint8_t *a, const uint8_t *b, float w, float *out, size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                const auto va = (float) a[i];
+                out[i] = va + w * ((float) b[i] - va);
+            }
+        }
+
+#ifdef EOX_PREPROCESS_X86
+
+        __attribute__((target("avx2,fma")))
+        void blend_rows_avx2(const uint8_t *a, const uint8_t *b, float w, float *out, size_t n) {
+            const __m256 vw = _mm256_set1_ps(w);
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                const __m256 va = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (a + i))));
+                const __m256 vb = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (b + i))));
+                _mm256_storeu_ps(out + i, _mm256_fmadd_ps(vw, _mm256_sub_ps(vb, va), va));
+            }
+            blend_rows_scalar(a + i, b + i, w, out + i, n - i);
+        }
+
+#endif
+
+#ifdef EOX_PREPROCESS_NEON
+
+        void blend_rows_neon(const uint8_t *a, const uint8_t *b, float w, float *out, size_t n) {
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                const uint16x8_t a16 = vmovl_u8(vld1_u8(a + i));
+                const uint16x8_t b16 = vmovl_u8(vld1_u8(b + i));
+                const float32x4_t a_lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(a16)));
+                const float32x4_t a_hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(a16)));
+                const float32x4_t b_lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(b16)));
+                const float32x4_t b_hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(b16)));
+                vst1q_f32(out + i, vmlaq_n_f32(a_lo, vsubq_f32(b_lo, a_lo), w));
+                vst1q_f32(out + i + 4, vmlaq_n_f32(a_hi, vsubq_f32(b_hi, a_hi), w));
+            }
+            blend_rows_scalar(a + i, b + i, w, out + i, n - i);
+        }
+
+#endif
+
+        blend_func select_blend() {
+#if defined(EOX_PREPROCESS_X86)
+            if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+                return &blend_rows_avx2;
+#elif defined(EOX_PREPROCESS_NEON)
+            return &blend_rows_neon;
+#endif
+            return &blend_rows_scalar;
+        }
+
+        const blend_func blend_rows = select_blend();
+
+        /**
+         * Source coordinate (half-pixel centers, same as cv::INTER_LINEAR) of the destination one
+         */
+        void source_coordinate(int dst, float scale, int limit, int &i0, int &i1, float &w) {
+            const float f = std::clamp(((float) dst + .5f) * scale - .5f, 0.f, (float) (limit - 1));
+            i0 = (int) f;
+            i1 = std::min(i0 + 1, limit - 1);
+            w = f - (float) i0;
+        }
+
+        /**
+         * Bilinear sample of 3 (RGB) channels at (x, y), pixel centers, taps outside of the frame are zero
+         */
+        void sample_border(const uint8_t *src, int width, int height, size_t stride, int channels,
+                           const int map[3], float x, float y, float *out) {
+            const float fx = std::floor(x);
+            const float fy = std::floor(y);
+            const int x0 = (int) fx;
+            const int y0 = (int) fy;
+            const float wx = x - fx;
+            const float wy = y - fy;
+
+            const float weights[4] = {(1 - wx) * (1 - wy), wx * (1 - wy), (1 - wx) * wy, wx * wy};
+            const int xs[4] = {x0, x0 + 1, x0, x0 + 1};
+            const int ys[4] = {y0, y0, y0 + 1, y0 + 1};
+
+            out[0] = out[1] = out[2] = 0;
+            for (int t = 0; t < 4; t++) {
+                if (xs[t] < 0 || ys[t] < 0 || xs[t] >= width || ys[t] >= height)
+                    continue;
+                const uint8_t *p = src + (size_t) ys[t] * stride + (size_t) xs[t] * channels;
+                for (int c = 0; c < 3; c++)
+                    out[c] += weights[t] * (float) p[map[c]];
+            }
+        }
+
+        // working buffers of the calling thread
+        thread_local std::vector<float> row;
+        thread_local std::vector<int> x_offsets;
+        thread_local std::vector<float> x_weights;
+    }
+
+    void letterbox_to_tensor(const uint8_t *src,
+                             int width,
+                             int height,
+                             size_t stride,
+                             int channels,
+                             int size,
+                             bool keep_aspect_ratio,
+                             float *dst) {
+        if (channels != 1 && channels != 3 && channels != 4)
+            throw std::runtime_error("Unsupported number of channels: " + std::to_string(channels));
+
+        // geometry of the content (same as get_letterbox_paddings)
+        int n_w = size, n_h = size, s_x = 0, s_y = 0;
+        if (keep_aspect_ratio && (width != size || height != size)) {
+            const float r = (float) width / (float) height;
+            n_w = std::max(1, (int) ((float) size * std::min(1.f, r)));
+            n_h = std::max(1, (int) ((float) n_w / std::max(1.f, r)));
+            s_x = (size - n_w) / 2;
+            s_y = (size - n_h) / 2;
+        }
+
+        const size_t dst_stride = (size_t) size * 3;
+
+        // paddings above and below the content
+        std::memset(dst, 0, (size_t) s_y * dst_stride * sizeof(float));
+        std::memset(dst + (size_t) (s_y + n_h) * dst_stride, 0,
+                    (size_t) (size - s_y - n_h) * dst_stride * sizeof(float));
+
+        // BGR(A) -> RGB, gray is replicated
+        const int map[3] = {
+                channels == 1 ? 0 : 2,
+                channels == 1 ? 0 : 1,
+                0
+        };
+
+        const float scale_x = (float) width / (float) n_w;
+        const float scale_y = (float) height / (float) n_h;
+
+        x_offsets.resize((size_t) n_w * 2);
+        x_weights.resize(n_w);
+        for (int x = 0; x < n_w; x++) {
+            int x0, x1;
+            source_coordinate(x, scale_x, width, x0, x1, x_weights[x]);
+            x_offsets[x * 2 + 0] = x0 * channels;
+            x_offsets[x * 2 + 1] = x1 * channels;
+        }
+
+        const size_t row_size = (size_t) width * channels;
+        row.resize(row_size);
+
+        constexpr float inv = 1.f / 255.f;
+        for (int y = 0; y < n_h; y++) {
+            int y0, y1;
+            float wy;
+            source_coordinate(y, scale_y, height, y0, y1, wy);
+
+            // vertical pass (simd): interpolated source row
+            blend_rows(src + (size_t) y0 * stride, src + (size_t) y1 * stride, wy, row.data(), row_size);
+
+            float *out = dst + (size_t) (s_y + y) * dst_stride;
+
+            // left and right paddings
+            std::memset(out, 0, (size_t) s_x * 3 * sizeof(float));
+            std::memset(out + (size_t) (s_x + n_w) * 3, 0, (size_t) (size - s_x - n_w) * 3 * sizeof(float));
+
+            // horizontal pass: interpolation, channel swap and scale
+            out += (size_t) s_x * 3;
+            const float *in = row.data();
+            for (int x = 0; x < n_w; x++) {
+                const float *p0 = in + x_offsets[x * 2 + 0];
+                const float *p1 = in + x_offsets[x * 2 + 1];
+                const float wx = x_weights[x];
+                for (int c = 0; c < 3; c++) {
+                    const float v0 = p0[map[c]];
+                    out[c] = (v0 + wx * (p1[map[c]] - v0)) * inv;
+                }
+                out += 3;
+            }
+        }
+    }
+
+    void roi_transform(float c_x, float c_y, float w, float h, float rotation, int size, float matrix[6]) {
+        const float cos_r = std::cos(rotation);
+        const float sin_r = std::sin(rotation);
+        const float s_x = w / (float) size;
+        const float s_y = h / (float) size;
+        const float half = (float) size * .5f;
+
+        // frame = c + R * S * (uv - half)
+        matrix[0] = cos_r * s_x;
+        matrix[1] = -sin_r * s_y;
+        matrix[3] = sin_r * s_x;
+        matrix[4] = cos_r * s_y;
+        matrix[2] = c_x - (matrix[0] + matrix[1]) * half;
+        matrix[5] = c_y - (matrix[3] + matrix[4]) * half;
+    }
+
+    void pixel_centers_transform(const float matrix[6], float out[6]) {
+        out[0] = matrix[0];
+        out[1] = matrix[1];
+        out[3] = matrix[3];
+        out[4] = matrix[4];
+        out[2] = matrix[2] + (matrix[0] + matrix[1]) * .5f - .5f;
+        out[5] = matrix[5] + (matrix[3] + matrix[4]) * .5f - .5f;
+    }
+
+    void warp_to_tensor(const uint8_t *src,
+                        int width,
+                        int height,
+                        size_t stride,
+                        int channels,
+                        const float matrix[6],
+                        int size,
+                        float *dst) {
+        if (channels != 1 && channels != 3 && channels != 4)
+            throw std::runtime_error("Unsupported number of channels: " + std::to_string(channels));
+
+        const int map[3] = {
+                channels == 1 ? 0 : 2,
+                channels == 1 ? 0 : 1,
+                0
+        };
+
+        // pixel centers of the tensor into pixel centers of the frame
+        float m[6];
+        pixel_centers_transform(matrix, m);
+        const float m0 = m[0], m1 = m[1], m2 = m[2], m3 = m[3], m4 = m[4], m5 = m[5];
+
+        // bilinear taps (x, x + 1) are both inside of the frame
+        const auto max_x = (float) (width - 1);
+        const auto max_y = (float) (height - 1);
+
+        constexpr float inv = 1.f / 255.f;
+        float *out = dst;
+        for (int v = 0; v < size; v++) {
+            // row of the tensor is a line in the frame (not accumulated, to keep the precision)
+            const float r_x = m1 * (float) v + m2;
+            const float r_y = m4 * (float) v + m5;
+
+            for (int u = 0; u < size; u++, out += 3) {
+                const float x = m0 * (float) u + r_x;
+                const float y = m3 * (float) u + r_y;
+
+                if (x >= 0 && y >= 0 && x < max_x && y < max_y) {
+                    const int x0 = (int) x;
+                    const int y0 = (int) y;
+                    const float wx = x - (float) x0;
+                    const float wy = y - (float) y0;
+
+                    const uint8_t *p0 = src + (size_t) y0 * stride + (size_t) x0 * channels;
+                    const uint8_t *p1 = p0 + stride;
+                    for (int c = 0; c < 3; c++) {
+                        const int k = map[c];
+                        const float top = (float) p0[k] + wx * ((float) p0[k + channels] - (float) p0[k]);
+                        const float bot = (float) p1[k] + wx * ((float) p1[k + channels] - (float) p1[k]);
+                        out[c] = (top + wy * (bot - top)) * inv;
+                    }
+                    continue;
+                }
+
+                if (x <= -1 || y <= -1 || x >= (float) width || y >= (float) height) {
+                    out[0] = out[1] = out[2] = 0;
+                    continue;
+                }
+
+                // edge of the frame
+                sample_border(src, width, height, stride, channels, map, x, y, out);
+                out[0] *= inv;
+                out[1] *= inv;
+                out[2] *= inv;
+            }
+        }
+    }
+
+} // eox
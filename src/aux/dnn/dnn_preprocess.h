@@ -0,0 +1,87 @@
+//
+// Created by henryco on 2/22/24.
+//
+
+#ifndef STEREOX_DNN_PREPROCESS_H
+#define STEREOX_DNN_PREPROCESS_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace eox::dnn {
+
+    /**
+     * @brief Fused preprocessing of the frame into the input tensor of the model:
+     * letterbox (optional), bilinear resize, BGR -> RGB and scale to [0, 1], in a single pass.
+     *
+     * Writes size x size x 3 (row-oriented, interleaved RGB) floats straight into the tensor,
+     * letterbox paddings are zeroed (same geometry as get_letterbox_paddings).
+     * Allocates nothing once the working buffers of the calling thread are warmed up.
+     * Vertical interpolation uses AVX2 (detected at runtime) or NEON, otherwise scalar code.
+     *
+     * @param src first pixel of the frame (8 bit BGR, BGRA or gray)
+     * @param width width of the frame
+     * @param height height of the frame
+     * @param stride bytes between the rows of the frame (views of bigger frames are fine)
+     * @param channels 1, 3 or 4
+     * @param size side of the (square) tensor
+     * @param keep_aspect_ratio letterbox instead of stretching
+     * @param dst input tensor, size * size * 3 floats
+     */
+    void letterbox_to_tensor(const uint8_t *src,
+                             int width,
+                             int height,
+                             size_t stride,
+                             int channels,
+                             int size,
+                             bool keep_aspect_ratio,
+                             float *dst);
+
+    /**
+     * @brief Affine transform of the rotated region of interest, maps tensor coordinates into frame coordinates:
+     * frame = [m0 m1 m2; m3 m4 m5] * (u, v, 1), continuous coordinates (pixel edges, not centers).
+     *
+     * With size = 1 it maps normalized (0,1) tensor coordinates (i.e. landmarks) into frame pixels.
+     *
+     * @param c_x center of the region in the frame
+     * @param c_y center of the region in the frame
+     * @param w width of the region (before rotation)
+     * @param h height of the region (before rotation)
+     * @param rotation rotation of the region, radians (same convention as DetectedPose::rotation)
+     * @param size side of the (square) tensor
+     * @param matrix output, 2x3 row-major
+     */
+    void roi_transform(float c_x, float c_y, float w, float h, float rotation, int size, float matrix[6]);
+
+    /**
+     * @brief Same transform in pixel centers (indices) instead of continuous coordinates,
+     * i.e. in the convention of cv::warpAffine
+     */
+    void pixel_centers_transform(const float matrix[6], float out[6]);
+
+    /**
+     * @brief Fused preprocessing of the rotated region of the frame into the input tensor of the model:
+     * affine warp (bilinear), BGR -> RGB and scale to [0, 1], in a single pass.
+     * Parts of the region outside of the frame are zeroed.
+     *
+     * @param src first pixel of the frame (8 bit BGR, BGRA or gray)
+     * @param width width of the frame
+     * @param height height of the frame
+     * @param stride bytes between the rows of the frame
+     * @param channels 1, 3 or 4
+     * @param matrix tensor -> frame transform (see roi_transform)
+     * @param size side of the (square) tensor
+     * @param dst input tensor, size * size * 3 floats
+     */
+    void warp_to_tensor(const uint8_t *src,
+                        int width,
+                        int height,
+                        size_t stride,
+                        int channels,
+                        const float matrix[6],
+                        int size,
+                        float *dst);
+
+} // eox
+
+#endif //STEREOX_DNN_PREPROCESS_H
@@ -0,0 +1,152 @@
+//
+// Created by henryco on 2/21/24.
+//
+
+#include "dnn_runtime.h"
+
+#include <optional>
+#include <algorithm>
+
+#include <tensorflow/lite/kernels/register.h>
+#include <tensorflow/lite/delegates/gpu/delegate.h>
+#include <tensorflow/lite/delegates/xnnpack/xnnpack_delegate.h>
+
+#include "../utils/sched/thread_sched.h"
+
+namespace eox::dnn {
+
+    DnnRuntime::~DnnRuntime() {
+        release();
+    }
+
+    void DnnRuntime::release() {
+        // interpreter must be gone before its delegate
+        interpreter.reset();
+        if (delegate && delegate_delete)
+            delegate_delete(delegate);
+        delegate = nullptr;
+        delegate_delete = nullptr;
+    }
+
+    bool DnnRuntime::create(eox::data::Inference inference, int threads, int batch) {
+        release();
+
+        // default delegates (xnnpack) are applied explicitly, so reference kernels stay reference
+        tflite::ops::builtin::BuiltinOpResolverWithoutDefaultDelegates resolver;
+        tflite::InterpreterBuilder(*model, resolver)(&interpreter);
+        if (!interpreter) {
+            log->warn("[{}] failed to create tflite interpreter", backendName(inference));
+            return false;
+        }
+
+        interpreter->SetNumThreads(std::max(threads, 1));
+
+        if (batch > 1) {
+            // delegates are prepared for the shape they see, so it has to be final before that
+            const auto *input = interpreter->input_tensor(0);
+            std::vector<int> dims(input->dims->data, input->dims->data + input->dims->size);
+            dims[0] = batch;
+            if (interpreter->ResizeInputTensor(interpreter->inputs()[0], dims) != kTfLiteOk) {
+                log->warn("[{}] failed to resize input tensor to batch of {}", backendName(inference), batch);
+                release();
+                return false;
+            }
+        }
+
+        if (inference == eox::data::Inference::GPU) {
+            TfLiteGpuDelegateOptionsV2 options = TfLiteGpuDelegateOptionsV2Default();
+            delegate = TfLiteGpuDelegateV2Create(&options);
+            delegate_delete = &TfLiteGpuDelegateV2Delete;
+        }
+
+        if (inference == eox::data::Inference::XNNPACK) {
+            TfLiteXNNPackDelegateOptions options = TfLiteXNNPackDelegateOptionsDefault();
+            options.num_threads = std::max(threads, 1);
+            delegate = TfLiteXNNPackDelegateCreate(&options);
+            delegate_delete = &TfLiteXNNPackDelegateDelete;
+        }
+
+        if (inference != eox::data::Inference::REFERENCE && !delegate) {
+            log->warn("[{}] failed to create delegate", backendName(inference));
+            return false;
+        }
+
+        if (delegate && interpreter->ModifyGraphWithDelegate(delegate) != kTfLiteOk) {
+            log->warn("[{}] failed to modify graph with delegate", backendName(inference));
+            release();
+            return false;
+        }
+
+        if (interpreter->AllocateTensors() != kTfLiteOk) {
+            log->warn("[{}] failed to allocate tensors for tflite interpreter", backendName(inference));
+            release();
+            return false;
+        }
+
+        return true;
+    }
+
+    void DnnRuntime::load(const std::string &file, const eox::data::inference_config &config, int batch) {
+        model = tflite::FlatBufferModel::BuildFromFile(file.c_str());
+        if (!model) {
+            log->error("Failed to load tflite model: {}", file);
+            throw std::runtime_error("Failed to load tflite model: " + file);
+        }
+
+        // interpreter (and delegate) threads inherit cpus of the thread which creates them
+        eox::util::ScopedAffinity affinity(eox::util::thread_class::DNN);
+        invoked = false;
+
+        // preferred backend first, then every backend after it
+        for (int i = config.backend; i <= eox::data::Inference::REFERENCE; i++) {
+            const auto inference = (eox::data::Inference) i;
+            if (!create(inference, config.threads, batch)) {
+                log->warn("{} backend is not available for: {}", backendName(inference), file);
+                continue;
+            }
+
+            if (inference != config.backend)
+                log->warn("{}: fallback from {} to {}", file, backendName(config.backend), backendName(inference));
+
+            backend = inference;
+            log->info("{}: {} backend, threads: {}, batch: {}", file, backendName(inference), config.threads, batch);
+            return;
+        }
+
+        log->error("No inference backend is able to run: {}", file);
+        throw std::runtime_error("No inference backend is able to run: " + file);
+    }
+
+    void DnnRuntime::invoke() {
+        // kernels may spawn their workers lazily on the first run, only that one needs the affinity
+        std::optional<eox::util::ScopedAffinity> affinity;
+        if (!invoked)
+            affinity.emplace(eox::util::thread_class::DNN);
+        invoked = true;
+
+        if (interpreter->Invoke() != kTfLiteOk) {
+            log->error("Failed to invoke interpreter");
+            throw std::runtime_error("Failed to invoke interpreter");
+        }
+    }
+
+    tflite::Interpreter *DnnRuntime::get() const {
+        return interpreter.get();
+    }
+
+    eox::data::Inference DnnRuntime::getBackend() const {
+        return backend;
+    }
+
+    std::string DnnRuntime::backendName(eox::data::Inference inference) {
+        switch (inference) {
+            case eox::data::Inference::GPU:
+                return "gpu";
+            case eox::data::Inference::XNNPACK:
+                return "xnnpack";
+            default:
+                return "reference";
+        }
+    }
+
+} // eox
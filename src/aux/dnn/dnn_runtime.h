@@ -0,0 +1,80 @@
+//
+// Created by henryco on 2/21/24.
+//
+
+#ifndef STEREOX_DNN_RUNTIME_H
+#define STEREOX_DNN_RUNTIME_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <spdlog/logger.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include <tensorflow/lite/interpreter.h>
+#include <tensorflow/lite/model_builder.h>
+
+#include "../commons.h"
+
+namespace eox::dnn {
+
+    /**
+     * @class DnnRuntime
+     * @brief TFLite model with interpreter running on selected backend.
+     *
+     * Backends: GPU delegate, XNNPACK delegate (cpu, multithreaded) or reference kernels (cpu).
+     * If preferred backend cannot run the model (i.e. no GPU on the headless server),
+     * the next one is used: gpu -> xnnpack -> reference.
+     */
+    class DnnRuntime {
+        static inline const auto log =
+                spdlog::stdout_color_mt("dnn_runtime");
+
+    private:
+        std::unique_ptr<tflite::FlatBufferModel> model;
+        std::unique_ptr<tflite::Interpreter> interpreter;
+        TfLiteDelegate *delegate = nullptr;
+        void (*delegate_delete)(TfLiteDelegate *) = nullptr;
+        eox::data::Inference backend = eox::data::Inference::REFERENCE;
+        bool invoked = false;
+
+        bool create(eox::data::Inference inference, int threads, int batch);
+
+        void release();
+
+    public:
+        DnnRuntime() = default;
+
+        DnnRuntime(const DnnRuntime &other) = delete;
+
+        DnnRuntime &operator=(const DnnRuntime &other) = delete;
+
+        ~DnnRuntime();
+
+        /**
+         * @brief Loads the model and creates interpreter, falls back to the next backend on failure.
+         * Throws if model cannot be loaded or no backend is able to run it.
+         * @param batch first dimension of the input tensor (and outputs), resized before delegate is applied
+         */
+        void load(const std::string &file, const eox::data::inference_config &config, int batch = 1);
+
+        /**
+         * @brief Runs the model on input tensors, throws on failure
+         */
+        void invoke();
+
+        [[nodiscard]] tflite::Interpreter *get() const;
+
+        /**
+         * @return backend actually used (after fallback)
+         */
+        [[nodiscard]] eox::data::Inference getBackend() const;
+
+        static std::string backendName(eox::data::Inference inference);
+    };
+
+} // eox
+
+#endif //STEREOX_DNN_RUNTIME_H
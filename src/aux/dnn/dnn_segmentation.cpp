@@ -0,0 +1,126 @@
+//
+// Created by henryco on 2/27/24.
+//
+
+#include "dnn_segmentation.h"
+#include "dnn_preprocess.h"
+
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace eox::dnn {
+
+    namespace {
+
+        /**
+         * Narrows [lo, hi] to x for which a * x + b is in [min, max]
+         */
+        void clip_span(float a, float b, float min, float max, float &lo, float &hi) {
+            if (std::abs(a) < 1e-12f) {
+                if (b < min || b > max)
+                    hi = lo - 1;
+                return;
+            }
+            float x0 = (min - b) / a;
+            float x1 = (max - b) / a;
+            if (x0 > x1)
+                std::swap(x0, x1);
+            lo = std::max(lo, x0);
+            hi = std::min(hi, x1);
+        }
+    }
+
+    void segment_to_frame(const uint8_t *src,
+                          size_t src_stride,
+                          uint8_t *dst,
+                          size_t dst_stride,
+                          int width,
+                          int height,
+                          int pixel,
+                          const float *logits,
+                          int size,
+                          const float matrix[6]) {
+        // mask -> frame in pixel centers
+        float m[6];
+        eox::dnn::pixel_centers_transform(matrix, m);
+
+        const float det = m[0] * m[4] - m[1] * m[3];
+        if (std::abs(det) < 1e-12f)
+            return;
+
+        // frame -> mask
+        const float i0 = m[4] / det;
+        const float i1 = -m[1] / det;
+        const float i3 = -m[3] / det;
+        const float i4 = m[0] / det;
+        const float i2 = -(i0 * m[2] + i1 * m[5]);
+        const float i5 = -(i3 * m[2] + i4 * m[5]);
+
+        // bounding box of the region (corners of the mask), clipped to the frame
+        float min_x = (float) width, min_y = (float) height, max_x = -1, max_y = -1;
+        for (const auto &corner: {std::array<float, 2>{-.5f, -.5f},
+                                  std::array<float, 2>{(float) size - .5f, -.5f},
+                                  std::array<float, 2>{-.5f, (float) size - .5f},
+                                  std::array<float, 2>{(float) size - .5f, (float) size - .5f}}) {
+            const float x = m[0] * corner[0] + m[1] * corner[1] + m[2];
+            const float y = m[3] * corner[0] + m[4] * corner[1] + m[5];
+            min_x = std::min(min_x, x);
+            min_y = std::min(min_y, y);
+            max_x = std::max(max_x, x);
+            max_y = std::max(max_y, y);
+        }
+
+        const int x_begin = std::max(0, (int) std::floor(min_x));
+        const int y_begin = std::max(0, (int) std::floor(min_y));
+        const int x_end = std::min(width, (int) std::ceil(max_x) + 1);
+        const int y_end = std::min(height, (int) std::ceil(max_y) + 1);
+
+        const auto limit = (float) (size - 1);
+        for (int y = y_begin; y < y_end; y++) {
+            const uint8_t *in = src + (size_t) y * src_stride;
+            uint8_t *out = dst + (size_t) y * dst_stride;
+
+            // row of the frame is a line in the mask
+            const float r_u = i1 * (float) y + i2;
+            const float r_v = i4 * (float) y + i5;
+
+            // span of the row inside of the rotated region, corners of the bounding box are skipped
+            float lo = (float) x_begin, hi = (float) (x_end - 1);
+            clip_span(i0, r_u, -.5f, limit + .5f, lo, hi);
+            clip_span(i3, r_v, -.5f, limit + .5f, lo, hi);
+            if (lo > hi)
+                continue;
+
+            const int x_lo = std::max(x_begin, (int) std::floor(lo));
+            const int x_hi = std::min(x_end - 1, (int) std::ceil(hi));
+            for (int x = x_lo; x <= x_hi; x++) {
+                // clamped to the edge, half a pixel outside still belongs to the mask
+                const float u_raw = i0 * (float) x + r_u;
+                const float v_raw = i3 * (float) x + r_v;
+                if (u_raw < -.5f || v_raw < -.5f || u_raw > limit + .5f || v_raw > limit + .5f)
+                    continue;
+
+                const float u = std::clamp(u_raw, 0.f, limit);
+                const float v = std::clamp(v_raw, 0.f, limit);
+                const int u0 = (int) u;
+                const int v0 = (int) v;
+                const int u1 = std::min(u0 + 1, size - 1);
+                const int v1 = std::min(v0 + 1, size - 1);
+                const float wu = u - (float) u0;
+                const float wv = v - (float) v0;
+
+                const float *l0 = logits + (size_t) v0 * size;
+                const float *l1 = logits + (size_t) v1 * size;
+                const float top = l0[u0] + wu * (l0[u1] - l0[u0]);
+                const float bot = l1[u0] + wu * (l1[u1] - l1[u0]);
+
+                // sigmoid(logit) > 0.5 <=> logit > 0
+                if (top + wv * (bot - top) > 0)
+                    std::memcpy(out + (size_t) x * pixel, in + (size_t) x * pixel, pixel);
+            }
+        }
+    }
+
+} // eox
@@ -0,0 +1,45 @@
+//
+// Created by henryco on 2/27/24.
+//
+
+#ifndef STEREOX_DNN_SEGMENTATION_H
+#define STEREOX_DNN_SEGMENTATION_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace eox::dnn {
+
+    /**
+     * @brief Fused segmentation of the rotated region: copies pixels of the frame covered by the mask into the output.
+     *
+     * Only the bounding box of the region (clipped to the frame) is visited, every pixel is mapped into the mask,
+     * logits are interpolated (bilinear) and thresholded at 0 (probability 0.5), so no sigmoid is evaluated.
+     * Pixels outside of the mask are left untouched: output is zeroed by the caller once,
+     * then masks of several regions accumulate into it.
+     *
+     * @param src first pixel of the frame
+     * @param src_stride bytes between the rows of the frame
+     * @param dst first pixel of the output (same size and type as the frame)
+     * @param dst_stride bytes between the rows of the output
+     * @param width width of the frame
+     * @param height height of the frame
+     * @param pixel bytes per pixel
+     * @param logits size x size mask (raw logits), row-oriented
+     * @param size side of the mask
+     * @param matrix mask -> frame transform (see roi_transform called with the size of the mask)
+     */
+    void segment_to_frame(const uint8_t *src,
+                          size_t src_stride,
+                          uint8_t *dst,
+                          size_t dst_stride,
+                          int width,
+                          int height,
+                          int pixel,
+                          const float *logits,
+                          int size,
+                          const float matrix[6]);
+
+} // eox
+
+#endif //STEREOX_DNN_SEGMENTATION_H
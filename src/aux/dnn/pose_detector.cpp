@@ -3,7 +3,8 @@
 //
 
 #include "pose_detector.h"
-#include "tensorflow/lite/delegates/gpu/delegate.h"
+#include "dnn_preprocess.h"
+#include "../utils/metrics/metrics.h"
 
 #include <filesystem>
 #include <opencv2/imgproc.hpp>
@@ -18,10 +19,6 @@ namespace eox::dnn {
         const float *detector_scores_1x2254x1(const tflite::Interpreter &interpreter) {
             return interpreter.output_tensor(1)->data.f;
         }
-
-        double normalize_radians(double angle) {
-            return angle - 2 * M_PI * floor((angle + M_PI) / (2 * M_PI));
-        }
     }
 
     const std::vector<std::string> PoseDetector::outputs = {
@@ -36,11 +33,7 @@ namespace eox::dnn {
         }
     }
 
-    PoseDetector::~PoseDetector() {
-        if (gpu_delegate) {
-            TfLiteGpuDelegateV2Delete(gpu_delegate);
-        }
-    }
+    PoseDetector::~PoseDetector() = default;
 
     void PoseDetector::init() {
         if (initialized)
@@ -48,7 +41,7 @@ namespace eox::dnn {
 
         log->info("INIT");
 
-        anchors_vec = eox::dnn::ssd::generate_anchors(eox::dnn::ssd::SSDAnchorOptions(
+        anchors = eox::dnn::ssd::anchor_table(eox::dnn::ssd::generate_anchors(eox::dnn::ssd::SSDAnchorOptions(
                 5,
                 0.15,
                 0.75,
@@ -61,32 +54,15 @@ namespace eox::dnn {
                 false,
                 1.0,
                 true
-        ));
+        )));
 
-        model = std::move(tflite::FlatBufferModel::BuildFromFile(file.c_str()));
-        if (!model) {
-            log->error("Failed to load tflite model");
-            throw std::runtime_error("Failed to load tflite model");
-        }
+        runtime.load(file, config);
+        interpreter = runtime.get();
 
-        tflite::ops::builtin::BuiltinOpResolver resolver;
-        tflite::InterpreterBuilder(*model, resolver)(&interpreter);
-        if (!interpreter) {
-            log->error("Failed to create tflite interpreter");
-            throw std::runtime_error("Failed to create tflite interpreter");
-        }
-
-        TfLiteGpuDelegateOptionsV2 options = TfLiteGpuDelegateOptionsV2Default();
-        gpu_delegate = TfLiteGpuDelegateV2Create(&options);
-
-        if (interpreter->ModifyGraphWithDelegate(gpu_delegate) != kTfLiteOk) {
-            log->error("Failed to modify graph with GPU delegate");
-            throw std::runtime_error("Failed to modify graph with GPU delegate");
-        }
-
-        if (interpreter->AllocateTensors() != kTfLiteOk) {
-            log->error("Failed to allocate tensors for tflite interpreter");
-            throw std::runtime_error("Failed to allocate tensors for tflite interpreter");
+        const auto *scores = interpreter->output_tensor(1);
+        if ((size_t) scores->dims->data[1] != anchors.x.size()) {
+            log->error("Number of anchors ({}) and scores ({}) differs", anchors.x.size(), scores->dims->data[1]);
+            throw std::runtime_error("Number of anchors and scores differs");
         }
 
         int i = 0;
@@ -101,6 +77,18 @@ namespace eox::dnn {
         initialized = true;
     }
 
+    void PoseDetector::setInference(const eox::data::inference_config &inference) {
+        if (initialized) {
+            log->warn("inference backend cannot be changed after init");
+            return;
+        }
+        config = inference;
+    }
+
+    eox::data::Inference PoseDetector::getBackend() const {
+        return runtime.getBackend();
+    }
+
     std::vector<eox::dnn::DetectedPose> PoseDetector::inference(const float *frame, int w, int h) {
         init();
 
@@ -110,18 +98,38 @@ namespace eox::dnn {
         auto input = interpreter->input_tensor(0)->data.f;
         std::memcpy(input, frame, in_resolution * in_resolution * 3 * 4); // 224*224*3*4 = 602112
 
-        if (interpreter->Invoke() != kTfLiteOk) {
-            log->error("Failed to invoke interpreter");
-            throw std::runtime_error("Failed to invoke interpreter");
-        }
-
-        return process();
+        return run();
     }
 
     std::vector<eox::dnn::DetectedPose> PoseDetector::inference(cv::InputArray &frame) {
         auto ref = frame.getMat();
-        cv::Mat blob = eox::dnn::convert_to_squared_blob(ref, in_resolution, true);
-        return inference(blob.ptr<float>(0), ref.cols, ref.rows);
+        if (ref.depth() != CV_8U) {
+            cv::Mat blob = eox::dnn::convert_to_squared_blob(ref, in_resolution, true);
+            return inference(blob.ptr<float>(0), ref.cols, ref.rows);
+        }
+
+        init();
+
+        view_w = ref.cols;
+        view_h = ref.rows;
+
+        {
+            // letterbox, resize, BGR -> RGB and normalization straight into the input tensor
+            EOX_STAGE_LATENCY("preprocess_detector");
+            eox::dnn::letterbox_to_tensor(ref.data, ref.cols, ref.rows, ref.step[0], ref.channels(),
+                                          in_resolution, true, interpreter->input_tensor(0)->data.f);
+        }
+
+        return run();
+    }
+
+    std::vector<eox::dnn::DetectedPose> PoseDetector::run() {
+        {
+            EOX_STAGE_LATENCY("invoke_detector");
+            runtime.invoke();
+        }
+
+        return process();
     }
 
     std::vector<eox::dnn::DetectedPose> PoseDetector::process() {
@@ -132,29 +140,25 @@ namespace eox::dnn {
         const auto bboxes = dtc::detector_bboxes_1x2254x12(*interpreter);
         const auto scores = dtc::detector_scores_1x2254x1(*interpreter);
 
-        std::vector<float> scores_vec;
-        std::vector<std::array<float, 12>> bboxes_vec;
-
-        scores_vec.reserve(2254);
-        bboxes_vec.reserve(2254);
-
-        for (int i = 0; i < 2254; i++) {
-            scores_vec.push_back(scores[i]);
-
-            std::array<float, 12> det_bbox{};
-            for (int k = 0; k < 12; k++) {
-                det_bbox[k] = bboxes[i * 12 + k];
-            }
-            bboxes_vec.push_back(det_bbox);
-        }
-
-        auto boxes = eox::dnn::ssd::decode_bboxes(
-                threshold,
-                scores_vec,
-                bboxes_vec,
-                anchors_vec,
-                in_resolution,
-                true);
+        auto boxes = [&]() {
+            EOX_STAGE_LATENCY("decode_bboxes");
+            // straight from the output tensors
+            auto decoded = eox::dnn::ssd::decode(
+                    scores,
+                    bboxes,
+                    anchors,
+                    threshold,
+                    in_resolution,
+                    max_detections <= 1);
+            if (max_detections <= 1)
+                return decoded;
+
+            // every person is usually covered by several overlapping anchors
+            auto merged = eox::dnn::ssd::weighted_nms(std::move(decoded), nms_threshold);
+            if (merged.size() > max_detections)
+                merged.resize(max_detections);
+            return merged;
+        }();
 
         // correcting letterbox paddings
         const auto p = eox::dnn::get_letterbox_paddings(view_w, view_h, in_resolution);
@@ -186,10 +190,12 @@ namespace eox::dnn {
                 body.y = ((body.y * (float) in_resolution) - p.top) / n_h;
                 body.w = ((body.w * (float) in_resolution)) / n_w;
                 body.h = ((body.h * (float) in_resolution)) / n_h;
+                body.c.x = ((body.c.x * (float) in_resolution) - p.left) / n_w;
+                body.c.y = ((body.c.y * (float) in_resolution) - p.top) / n_h;
                 pose.body = body;
 
-                const float angle = M_PI * 0.5 - std::atan2(-(end[1] - mid[1]), end[0] - mid[0]);
-                pose.rotation = eox::dnn::dtc::normalize_radians(angle);
+                // letterbox keeps aspect ratio, so rotation is the same as in the frame
+                pose.rotation = body.r;
             }
 
             for (int i = 0; i < 4; i++) {
@@ -221,4 +227,12 @@ namespace eox::dnn {
         threshold = _threshold;
     }
 
+    void PoseDetector::setMaxDetections(size_t max) {
+        max_detections = std::max<size_t>(max, 1);
+    }
+
+    size_t PoseDetector::getMaxDetections() const {
+        return max_detections;
+    }
+
 } // eox
\ No newline at end of file
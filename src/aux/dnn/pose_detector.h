@@ -12,8 +12,10 @@
 #include <opencv2/core/mat.hpp>
 
 #include "ssd/ssd_anchors.h"
+#include "ssd/ssd_decode.h"
 #include "roi/pose_roi.h"
 #include "dnn_common.h"
+#include "dnn_runtime.h"
 
 namespace eox::dnn {
 
@@ -56,13 +58,15 @@ namespace eox::dnn {
         static inline const std::string file = "./../models/blazepose_detection_float32.tflite";
         static inline const size_t in_resolution = 224;
         static const std::vector<std::string> outputs;
-        std::unique_ptr<tflite::FlatBufferModel> model;
-        std::unique_ptr<tflite::Interpreter> interpreter;
-        TfLiteDelegate *gpu_delegate = nullptr;
+        eox::dnn::DnnRuntime runtime;
+        eox::data::inference_config config = {.backend = eox::data::Inference::GPU, .threads = 2};
+        tflite::Interpreter *interpreter = nullptr;
         bool initialized = false;
 
-        std::vector<std::array<float, 4>> anchors_vec;
+        eox::dnn::ssd::AnchorTable anchors;
         float threshold = 0.5;
+        float nms_threshold = 0.3;
+        size_t max_detections = 1;
 
         int view_w = 0;
         int view_h = 0;
@@ -70,6 +74,8 @@ namespace eox::dnn {
         eox::dnn::PoseRoi roiPredictor;
 
     protected:
+        std::vector<eox::dnn::DetectedPose> run();
+
         std::vector<eox::dnn::DetectedPose> process();
 
     public:
@@ -79,6 +85,13 @@ namespace eox::dnn {
 
         void init();
 
+        /**
+         * @brief Selects inference backend and number of cpu threads, must be called before init()
+         */
+        void setInference(const eox::data::inference_config &inference);
+
+        [[nodiscard]] eox::data::Inference getBackend() const;
+
         std::vector<eox::dnn::DetectedPose> inference(cv::InputArray &frame);
 
         std::vector<eox::dnn::DetectedPose> inference(const float *frame, int w, int h);
@@ -86,6 +99,14 @@ namespace eox::dnn {
         void setThreshold(float threshold);
 
         [[nodiscard]] float getThreshold() const;
+
+        /**
+         * @brief Maximum number of detected poses: 1 - the best one only,
+         * more - every pose above threshold after weighted non-maximum suppression (ordered by score)
+         */
+        void setMaxDetections(size_t max);
+
+        [[nodiscard]] size_t getMaxDetections() const;
     };
 
 } // eox
@@ -8,6 +8,12 @@
 
 namespace eox::dnn {
 
+    namespace {
+        float normalize_radians(float angle) {
+            return angle - 2.f * (float) M_PI * std::floor((angle + (float) M_PI) / (2.f * (float) M_PI));
+        }
+    }
+
     PoseRoiInput roiFromPoseLandmarks39(const Landmark landmarks[39]) {
         PoseRoiInput output;
         for (int i = 0; i < 39; i++)
@@ -43,11 +49,16 @@ namespace eox::dnn {
         const float x0 = x1 - (w / 2.f);
         const float y0 = y1 - (h / 2.f);
 
+        // vertical (upright) body has zero rotation
+        const float rotation = (float) M_PI * 0.5f - std::atan2(-(y2 - y1), x2 - x1);
+
         return {
                 .x = std::max(0.f, x0 + fix_x),
                 .y = std::max(0.f, y0 + fix_y),
                 .w = std::max(0.f, w),
                 .h = std::max(0.f, h),
+                .c = {.x = x1 + fix_x, .y = y1 + fix_y},
+                .r = normalize_radians(rotation),
         };
     }
 
@@ -5,6 +5,7 @@
 #include "ssd_anchors.h"
 
 #include <cmath>
+#include <algorithm>
 
 namespace eox::dnn::ssd {
 
@@ -157,4 +158,61 @@ namespace eox::dnn::ssd {
 
         return regions;
     }
-}
\ No newline at end of file
+
+    std::vector<eox::dnn::DetectedRegion> weighted_nms(std::vector<eox::dnn::DetectedRegion> regions,
+                                                       float iou_threshold) {
+        std::sort(regions.begin(), regions.end(), [](const auto &a, const auto &b) {
+            return a.score > b.score;
+        });
+
+        std::vector<eox::dnn::DetectedRegion> output;
+        std::vector<bool> merged(regions.size(), false);
+
+        for (size_t i = 0; i < regions.size(); i++) {
+            if (merged[i])
+                continue;
+
+            const auto &best = regions[i];
+            auto region = best;
+            float total = 0;
+            float box[4] = {0, 0, 0, 0};
+            std::vector<Point> points(best.key_points.size(), {0, 0});
+
+            // best one is merged with itself as well
+            for (size_t j = i; j < regions.size(); j++) {
+                if (merged[j] || eox::dnn::iou(best.box, regions[j].box) <= iou_threshold)
+                    continue;
+
+                const auto &other = regions[j];
+                const float w = other.score;
+                merged[j] = true;
+                total += w;
+
+                box[0] += other.box.x * w;
+                box[1] += other.box.y * w;
+                box[2] += other.box.w * w;
+                box[3] += other.box.h * w;
+
+                for (size_t k = 0; k < points.size() && k < other.key_points.size(); k++) {
+                    points[k].x += other.key_points[k].x * w;
+                    points[k].y += other.key_points[k].y * w;
+                }
+            }
+
+            if (total > 0) {
+                region.box.x = box[0] / total;
+                region.box.y = box[1] / total;
+                region.box.w = box[2] / total;
+                region.box.h = box[3] / total;
+                for (size_t k = 0; k < points.size(); k++) {
+                    region.key_points[k].x = points[k].x / total;
+                    region.key_points[k].y = points[k].y / total;
+                }
+            }
+
+            output.push_back(region);
+        }
+
+        return output;
+    }
+}
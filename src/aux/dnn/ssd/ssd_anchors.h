@@ -34,6 +34,14 @@ namespace eox::dnn::ssd {
                                                         const std::vector<std::array<float, 4>> &anchors,
                                                         const float scale = 224.f,
                                                         bool best_only = false);
+
+    /**
+     * @brief Weighted non-maximum suppression: regions overlapping the best one (IoU above threshold)
+     * are merged into it, box and key points are averaged weighted by score, score of the best one is kept.
+     * @return merged regions ordered by score (descending)
+     */
+    std::vector<eox::dnn::DetectedRegion> weighted_nms(std::vector<eox::dnn::DetectedRegion> regions,
+                                                       float iou_threshold);
 }
 
 #endif //STEREOX_SSD_ANCHORS_H
@@ -0,0 +1,194 @@
+//
+// Created by henryco on 2/26/24.
+//
+
+#include "ssd_decode.h"
+
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EOX_SSD_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define EOX_SSD_NEON
+#endif
+
+namespace eox::dnn::ssd {
+
+    namespace {
+
+        using scan_func = size_t (*)(const float *scores, size_t count, float threshold, uint32_t *indices);
+
+        size_t scan_scalar(const float *scores, size_t count, float threshold, uint32_t *indices) {
+            size_t n = 0;
+            for (size_t i = 0; i < count; i++) {
+                // branch free, index is written anyway and kept only if accepted
+                indices[n] = (uint32_t) i;
+                n += scores[i] > threshold;
+            }
+            return n;
+        }
+
+#ifdef EOX_SSD_X86
+
+        __attribute__((target("avx2")))
+        size_t scan_avx2(const float *scores, size_t count, float threshold, uint32_t *indices) {
+            const __m256 vt = _mm256_set1_ps(threshold);
+            size_t n = 0;
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                auto mask = (uint32_t) _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(scores + i), vt, _CMP_GT_OQ));
+                // almost every anchor is rejected
+                while (mask) {
+                    indices[n++] = (uint32_t) i + __builtin_ctz(mask);
+                    mask &= mask - 1;
+                }
+            }
+            for (; i < count; i++) {
+                if (scores[i] > threshold)
+                    indices[n++] = (uint32_t) i;
+            }
+            return n;
+        }
+
+#endif
+
+#ifdef EOX_SSD_NEON
+
+        size_t scan_neon(const float *scores, size_t count, float threshold, uint32_t *indices) {
+            const float32x4_t vt = vdupq_n_f32(threshold);
+            size_t n = 0;
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                const uint32x4_t mask = vcgtq_f32(vld1q_f32(scores + i), vt);
+                // almost every anchor is rejected
+                if (vmaxvq_u32(mask) == 0)
+                    continue;
+                for (size_t k = 0; k < 4; k++) {
+                    if (scores[i + k] > threshold)
+                        indices[n++] = (uint32_t) (i + k);
+                }
+            }
+            for (; i < count; i++) {
+                if (scores[i] > threshold)
+                    indices[n++] = (uint32_t) i;
+            }
+            return n;
+        }
+
+#endif
+
+        scan_func select_scan() {
+#if defined(EOX_SSD_X86)
+            if (__builtin_cpu_supports("avx2"))
+                return &scan_avx2;
+#elif defined(EOX_SSD_NEON)
+            return &scan_neon;
+#endif
+            return &scan_scalar;
+        }
+
+        const scan_func scan = select_scan();
+
+        /**
+         * Probability threshold in logit space: sigmoid(x) > t <=> x > log(t / (1 - t))
+         */
+        float logit(float probability) {
+            if (probability <= 0)
+                return -std::numeric_limits<float>::infinity();
+            if (probability >= 1)
+                return std::numeric_limits<float>::infinity();
+            return std::log(probability / (1.f - probability));
+        }
+
+        // working buffer of the calling thread
+        thread_local std::vector<uint32_t> candidates;
+    }
+
+    AnchorTable anchor_table(const std::vector<std::array<float, 4>> &anchors) {
+        AnchorTable table;
+        table.x.reserve(anchors.size());
+        table.y.reserve(anchors.size());
+        table.w.reserve(anchors.size());
+        table.h.reserve(anchors.size());
+        for (const auto &anchor: anchors) {
+            table.x.push_back(anchor[0]);
+            table.y.push_back(anchor[1]);
+            table.w.push_back(anchor[2]);
+            table.h.push_back(anchor[3]);
+        }
+        return table;
+    }
+
+    size_t scan_scores(const float *scores, size_t count, float threshold, uint32_t *indices) {
+        return scan(scores, count, threshold, indices);
+    }
+
+    std::vector<eox::dnn::DetectedRegion> decode(const float *scores,
+                                                 const float *boxes,
+                                                 const AnchorTable &anchors,
+                                                 float score_thresh,
+                                                 float scale,
+                                                 bool best_only) {
+        std::vector<eox::dnn::DetectedRegion> regions;
+
+        const size_t count = anchors.x.size();
+        candidates.resize(count);
+        size_t accepted = scan(scores, count, logit(score_thresh), candidates.data());
+        if (accepted == 0)
+            return regions;
+
+        if (best_only) {
+            // sigmoid is monotonic, best logit is the best score
+            size_t best = 0;
+            for (size_t k = 1; k < accepted; k++) {
+                if (scores[candidates[k]] > scores[candidates[best]])
+                    best = k;
+            }
+            candidates[0] = candidates[best];
+            accepted = 1;
+        }
+
+        regions.reserve(accepted);
+        for (size_t k = 0; k < accepted; k++) {
+            const uint32_t i = candidates[k];
+            const float *raw = boxes + (size_t) i * 12;
+            const float a_x = anchors.x[i];
+            const float a_y = anchors.y[i];
+            const float s_x = anchors.w[i] / scale;
+            const float s_y = anchors.h[i] / scale;
+
+            const float w = raw[2] * s_x;
+            const float h = raw[3] * s_y;
+            const float c_x = raw[0] * s_x + a_x;
+            const float c_y = raw[1] * s_y + a_y;
+
+            std::vector<Point> key_points(4);
+            for (int kp = 0; kp < 4; kp++) {
+                key_points[kp] = {
+                        .x = raw[4 + kp * 2] * s_x + a_x,
+                        .y = raw[5 + kp * 2] * s_y + a_y,
+                };
+            }
+
+            regions.push_back({
+                    .box = {
+                            .x = c_x - w * 0.5f,
+                            .y = c_y - h * 0.5f,
+                            .w = w,
+                            .h = h,
+                            .c = {.x = c_x, .y = c_y},
+                            .r = 0,
+                    },
+                    .key_points = std::move(key_points),
+                    .score = (float) eox::dnn::sigmoid(scores[i]),
+                    .rotation = 0,
+            });
+        }
+
+        return regions;
+    }
+
+}
@@ -0,0 +1,60 @@
+//
+// Created by henryco on 2/26/24.
+//
+
+#ifndef STEREOX_SSD_DECODE_H
+#define STEREOX_SSD_DECODE_H
+
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "../dnn_common.h"
+
+namespace eox::dnn::ssd {
+
+    /**
+     * Anchors as structure of arrays: x center, y center, width, height
+     */
+    typedef struct {
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> w;
+        std::vector<float> h;
+    } AnchorTable;
+
+    AnchorTable anchor_table(const std::vector<std::array<float, 4>> &anchors);
+
+    /**
+     * @brief Decodes SSD output straight from output tensors (nothing is copied).
+     *
+     * Threshold is compared with raw scores in logit space, so sigmoid is evaluated only for accepted anchors,
+     * scores are scanned with AVX2 (detected at runtime) or NEON, otherwise scalar code.
+     * Only accepted anchors are decoded.
+     *
+     * @param scores raw scores (logits), one per anchor
+     * @param boxes raw boxes, 12 values per anchor: box (4) and 4 key points (x, y)
+     * @param anchors anchor table, same number of anchors as scores
+     * @param score_thresh probability threshold (0, 1)
+     * @param scale input resolution of the model
+     * @param best_only decode only the best anchor
+     * @return regions (normalized coordinates), in order of anchors
+     */
+    std::vector<eox::dnn::DetectedRegion> decode(const float *scores,
+                                                 const float *boxes,
+                                                 const AnchorTable &anchors,
+                                                 float score_thresh,
+                                                 float scale,
+                                                 bool best_only = false);
+
+    /**
+     * @brief Indices of scores greater than the threshold (in order)
+     * @param indices output, at least count elements
+     * @return number of indices written
+     */
+    size_t scan_scores(const float *scores, size_t count, float threshold, uint32_t *indices);
+
+}
+
+#endif //STEREOX_SSD_DECODE_H
@@ -6,6 +6,7 @@
 #include <utility>
 #include <gtkmm/eventbox.h>
 #include "gl_image.h"
+#include "../utils/trace/trace.h"
 
 namespace eox::xgtk {
 
@@ -33,6 +34,7 @@ namespace eox::xgtk {
                 return true;
             }
 
+            EOX_TRACE_SPAN("gl::render");
             glClearColor(.0f, .0f, .0f, .0f);
             glClear(GL_COLOR_BUFFER_BIT);
 
@@ -0,0 +1,100 @@
+//
+// Created by henryco on 2/14/24.
+//
+
+#include "frame_pool.h"
+
+#include <vector>
+
+namespace eox::ocv {
+
+    FramePool::FramePool(cv::UMatUsageFlags _usage) : usage(_usage) {
+    }
+
+    bool FramePool::shared(const cv::Mat &buffer) {
+        return buffer.u && buffer.u->refcount > 1;
+    }
+
+    bool FramePool::shared(const cv::UMat &buffer) {
+        // other UMat headers or host mappings (getMat) of the same data
+        return buffer.u && (buffer.u->urefcount > 1 || buffer.u->refcount > 0);
+    }
+
+    template<typename M>
+    FramePool::key FramePool::key_of(const M &buffer) {
+        return {buffer.rows, buffer.cols, buffer.type()};
+    }
+
+    template<typename M>
+    M &FramePool::acquire(std::map<key, bucket<M>> &buckets, cv::Size size, int type, cv::UMatUsageFlags flags) {
+        auto &b = buckets[{size.height, size.width, type}];
+
+        for (; b.used < b.buffers.size(); b.used++) {
+            auto &buffer = b.buffers[b.used];
+            if (shared(buffer))
+                continue;
+            b.used++;
+            buffer.create(size, type);
+            return buffer;
+        }
+
+        // deque never moves elements on push, so handed out references stay valid
+        if constexpr (std::is_same_v<M, cv::UMat>)
+            b.buffers.emplace_back(size, type, flags);
+        else
+            b.buffers.emplace_back(size, type);
+
+        b.used = b.buffers.size();
+        return b.buffers.back();
+    }
+
+    template<typename M>
+    void FramePool::recycle(std::map<key, bucket<M>> &buckets) {
+        std::vector<M> moved;
+
+        for (auto &[k, b]: buckets) {
+            b.used = 0;
+
+            // buffer reallocated by some function to different size or type goes to matching bucket
+            for (auto it = b.buffers.begin(); it != b.buffers.end();) {
+                if (it->empty() || key_of(*it) == k) {
+                    ++it;
+                    continue;
+                }
+                moved.push_back(std::move(*it));
+                it = b.buffers.erase(it);
+            }
+        }
+
+        for (auto &buffer: moved) {
+            buckets[key_of(buffer)].buffers.push_back(std::move(buffer));
+        }
+    }
+
+    template<typename M>
+    size_t FramePool::count(const std::map<key, bucket<M>> &buckets) {
+        size_t total = 0;
+        for (const auto &[k, b]: buckets) {
+            total += b.buffers.size();
+        }
+        return total;
+    }
+
+    cv::Mat &FramePool::mat(cv::Size size, int type) {
+        return acquire(mats, size, type, usage);
+    }
+
+    cv::UMat &FramePool::umat(cv::Size size, int type) {
+        return acquire(umats, size, type, usage);
+    }
+
+    void FramePool::recycle() {
+        recycle(mats);
+        recycle(umats);
+    }
+
+    size_t FramePool::size() const {
+        return count(mats) + count(umats);
+    }
+
+} // eox
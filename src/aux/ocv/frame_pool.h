@@ -0,0 +1,90 @@
+//
+// Created by henryco on 2/14/24.
+//
+
+#ifndef STEREOX_FRAME_POOL_H
+#define STEREOX_FRAME_POOL_H
+
+#include <map>
+#include <deque>
+#include <tuple>
+#include <opencv2/core/mat.hpp>
+
+namespace eox::ocv {
+
+    /**
+     * @class FramePool
+     * @brief Reusable per-frame buffers (cv::Mat and cv::UMat) keyed by size and type.
+     *
+     * Pipeline draws temporary buffers during the frame and returns all of them at once with recycle(),
+     * so after the first few frames no heap (nor OpenCL) allocation happens at all.
+     * Buffers are handed out already allocated, OpenCV functions reuse them as long as size and type matches.
+     * Buffer still referenced outside the pool (e.g. kept by renderer) is skipped until it's released.
+     *
+     * @note Pool is NOT thread safe, use one pool per pipeline
+     */
+    class FramePool {
+    private:
+        using key = std::tuple<int, int, int>;
+
+        template<typename M>
+        struct bucket {
+            std::deque<M> buffers;
+            size_t used = 0;
+        };
+
+        std::map<key, bucket<cv::Mat>> mats;
+        std::map<key, bucket<cv::UMat>> umats;
+        cv::UMatUsageFlags usage;
+
+        static bool shared(const cv::Mat &buffer);
+
+        static bool shared(const cv::UMat &buffer);
+
+        template<typename M>
+        static key key_of(const M &buffer);
+
+        template<typename M>
+        static M &acquire(std::map<key, bucket<M>> &buckets, cv::Size size, int type, cv::UMatUsageFlags flags);
+
+        template<typename M>
+        static void recycle(std::map<key, bucket<M>> &buckets);
+
+        template<typename M>
+        static size_t count(const std::map<key, bucket<M>> &buckets);
+
+    public:
+        /**
+         * @param usage usage flags of cv::UMat buffers
+         */
+        explicit FramePool(cv::UMatUsageFlags usage = cv::USAGE_DEFAULT);
+
+        FramePool(const FramePool &other) = delete;
+
+        FramePool &operator=(const FramePool &other) = delete;
+
+        /**
+         * @return buffer (content is undefined) valid until recycle()
+         */
+        cv::Mat &mat(cv::Size size, int type);
+
+        /**
+         * @return buffer (content is undefined) valid until recycle()
+         */
+        cv::UMat &umat(cv::Size size, int type);
+
+        /**
+         * Returns every buffer handed out since previous call back to the pool,
+         * usually called once per frame
+         */
+        void recycle();
+
+        /**
+         * @return number of buffers owned by the pool
+         */
+        [[nodiscard]] size_t size() const;
+    };
+
+} // eox
+
+#endif //STEREOX_FRAME_POOL_H
@@ -0,0 +1,134 @@
+//
+// Created by henryco on 2/13/24.
+//
+
+#include "jpeg_decoder.h"
+
+#include <cstring>
+#include <algorithm>
+
+namespace eox::ocv {
+
+    void JpegDecoder::onError(j_common_ptr info) {
+        // libjpeg would call exit() by default, jump back to decoder instead
+        auto error = reinterpret_cast<error_manager *>(info->err);
+        (*info->err->format_message)(info, error->message);
+        longjmp(error->jump, 1);
+    }
+
+    void JpegDecoder::onMessage(j_common_ptr) {
+        // corrupted (e.g. truncated) MJPEG frames are common, warnings are not interesting
+    }
+
+    JpegDecoder::JpegDecoder() {
+        info.err = jpeg_std_error(&error.manager);
+        error.manager.error_exit = onError;
+        error.manager.output_message = onMessage;
+
+        if (setjmp(error.jump)) {
+            log->error("Cannot create decompressor: {}", error.message);
+            throw std::runtime_error("Cannot create decompressor: " + std::string(error.message));
+        }
+
+        jpeg_create_decompress(&info);
+    }
+
+    JpegDecoder::~JpegDecoder() {
+        jpeg_destroy_decompress(&info);
+    }
+
+    JpegDecoder &JpegDecoder::local() {
+        static thread_local JpegDecoder decoder;
+        return decoder;
+    }
+
+    bool JpegDecoder::decode(const void *data, size_t bytes, cv::Mat &out, const JpegOptions &options) {
+        if (!data || bytes == 0)
+            return false;
+
+        if (!decompress(static_cast<const uint8_t *>(data), bytes, out, options)) {
+            log->debug("Cannot decode frame: {}", error.message);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool JpegDecoder::decompress(const uint8_t *data, size_t bytes, cv::Mat &out, const JpegOptions &options) {
+        // nothing with non-trivial destructor may live in this scope, longjmp would skip it
+        if (setjmp(error.jump)) {
+            jpeg_abort_decompress(&info);
+            return false;
+        }
+
+        jpeg_mem_src(&info, data, bytes);
+        jpeg_read_header(&info, TRUE);
+
+        // BGR straight from the decoder, no extra conversion later
+        info.out_color_space = options.gray ? JCS_GRAYSCALE : JCS_EXT_BGR;
+
+        const cv::Rect full(0, 0, (int) info.image_width, (int) info.image_height);
+        const cv::Rect roi = options.roi.empty() ? full : (options.roi & full);
+        if (roi.empty()) {
+            jpeg_abort_decompress(&info);
+            std::strcpy(error.message, "Region of interest is out of image");
+            return false;
+        }
+
+        // DCT scaling is almost free, unlike decoding full frame and resizing it afterwards
+        int denominator = 1;
+        if (!options.size.empty()) {
+            while (denominator < 8
+                   && roi.width / (denominator * 2) >= options.size.width
+                   && roi.height / (denominator * 2) >= options.size.height) {
+                denominator *= 2;
+            }
+        }
+        info.scale_num = 1;
+        info.scale_denom = denominator;
+
+        jpeg_start_decompress(&info);
+
+        // region of interest in scaled coordinates
+        const int x0 = roi.x / denominator;
+        const int y0 = roi.y / denominator;
+        const int x1 = std::min((int) info.output_width, (roi.x + roi.width + denominator - 1) / denominator);
+        const int y1 = std::min((int) info.output_height, (roi.y + roi.height + denominator - 1) / denominator);
+
+        JDIMENSION x = x0;
+        JDIMENSION width = x1 - x0;
+        if (width != info.output_width) {
+            // decoder crops at iMCU boundary, so resulting columns might start a bit earlier
+            jpeg_crop_scanline(&info, &x, &width);
+        }
+
+        const int channels = info.output_components;
+        const size_t shift = (size_t) (x0 - (int) x) * channels;
+        const bool direct = shift == 0 && width == (JDIMENSION) (x1 - x0);
+
+        out.create(y1 - y0, x1 - x0, channels == 1 ? CV_8UC1 : CV_8UC3);
+        if (!direct)
+            line.resize((size_t) width * channels);
+
+        if (y0 > 0)
+            jpeg_skip_scanlines(&info, y0);
+
+        while (info.output_scanline < (JDIMENSION) y1) {
+            const int row = (int) info.output_scanline - y0;
+            JSAMPROW target = direct ? out.ptr<uint8_t>(row) : line.data();
+            jpeg_read_scanlines(&info, &target, 1);
+            if (!direct)
+                std::memcpy(out.ptr<uint8_t>(row), line.data() + shift, out.cols * channels);
+        }
+
+        if (info.output_scanline < info.output_height) {
+            // the rest of image is not needed
+            jpeg_abort_decompress(&info);
+        } else {
+            jpeg_finish_decompress(&info);
+        }
+
+        return true;
+    }
+
+} // eox
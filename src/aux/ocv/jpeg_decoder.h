@@ -0,0 +1,95 @@
+//
+// Created by henryco on 2/13/24.
+//
+
+#ifndef STEREOX_JPEG_DECODER_H
+#define STEREOX_JPEG_DECODER_H
+
+#include <csetjmp>
+#include <cstdio>
+#include <vector>
+#include <jpeglib.h>
+#include <opencv2/core/mat.hpp>
+#include <spdlog/logger.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+namespace eox::ocv {
+
+    typedef struct {
+        /**
+         * decode to single channel (luma only) matrix instead of BGR
+         */
+        bool gray;
+
+        /**
+         * minimal size of decoded image, decoder picks the largest DCT downscale (1/2, 1/4, 1/8)
+         * that still covers it (empty - full resolution)
+         */
+        cv::Size size;
+
+        /**
+         * region of interest in full resolution coordinates,
+         * only this part of the image is decoded (empty - whole image)
+         */
+        cv::Rect roi;
+    } jpeg_options;
+
+    using JpegOptions = jpeg_options;
+
+    /**
+     * @class JpegDecoder
+     * @brief Reusable libjpeg-turbo decompressor, supports scaled and cropped decoding.
+     *
+     * Decompressor is expensive to create, so single instance should be reused for all the frames,
+     * decoder is NOT thread safe, use local() to get instance owned by calling thread.
+     */
+    class JpegDecoder {
+        static inline const auto log =
+                spdlog::stdout_color_mt("jpeg_decoder");
+
+    private:
+        using error_manager = struct {
+            jpeg_error_mgr manager;
+            jmp_buf jump;
+            char message[JMSG_LENGTH_MAX];
+        };
+
+        jpeg_decompress_struct info{};
+        error_manager error{};
+        std::vector<uint8_t> line;
+
+        static void onError(j_common_ptr info);
+
+        static void onMessage(j_common_ptr info);
+
+        bool decompress(const uint8_t *data, size_t bytes, cv::Mat &out, const JpegOptions &options);
+
+    public:
+        JpegDecoder();
+
+        JpegDecoder(const JpegDecoder &other) = delete;
+
+        JpegDecoder &operator=(const JpegDecoder &other) = delete;
+
+        ~JpegDecoder();
+
+        /**
+         * @brief Decodes JPEG (MJPEG frame) into BGR or grayscale matrix.
+         *
+         * @param data compressed data
+         * @param bytes size of compressed data
+         * @param out output matrix (reallocated only if its size or type does not match)
+         * @param options scaled/cropped decoding options
+         * @return false if data cannot be decoded
+         */
+        bool decode(const void *data, size_t bytes, cv::Mat &out, const JpegOptions &options = {});
+
+        /**
+         * @return decoder owned by calling thread
+         */
+        static JpegDecoder &local();
+    };
+
+} // eox
+
+#endif //STEREOX_JPEG_DECODER_H
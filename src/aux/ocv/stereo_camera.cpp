@@ -4,9 +4,15 @@
 
 #include "./../v4l2/linux_video.h"
 #include "stereo_camera.h"
+#include "jpeg_decoder.h"
+#include "../utils/trace/trace.h"
+#include "../utils/metrics/metrics.h"
 
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
 #include <utility>
 #include <iostream>
+#include <numeric>
 
 namespace eox::xocv {
 
@@ -18,6 +24,10 @@ namespace eox::xocv {
                 name[3]);
     }
 
+    bool is_mjpeg(const eox::data::camera_properties &prop) {
+        return fourCC(prop.codec) == cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+    }
+
     void init_from_params(cv::VideoCapture &capture, const eox::data::camera_properties &prop, int api) {
         std::vector<int> params;
         params.assign({
@@ -27,11 +37,74 @@ namespace eox::xocv {
                               cv::CAP_PROP_FPS, prop.fps,
                               cv::CAP_PROP_BUFFERSIZE, prop.buffer
                       });
+        if (api == cv::CAP_V4L2 && is_mjpeg(prop)) {
+            // hand out compressed frames, they are decoded by eox::ocv::JpegDecoder instead
+            params.insert(params.end(), {cv::CAP_PROP_CONVERT_RGB, 0});
+        }
         capture.open((int) prop.index, api, params);
     }
 
+    /**
+     * @return region of interest (if any) clamped to frame,
+     *         for YUYV aligned to macro pixel (two pixels sharing chroma)
+     */
+    cv::Rect frame_region(const eox::v4l2::V4L2_Frame &frame, const eox::ocv::JpegOptions &options) {
+        const cv::Rect full(0, 0, (int) frame.width, (int) frame.height);
+        if (options.roi.empty())
+            return full;
+
+        auto region = options.roi & full;
+        if (frame.fourcc == V4L2_PIX_FMT_YUYV) {
+            const int x = region.x & ~1;
+            region.width = std::min(full.width - x, (region.x + region.width - x + 1) & ~1);
+            region.x = x;
+        }
+        return region;
+    }
+
+    /**
+     * @param options grayscale mode, region of interest and (for MJPEG only) scaled decoding
+     * @return true if resulting matrix wraps kernel buffer (zero-copy), false if frame was decoded
+     */
+    bool frame_to_mat(const eox::v4l2::V4L2_Frame &frame, cv::Mat &out, const eox::ocv::JpegOptions &options) {
+        const int w = (int) frame.width;
+        const int h = (int) frame.height;
+        const bool gray = options.gray;
+
+        switch (frame.fourcc) {
+            case V4L2_PIX_FMT_MJPEG:
+            case V4L2_PIX_FMT_JPEG:
+                // decoder writes straight to the output, decoding only requested region at requested scale
+                // (in grayscale mode decoder skips chroma upsampling and color conversion)
+                if (!eox::ocv::JpegDecoder::local().decode(frame.data, frame.bytes, out, options))
+                    out = cv::Mat();
+                return false;
+            case V4L2_PIX_FMT_YUYV:
+                // in grayscale mode just pick Y samples
+                cv::cvtColor(cv::Mat(h, w, CV_8UC2, frame.data, frame.stride)(frame_region(frame, options)), out,
+                             gray ? cv::COLOR_YUV2GRAY_YUYV : cv::COLOR_YUV2BGR_YUYV);
+                return false;
+            case V4L2_PIX_FMT_BGR24:
+                if (gray) {
+                    cv::cvtColor(cv::Mat(h, w, CV_8UC3, frame.data, frame.stride)(frame_region(frame, options)), out,
+                                 cv::COLOR_BGR2GRAY);
+                    return false;
+                }
+                out = cv::Mat(h, w, CV_8UC3, frame.data, frame.stride)(frame_region(frame, options));
+                return true;
+            case V4L2_PIX_FMT_GREY:
+                out = cv::Mat(h, w, CV_8UC1, frame.data, frame.stride)(frame_region(frame, options));
+                return true;
+            default:
+                out = cv::Mat();
+                return false;
+        }
+    }
+
     StereoCamera::StereoCamera(StereoCamera &&other) noexcept:
             captures(std::move(other.captures)),
+            streams(std::move(other.streams)),
+            held(std::move(other.held)),
             properties(std::move(other.properties)),
             properties_map(std::move(other.properties_map)),
             executor(std::move(other.executor)) {}
@@ -41,7 +114,7 @@ namespace eox::xocv {
     }
 
     std::vector<camera_controls> StereoCamera::getControls(bool _homogeneous) {
-        if (api == cv::CAP_V4L2) {
+        if (isControllable()) {
             std::vector<camera_controls> vec;
             for (const auto &prop: properties) {
 
@@ -92,6 +165,66 @@ namespace eox::xocv {
     }
 
     std::vector<cv::Mat> StereoCamera::capture() {
+        EOX_TRACE_SPAN("camera::capture");
+        static auto &captured = eox::util::metrics_counter(
+                "eox_capture_frames_total", "Captured frame sets (every device)", "result=\"ok\"");
+        static auto &failed = eox::util::metrics_counter(
+                "eox_capture_frames_total", "Captured frame sets (every device)", "result=\"empty\"");
+
+        auto frames = async ? captureLatest() : captureDevices();
+        (frames.empty() ? failed : captured).add();
+        return frames;
+    }
+
+    std::vector<cv::Mat> StereoCamera::captureLatest() {
+        if (!mailbox.update()) {
+            EOX_STAGE_LATENCY("capture_wait");
+            std::unique_lock<std::mutex> lock(mutex);
+            flag.wait_for(lock, MAILBOX_TIMEOUT, [this]() {
+                return mailbox.fresh() || !alive;
+            });
+            lock.unlock();
+
+            if (!mailbox.update())
+                return {};
+        }
+        return mailbox.front();
+    }
+
+    void StereoCamera::captureWorker() {
+        auto backoff = FAILURE_BACKOFF_MIN;
+        while (alive) {
+            auto frames = captureDevices();
+            if (frames.empty()) {
+                if (backend == eox::data::Backend::PLAYBACK && player.isOver()) {
+                    log->info("playback is over, capture thread stops");
+                    break;
+                }
+
+                // failing device (or one which is gone) is not polled in a busy loop
+                std::this_thread::sleep_for(backoff);
+                backoff = std::min(backoff * 2, FAILURE_BACKOFF_MAX);
+                continue;
+            }
+            backoff = FAILURE_BACKOFF_MIN;
+
+            mailbox.back() = std::move(frames);
+            mailbox.publish();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                flag.notify_all();
+            }
+        }
+    }
+
+    std::vector<cv::Mat> StereoCamera::captureDevices() {
+        EOX_TRACE_SPAN("camera::grab");
+        if (backend == eox::data::Backend::MMAP)
+            return captureStreams();
+        if (backend == eox::data::Backend::PLAYBACK)
+            return captureSession();
+
         std::vector<cv::Mat> frames;
 
         if (captures.empty()) {
@@ -109,28 +242,42 @@ namespace eox::xocv {
 
         if (fast) {
             // faster because it calls for buffer often, but less synchronized method of grabbing frames
+            EOX_STAGE_LATENCY("capture_wait");
             if (!cv::VideoCapture::waitAny(cameras, ready))
                 return {};
         } else {
             // slower, but more precise (synchronized) method of grabbing frames
+            EOX_STAGE_LATENCY("capture_wait");
             for (auto &item: cameras) {
                 if (!item.grab())
                     return {};
             }
         }
 
-        std::vector<std::future<cv::Mat>> results;
-        results.reserve(captures.size());
-        for (auto &capture: captures) {
-            results.push_back(executor->execute<cv::Mat>([&capture]() mutable -> cv::Mat {
-                cv::Mat frame;
-                capture->retrieve(frame);
-                return frame;
-            }));
-        }
+        // retrieve (and decode) frames in parallel, calling thread takes one of them
+        std::vector<cv::Mat> retrieved(captures.size());
+        std::vector<cv::Mat> raw(captures.size());
+        executor->parallel_for(0, captures.size(), [this, &retrieved, &raw](size_t i) {
+            EOX_STAGE_LATENCY("retrieve");
+            auto &out = retrieved[i];
+
+            auto &frame = raw[i];
+            captures[i]->retrieve(frame);
+            if (frame.rows == 1 && frame.type() == CV_8UC1) {
+                // raw MJPEG frame (RGB conversion is disabled), decoded by decoder owned by this thread
+                if (!eox::ocv::JpegDecoder::local().decode(frame.data, frame.total(), out, decoding))
+                    out.release();
+                return;
+            }
+            if (decoding.gray && frame.channels() == 3) {
+                // cv::VideoCapture always decodes to BGR, so at least convert before handing out
+                cv::cvtColor(frame, out, cv::COLOR_BGR2GRAY);
+                return;
+            }
+            out = frame;
+        });
 
-        for (auto &future: results) {
-            auto frame = future.get();
+        for (auto &frame: retrieved) {
             if (frame.empty()) {
                 log->warn("empty frame");
                 return frames;
@@ -138,26 +285,274 @@ namespace eox::xocv {
             frames.push_back(std::move(frame));
         }
 
+        // as delivered, not as decoded (decoded frames may be scaled down and are several times bigger)
+        recordFrames(raw);
+        return frames;
+    }
+
+    void StereoCamera::recordFrames(const std::vector<eox::v4l2::V4L2_Frame> &frames) {
+        if (!recorder.isOpened())
+            return;
+
+        for (size_t i = 0; i < frames.size(); i++) {
+            recorder.record(frame_set, properties[i].id, frames[i]);
+        }
+        frame_set++;
+    }
+
+    void StereoCamera::recordFrames(const std::vector<cv::Mat> &raw) {
+        if (!recorder.isOpened())
+            return;
+
+        // cv::VideoCapture does not expose kernel timestamps, so use time of retrieval instead
+        const auto timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch());
+
+        std::vector<eox::v4l2::V4L2_Frame> descriptors;
+        descriptors.reserve(raw.size());
+        for (size_t i = 0; i < raw.size(); i++) {
+            const auto &mat = raw[i];
+            if (mat.rows != 1 || mat.type() != CV_8UC1) {
+                static std::once_flag warned;
+                std::call_once(warned, []() {
+                    log->warn("frames are decoded by OpenCV, nothing to record (use MJPG codec or mmap backend)");
+                });
+                return;
+            }
+
+            descriptors.push_back({
+                                          .index = 0,
+                                          .data = mat.data,
+                                          .bytes = mat.total(),
+                                          .stride = 0,
+                                          .sequence = (uint32_t) frame_set,
+                                          .timestamp = timestamp,
+                                          .width = (uint) properties[i].width,
+                                          .height = (uint) properties[i].height,
+                                          .fourcc = (uint32_t) V4L2_PIX_FMT_MJPEG
+                                  });
+        }
+
+        recordFrames(descriptors);
+    }
+
+    bool StereoCamera::readStreams(const std::vector<size_t> &indexes, std::vector<eox::v4l2::V4L2_Frame> &out) {
+        // not std::vector<bool>, elements are written concurrently
+        std::vector<uint8_t> ok(indexes.size(), 0);
+        out.resize(indexes.size());
+
+        // every device streams on its own, so dequeue them all in parallel
+        executor->parallel_for(0, indexes.size(), [this, &indexes, &out, &ok](size_t k) {
+            EOX_STAGE_LATENCY("capture_wait");
+            ok[k] = streams[indexes[k]]->read(out[k]);
+        });
+
+        if (std::find(ok.begin(), ok.end(), 0) == ok.end())
+            return true;
+
+        // give successfully dequeued buffers back, otherwise they would be lost
+        for (size_t k = 0; k < ok.size(); k++) {
+            if (ok[k])
+                streams[indexes[k]]->requeue(out[k]);
+        }
+        return false;
+    }
+
+    std::vector<cv::Mat> StereoCamera::captureStreams() {
+        std::vector<cv::Mat> frames;
+
+        if (streams.empty()) {
+            log->warn("StereoCamera is not initialized");
+            return frames;
+        }
+
+        for (size_t i = 0; i < streams.size(); i++) {
+            if (held[i].data) {
+                // frame handed out during previous capture is not in use anymore
+                streams[i]->requeue(held[i]);
+                held[i].data = nullptr;
+            }
+        }
+
+        std::vector<eox::v4l2::V4L2_Frame> tuple;
+        if (fast) {
+            // faster, just take next frame of every device, no synchronization guarantee
+            std::vector<size_t> all(streams.size());
+            std::iota(all.begin(), all.end(), 0);
+            if (!readStreams(all, tuple))
+                return {};
+        } else {
+            // pairing frames by kernel timestamps, stale frames are dropped instead of blocking
+            bool matched = false;
+            for (size_t attempt = 0; attempt < SYNC_ATTEMPTS_MAX; attempt++) {
+                matched = sync.match(tuple);
+                if (matched)
+                    break;
+
+                const auto missing = sync.missing();
+                std::vector<eox::v4l2::V4L2_Frame> read;
+                if (!readStreams(missing, read))
+                    return {};
+
+                for (size_t k = 0; k < missing.size(); k++) {
+                    sync.push(missing[k], read[k]);
+                }
+            }
+
+            if (!matched) {
+                log->warn("cannot match frames within tolerance: {}ns", sync.getTolerance().count());
+                return {};
+            }
+
+            log->debug("frames skew: {}ns, dropped total: {}", sync.getSkew().count(), sync.getDropped());
+        }
+
+        // record data exactly as delivered by devices (e.g. MJPEG), before decoding
+        recordFrames(tuple);
+
+        frames.resize(tuple.size());
+        executor->parallel_for(0, tuple.size(), [this, &tuple, &frames](size_t i) {
+            const auto &frame = tuple[i];
+
+            auto &mat = frames[i];
+            if (frame_to_mat(frame, mat, decoding)) {
+                if (async) {
+                    // capture thread re-queues buffers before consumer is done with them
+                    mat = mat.clone();
+                    streams[i]->requeue(frame);
+                    return;
+                }
+
+                // zero-copy, keep kernel buffer until next capture
+                held[i] = frame;
+                return;
+            }
+
+            streams[i]->requeue(frame);
+        });
+
+        bool empty = false;
+        for (const auto &frame: frames) {
+            empty |= frame.empty();
+        }
+
+        if (empty) {
+            log->warn("empty frame");
+            return {};
+        }
+
+        return frames;
+    }
+
+    std::vector<cv::Mat> StereoCamera::captureSession() {
+        if (!player.isOpened()) {
+            log->warn("StereoCamera is not initialized");
+            return {};
+        }
+
+        std::vector<uint> ids;
+        ids.reserve(properties.size());
+        for (const auto &prop: properties) {
+            ids.push_back(prop.id);
+        }
+
+        std::vector<eox::v4l2::V4L2_Frame> tuple;
+        if (!player.next(ids, tuple))
+            return {};
+
+        std::vector<cv::Mat> frames(tuple.size());
+        executor->parallel_for(0, tuple.size(), [this, &tuple, &frames](size_t i) {
+            cv::Mat mat;
+            const bool zero_copy = frame_to_mat(tuple[i], mat, decoding);
+            // recorded data is read only, consumers expect to own the frame (decoded ones are owned already)
+            frames[i] = zero_copy ? mat.clone() : std::move(mat);
+        });
+
+        bool empty = false;
+        for (const auto &frame: frames) {
+            empty |= frame.empty();
+        }
+
+        if (empty) {
+            log->warn("empty frame");
+            return {};
+        }
+
         return frames;
     }
 
     void StereoCamera::open(bool normalize) {
-        for (const auto &property: properties) {
+        if (backend == eox::data::Backend::MMAP && api != cv::CAP_V4L2) {
+            log->warn("mmap backend requires V4L2 api, fallback to OCV");
+            backend = eox::data::Backend::OCV;
+        }
+
+        if (backend == eox::data::Backend::PLAYBACK) {
+            const auto &first = properties[0];
+
+            log->debug("open session [{}]", first.session);
+
+            player.setRealtime(first.realtime);
+            player.setLoop(first.loop);
+            player.open(first.session);
+
+            const auto recorded = player.getDevices();
+            for (const auto &property: properties) {
+                if (std::find(recorded.begin(), recorded.end(), property.id) == recorded.end())
+                    throw std::runtime_error("Device is not recorded in session: " + std::to_string(property.id));
+            }
+        } else if (backend == eox::data::Backend::MMAP) {
+            for (const auto &property: properties) {
+
+                log->debug("open stream [{}]", property.index);
 
-            log->debug("open [{}]", property.index);
+                auto stream = std::make_unique<eox::v4l2::LinuxStream>();
 
-            auto capture = std::make_unique<cv::VideoCapture>();
+                // extra buffers: one held by consumer (zero-copy) and one waiting in sync queue
+                stream->open(property.index,
+                             property.width,
+                             property.height,
+                             property.fps,
+                             v4l2_fourcc(property.codec[0], property.codec[1], property.codec[2], property.codec[3]),
+                             std::max(2, property.buffer) + 2);
 
-            init_from_params(*capture, property, api);
+                if (!stream->isOpened())
+                    throw std::runtime_error("Failed to open camera: " + std::to_string(property.index));
+                streams.push_back(std::move(stream));
+                held.push_back({});
+            }
+
+            const auto &first = properties[0];
+            const auto tolerance = first.tolerance > 0
+                                   ? std::chrono::nanoseconds((long long) (first.tolerance * 1000000.f))
+                                   : std::chrono::nanoseconds(1000000000LL / std::max(1, first.fps) / 2);
+
+            // frames are dropped only by the pairing engine, return buffers to the driver
+            sync.reset(streams.size());
+            sync.setTolerance(tolerance);
+            sync.onDrop([this](size_t i, const eox::v4l2::V4L2_Frame &frame) {
+                streams[i]->requeue(frame);
+            });
+
+            log->debug("frame sync tolerance: {}ns", tolerance.count());
+        } else {
+            for (const auto &property: properties) {
 
-            if (!capture->isOpened())
-                throw std::runtime_error("Failed to open camera: " + std::to_string(property.index));
-            captures.push_back(std::move(capture));
+                log->debug("open [{}]", property.index);
+
+                auto capture = std::make_unique<cv::VideoCapture>();
+
+                init_from_params(*capture, property, api);
+
+                if (!capture->isOpened())
+                    throw std::runtime_error("Failed to open camera: " + std::to_string(property.index));
+                captures.push_back(std::move(capture));
+            }
         }
 
         if (normalize) {
             // ONLY FOR V4L2
-            if (api == cv::CAP_V4L2) {
+            if (isControllable()) {
 
                 // get first device
                 const auto &first = properties[0];
@@ -183,13 +578,27 @@ namespace eox::xocv {
             }
         }
 
+        if (backend != eox::data::Backend::PLAYBACK && !properties[0].record.empty()) {
+            const auto &first = properties[0];
+            frame_set = 0;
+            recorder.open(first.record,
+                          (size_t) std::max(1, first.segment_size) * 1024 * 1024,
+                          (size_t) std::max(1, first.ring_size) * 1024 * 1024);
+        }
+
         if (!executor) {
             // there is no assigned executors
             executor = std::make_shared<eox::util::ThreadPool>();
             executor->start(properties.size());
         }
 
-        log->debug("opened devices total: {}", captures.size());
+        if (async) {
+            log->debug("start capture thread");
+            alive = true;
+            worker = std::make_unique<std::thread>(&StereoCamera::captureWorker, this);
+        }
+
+        log->debug("opened devices total: {}", captures.size() + streams.size() + (player.isOpened() ? properties.size() : 0));
     }
 
     void StereoCamera::open() {
@@ -209,6 +618,18 @@ namespace eox::xocv {
     void StereoCamera::release() {
         log->debug("release");
 
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            alive = false;
+            flag.notify_all();
+        }
+
+        if (worker && worker->joinable()) {
+            log->debug("wait capture thread");
+            worker->join();
+        }
+        worker.reset();
+
         int i = 0;
         for (auto &capture: captures) {
             log->debug("release camera [{}]", i);
@@ -218,11 +639,29 @@ namespace eox::xocv {
             log->debug("camera released [{}]", i++);
         }
         captures.clear();
+
+        for (auto &stream: streams) {
+            stream->release();
+        }
+        streams.clear();
+        held.clear();
+        sync.reset(0);
+
+        if (isControllable()) {
+            // control handles are cached, close them together with devices
+            for (const auto &prop: properties) {
+                eox::v4l2::release_device(prop.index);
+            }
+        }
+
+        player.release();
+        recorder.release();
+
         log->debug("released");
     }
 
     void StereoCamera::restore(std::istream &input_stream) {
-        if (input_stream.peek() == EOF)
+        if (input_stream.peek() == EOF || !isControllable())
             return;
 
         int32_t backend_header[1];
@@ -269,7 +708,7 @@ namespace eox::xocv {
     }
 
     void StereoCamera::save(std::ostream &output_stream, const std::vector<uint> &devices) {
-        if (api == cv::CAP_V4L2) {
+        if (isControllable()) {
 
             // iterative over devices
             // map <device_id, controls>
@@ -335,10 +774,38 @@ namespace eox::xocv {
         this->homogeneous = _homogeneous;
     }
 
+    void StereoCamera::setAsync(bool _async) {
+        this->async = _async;
+    }
+
+    void StereoCamera::setGray(bool _gray) {
+        this->decoding.gray = _gray;
+    }
+
+    void StereoCamera::setDecodeSize(cv::Size size) {
+        this->decoding.size = size;
+    }
+
+    void StereoCamera::setDecodeRegion(cv::Rect roi) {
+        this->decoding.roi = roi;
+    }
+
     void StereoCamera::setApi(int _api) {
         this->api = _api;
     }
 
+    void StereoCamera::setBackend(eox::data::Backend _backend) {
+        this->backend = _backend;
+    }
+
+    bool StereoCamera::isControllable() const {
+        return api == cv::CAP_V4L2 && backend != eox::data::Backend::PLAYBACK;
+    }
+
+    std::chrono::nanoseconds StereoCamera::getSkew() const {
+        return sync.getSkew();
+    }
+
     void StereoCamera::setProperties(std::vector<eox::data::camera_properties> props) {
         this->properties = std::move(props);
 
@@ -353,7 +820,7 @@ namespace eox::xocv {
     }
 
     void StereoCamera::setPropValue(uint device_id, uint prop_id, int value) {
-        if (api == cv::CAP_V4L2) {
+        if (isControllable()) {
             eox::v4l2::set_camera_prop(properties_map.at(device_id).index, prop_id, value);
         } else {
             // TODO WINDOWS?
@@ -361,7 +828,7 @@ namespace eox::xocv {
     }
 
     void StereoCamera::resetDefaults(uint device_id) {
-        if (api == cv::CAP_V4L2) {
+        if (isControllable()) {
             eox::v4l2::reset_defaults(properties_map.at(device_id).index);
         }
     }
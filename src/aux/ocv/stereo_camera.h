@@ -7,7 +7,13 @@
 #include <opencv2/videoio.hpp>
 #include <opencv2/core/mat.hpp>
 #include "../utils/tp/thread_pool.h"
+#include "../utils/mailbox/triple_buffer.h"
+#include "../v4l2/linux_stream.h"
+#include "../v4l2/frame_sync.h"
+#include "../rec/session_player.h"
+#include "../rec/session_recorder.h"
 #include "../commons.h"
+#include "jpeg_decoder.h"
 
 namespace eox::xocv {
 
@@ -35,10 +41,29 @@ namespace eox::xocv {
     class StereoCamera final {
 
     private:
+        static inline const size_t SYNC_ATTEMPTS_MAX = 16;
+        static inline const auto MAILBOX_TIMEOUT = std::chrono::milliseconds(100);
+
+        // capture thread backs off (doubling, up to maximum) while devices give nothing
+        static inline const auto FAILURE_BACKOFF_MIN = std::chrono::milliseconds(1);
+        static inline const auto FAILURE_BACKOFF_MAX = std::chrono::milliseconds(100);
+
         static inline const auto log =
                 spdlog::stdout_color_mt("stereo_camera");
 
         std::vector<std::unique_ptr<cv::VideoCapture>> captures;
+        std::vector<std::unique_ptr<eox::v4l2::LinuxStream>> streams;
+        std::vector<eox::v4l2::V4L2_Frame> held;
+        eox::v4l2::FrameSync sync;
+        eox::rec::SessionPlayer player;
+        eox::rec::SessionRecorder recorder;
+        uint64_t frame_set = 0;
+
+        eox::util::TripleBuffer<std::vector<cv::Mat>> mailbox;
+        std::unique_ptr<std::thread> worker;
+        std::atomic<bool> alive = false;
+        std::condition_variable flag;
+        std::mutex mutex;
         std::map<uint, eox::data::camera_properties> properties_map;
         std::vector<eox::data::camera_properties> properties;
         std::shared_ptr<eox::util::ThreadPool> executor;
@@ -46,6 +71,57 @@ namespace eox::xocv {
         bool homogeneous = true;
         bool fast = false;
         int api = cv::CAP_V4L2;
+        eox::data::Backend backend = eox::data::Backend::OCV;
+        bool async = false;
+        eox::ocv::JpegOptions decoding{};
+
+    protected:
+
+        /**
+         * Captures frames from devices directly (blocking), used by capture() or by capture thread
+         */
+        std::vector<cv::Mat> captureDevices();
+
+        /**
+         * Capture thread loop, publishes every captured frame set into the mailbox.
+         * Backs off while capture fails, stops once recorded session is over.
+         */
+        void captureWorker();
+
+        /**
+         * Takes the newest frame set from the mailbox,
+         * waits (bounded) only if nothing new was captured since the last call
+         */
+        std::vector<cv::Mat> captureLatest();
+
+        /**
+         * Captures frames using native V4L2 mmap streams (MMAP backend).
+         * Uncompressed frames (GREY, BGR3) are returned as matrices wrapping kernel buffers.
+         * Unless fast mode is enabled, frames are paired by kernel capture timestamps.
+         */
+        std::vector<cv::Mat> captureStreams();
+
+        /**
+         * Reads next frame set of recorded session (PLAYBACK backend)
+         */
+        std::vector<cv::Mat> captureSession();
+
+        /**
+         * Dequeues one frame from each of given streams (in parallel)
+         */
+        bool readStreams(const std::vector<size_t> &indexes, std::vector<eox::v4l2::V4L2_Frame> &out);
+
+        /**
+         * Passes captured frame set to the session recorder (if recording is enabled), never blocks
+         */
+        void recordFrames(const std::vector<eox::v4l2::V4L2_Frame> &frames);
+
+        /**
+         * Same as recordFrames() for frames as retrieved from cv::VideoCapture (OCV backend), before decoding.
+         * Only raw MJPEG frames can be recorded that way (compressed, as delivered by device),
+         * frames decoded by OpenCV itself are not recorded (see mmap backend)
+         */
+        void recordFrames(const std::vector<cv::Mat> &raw);
 
     public:
 
@@ -70,7 +146,9 @@ namespace eox::xocv {
          *
          * @return A vector of cv::Mat objects representing the frames (usually left and right).
          *
-         * @note This is blocking operation
+         * @note This is blocking operation, unless async mode is enabled
+         * @note With MMAP backend returned frames might wrap kernel buffers directly (zero-copy),
+         *       such frames stay valid only until the next call of capture().
          */
 
         std::vector<cv::Mat> capture();
@@ -135,8 +213,67 @@ namespace eox::xocv {
 
         void setHomogeneous(bool homogeneous);
 
+        /**
+         * @brief Set the async mode for the StereoCamera.
+         *
+         * When async mode is enabled, devices are captured on a dedicated thread which publishes
+         * frame sets into lock-free mailbox, capture() then just takes the newest complete set.
+         * This way capturing overlaps with processing of the previous frames.
+         *
+         * @note Async mode is disabled by default, must be set before open()
+         */
+        void setAsync(bool async);
+
+        /**
+         * @brief Set the grayscale mode for the StereoCamera.
+         *
+         * When grayscale mode is enabled, capture() returns single channel (luma) frames,
+         * YUYV frames are reduced to the Y plane and JPEG frames are decoded to luma only,
+         * so no color conversion is ever done during capture.
+         *
+         * @note Grayscale mode is disabled by default
+         */
+        void setGray(bool gray);
+
+        /**
+         * @brief Set the minimal size of captured frames.
+         *
+         * MJPEG frames are decoded at the largest DCT downscale (1/2, 1/4, 1/8) which still covers given size,
+         * instead of decoding full resolution frame just to downscale it afterwards.
+         * It's only a hint, other formats (and MJPEG if size is not at least twice smaller) keep capture size.
+         *
+         * @param size minimal size of frames (empty - capture size)
+         */
+        void setDecodeSize(cv::Size size);
+
+        /**
+         * @brief Set the region of interest, only this part of frames is decoded and returned.
+         *
+         * @param roi region in capture resolution coordinates (empty - whole frame)
+         */
+        void setDecodeRegion(cv::Rect roi);
+
         void setApi(int api);
 
+        /**
+         * @brief Set the capturing backend.
+         *
+         * @param backend OCV (cv::VideoCapture), MMAP (native V4L2 zero-copy streaming, requires V4L2 api)
+         *                or PLAYBACK (recorded session, see eox::rec::SessionPlayer)
+         */
+        void setBackend(eox::data::Backend backend);
+
+        /**
+         * @return true if devices expose V4L2 controls (live V4L2 devices only)
+         */
+        [[nodiscard]] bool isControllable() const;
+
+        /**
+         * @return timestamp difference between the oldest and the newest frame of the last
+         *         synchronized capture (MMAP backend only)
+         */
+        [[nodiscard]] std::chrono::nanoseconds getSkew() const;
+
         /**
          * Restore camera settings from data from input stream
          * @param input_stream data stream with camera configuration
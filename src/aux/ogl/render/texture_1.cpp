@@ -3,6 +3,8 @@
 //
 
 #include "texture_1.h"
+#include "../../utils/trace/trace.h"
+#include "../../utils/metrics/metrics.h"
 
 namespace xogl {
 
@@ -126,6 +128,9 @@ namespace xogl {
             return;
         }
 
+        EOX_TRACE_SPAN("gl::texture_upload");
+        EOX_STAGE_LATENCY("texture_upload");
+
         glBindTexture(GL_TEXTURE_2D, texture);
         glTexImage2D(GL_TEXTURE_2D,
                      0,
@@ -4,6 +4,8 @@
 
 #include <GL/gl.h>
 #include "voxels.h"
+#include "../../utils/trace/trace.h"
+#include "../../utils/metrics/metrics.h"
 
 namespace eox::ogl {
 #define cc clear_color
@@ -130,6 +132,8 @@ void main() {
     }
 
     Voxels &Voxels::setPoints(const void *pos, const void *color) {
+        EOX_TRACE_SPAN("gl::points_upload");
+        EOX_STAGE_LATENCY("points_upload");
 
         glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
         glBufferSubData(GL_ARRAY_BUFFER, 0, (long) (total * 3 * sizeof(float)), pos);
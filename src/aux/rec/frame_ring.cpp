@@ -0,0 +1,84 @@
+//
+// Created by henryco on 2/12/24.
+//
+
+#include "frame_ring.h"
+
+#include <cstring>
+
+namespace eox::rec {
+
+    size_t align(size_t bytes, size_t alignment) {
+        return (bytes + alignment - 1) & ~(alignment - 1);
+    }
+
+    FrameRing::FrameRing(size_t _capacity)
+            : memory(align(_capacity, ALIGNMENT)),
+              capacity(align(_capacity, ALIGNMENT)) {
+    }
+
+    bool FrameRing::push(const SessionRecord &record, const void *data, size_t bytes) {
+        const size_t need = align(sizeof(entry_header) + bytes, ALIGNMENT);
+        if (need > capacity)
+            return false;
+
+        uint64_t h = head.load(std::memory_order_relaxed);
+        const uint64_t t = tail.load(std::memory_order_acquire);
+
+        size_t position = h % capacity;
+        const size_t padding = position + need > capacity ? capacity - position : 0;
+
+        if (h + padding + need - t > capacity)
+            // consumer is too slow, no space left
+            return false;
+
+        if (padding > 0) {
+            // entry does not fit at the end, mark the rest as padding and start over
+            const uint64_t marker = PADDING;
+            std::memcpy(memory.data() + position, &marker, sizeof(marker));
+            h += padding;
+            position = 0;
+        }
+
+        const entry_header header = {.bytes = bytes, .record = record};
+        std::memcpy(memory.data() + position, &header, sizeof(header));
+        std::memcpy(memory.data() + position + sizeof(header), data, bytes);
+
+        head.store(h + need, std::memory_order_release);
+        return true;
+    }
+
+    size_t FrameRing::drain(const std::function<void(const SessionRecord &, const uint8_t *)> &consumer) {
+        const uint64_t h = head.load(std::memory_order_acquire);
+        uint64_t t = tail.load(std::memory_order_relaxed);
+
+        size_t total = 0;
+        while (t < h) {
+            const size_t position = t % capacity;
+
+            uint64_t bytes;
+            std::memcpy(&bytes, memory.data() + position, sizeof(bytes));
+            if (bytes == PADDING) {
+                t += capacity - position;
+                continue;
+            }
+
+            entry_header header{};
+            std::memcpy(&header, memory.data() + position, sizeof(header));
+            consumer(header.record, memory.data() + position + sizeof(header));
+
+            t += align(sizeof(entry_header) + header.bytes, ALIGNMENT);
+            total++;
+
+            // free space as soon as possible, so producer does not drop frames
+            tail.store(t, std::memory_order_release);
+        }
+
+        return total;
+    }
+
+    bool FrameRing::empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+} // eox
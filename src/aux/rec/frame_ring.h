@@ -0,0 +1,70 @@
+//
+// Created by henryco on 2/12/24.
+//
+
+#ifndef STEREOX_FRAME_RING_H
+#define STEREOX_FRAME_RING_H
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+#include "session.h"
+
+namespace eox::rec {
+
+    /**
+     * @class FrameRing
+     * @brief Lock-free single producer / single consumer ring of variable sized frames.
+     *
+     * Every entry is a session record followed by frame payload, entries are stored contiguously
+     * (never split at the end of the ring, padding is used instead).
+     * Producer never waits: if there is not enough free space push() just fails.
+     */
+    class FrameRing {
+    private:
+        static inline const uint64_t PADDING = UINT64_MAX;
+        static inline const size_t ALIGNMENT = 8;
+
+        using entry_header = struct {
+            uint64_t bytes;
+            SessionRecord record;
+        };
+
+        std::vector<uint8_t> memory;
+        size_t capacity;
+
+        // total bytes ever written (owned by producer)
+        alignas(64) std::atomic<uint64_t> head = 0;
+
+        // total bytes ever consumed (owned by consumer)
+        alignas(64) std::atomic<uint64_t> tail = 0;
+
+    public:
+
+        /**
+         * @param capacity ring size in bytes (allocated up front)
+         */
+        explicit FrameRing(size_t capacity);
+
+        /**
+         * @brief Copies frame into the ring.
+         *
+         * @return false if there is not enough free space (frame is not stored)
+         */
+        bool push(const SessionRecord &record, const void *data, size_t bytes);
+
+        /**
+         * @brief Passes every available frame to the consumer function, then frees its space.
+         *
+         * @return number of consumed frames
+         */
+        size_t drain(const std::function<void(const SessionRecord &, const uint8_t *)> &consumer);
+
+        [[nodiscard]] bool empty() const;
+    };
+
+} // eox
+
+#endif //STEREOX_FRAME_RING_H
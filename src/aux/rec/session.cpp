@@ -0,0 +1,21 @@
+//
+// Created by henryco on 2/9/24.
+//
+
+#include "session.h"
+
+#include <cstdio>
+
+namespace eox::rec {
+
+    std::filesystem::path index_path(const std::filesystem::path &session) {
+        return session / "session.xidx";
+    }
+
+    std::filesystem::path segment_path(const std::filesystem::path &session, uint32_t segment) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "segment_%04u.xseg", segment);
+        return session / name;
+    }
+
+} // eox
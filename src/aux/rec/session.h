@@ -0,0 +1,80 @@
+//
+// Created by henryco on 2/9/24.
+//
+
+#ifndef STEREOX_SESSION_H
+#define STEREOX_SESSION_H
+
+#include <filesystem>
+#include <cstdint>
+
+namespace eox::rec {
+
+    /**
+     * "XREC" in little endian
+     */
+    static inline const uint32_t SESSION_MAGIC = 0x43455258;
+    static inline const uint32_t SESSION_VERSION = 1;
+
+    /**
+     * Header of session index file, followed by the sequence of session_record
+     */
+    typedef struct {
+        uint32_t magic;
+        uint32_t version;
+
+        /**
+         * size of every segment file in bytes
+         */
+        uint64_t segment_size;
+    } session_header;
+
+    /**
+     * Index entry of single recorded frame, frame payload itself is stored in segment file
+     */
+    typedef struct {
+        /**
+         * number of frame set (one call of capture), frames of the same set were captured together
+         */
+        uint64_t set;
+
+        /**
+         * offset of payload within segment file
+         */
+        uint64_t offset;
+
+        /**
+         * capture timestamp in nanoseconds
+         */
+        int64_t timestamp;
+
+        uint32_t device_id;
+        uint32_t sequence;
+        uint32_t segment;
+        uint32_t bytes;
+
+        /**
+         * V4L2 pixel format of payload (see V4L2_PIX_FMT_*)
+         */
+        uint32_t fourcc;
+        uint32_t width;
+        uint32_t height;
+        uint32_t stride;
+    } session_record;
+
+    using SessionHeader = session_header;
+    using SessionRecord = session_record;
+
+    /**
+     * @return path of the index file within session directory
+     */
+    std::filesystem::path index_path(const std::filesystem::path &session);
+
+    /**
+     * @return path of the segment file within session directory
+     */
+    std::filesystem::path segment_path(const std::filesystem::path &session, uint32_t segment);
+
+} // eox
+
+#endif //STEREOX_SESSION_H
@@ -0,0 +1,191 @@
+//
+// Created by henryco on 2/9/24.
+//
+
+#include "session_player.h"
+
+#include <thread>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+namespace eox::rec {
+
+    SessionPlayer::~SessionPlayer() {
+        release();
+    }
+
+    void SessionPlayer::open(const std::string &path) {
+        release();
+
+        session = std::filesystem::path(path);
+        if (std::filesystem::is_regular_file(session))
+            session = session.parent_path();
+
+        const auto index = index_path(session);
+        log->debug("open session: {}", index.string());
+
+        std::ifstream stream(index, std::ios::in | std::ios::binary);
+        if (!stream) {
+            log->error("Cannot open session index: {}", index.string());
+            throw std::runtime_error("Cannot open session index: " + index.string());
+        }
+
+        SessionHeader header{};
+        stream.read(reinterpret_cast<char *>(&header), sizeof(header));
+        if (!stream || header.magic != SESSION_MAGIC || header.version != SESSION_VERSION) {
+            log->error("Invalid session index: {}", index.string());
+            throw std::runtime_error("Invalid session index: " + index.string());
+        }
+
+        uint32_t segments_total = 0;
+        std::map<uint64_t, std::map<uint32_t, SessionRecord>> ordered;
+
+        SessionRecord record{};
+        while (stream.read(reinterpret_cast<char *>(&record), sizeof(record))) {
+            ordered[record.set][record.device_id] = record;
+            segments_total = std::max(segments_total, record.segment + 1);
+        }
+
+        sets.reserve(ordered.size());
+        for (auto &[_, set]: ordered) {
+            sets.push_back(std::move(set));
+        }
+
+        segments.reserve(segments_total);
+        for (uint32_t i = 0; i < segments_total; i++) {
+            const auto file = segment_path(session, i);
+
+            const int fd = ::open(file.c_str(), O_RDONLY);
+            if (fd == -1) {
+                release();
+                log->error("Cannot open session segment: {}", file.string());
+                throw std::runtime_error("Cannot open session segment: " + file.string());
+            }
+
+            const auto length = (size_t) std::filesystem::file_size(file);
+
+            void *start = length > 0
+                          ? mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0)
+                          : nullptr;
+            ::close(fd);
+
+            if (start == MAP_FAILED) {
+                release();
+                log->error("Cannot map session segment: {}", file.string());
+                throw std::runtime_error("Cannot map session segment: " + file.string());
+            }
+
+            segments.push_back({.start = start, .length = length});
+        }
+
+        rewind();
+        log->debug("session opened, frame sets: {}, segments: {}", sets.size(), segments.size());
+    }
+
+    const void *SessionPlayer::segment(uint32_t index) {
+        if (index >= segments.size())
+            return nullptr;
+        return segments[index].start;
+    }
+
+    bool SessionPlayer::next(const std::vector<uint> &device_ids, std::vector<eox::v4l2::V4L2_Frame> &frames) {
+        if (sets.empty())
+            return false;
+
+        if (position >= sets.size()) {
+            if (!loop)
+                return false;
+            rewind();
+        }
+
+        const auto &set = sets[position++];
+
+        frames.clear();
+        frames.reserve(device_ids.size());
+        for (const auto &id: device_ids) {
+            const auto it = set.find(id);
+            if (it == set.end()) {
+                log->warn("frame set has no frame for device: {}", id);
+                return false;
+            }
+
+            const auto &r = it->second;
+            const auto base = static_cast<const uint8_t *>(segment(r.segment));
+            if (!base || r.offset + r.bytes > segments[r.segment].length) {
+                log->warn("frame is out of segment bounds: {}", r.segment);
+                return false;
+            }
+
+            frames.push_back({
+                                     .index = (uint) r.set,
+                                     .data = (void *) (base + r.offset),
+                                     .bytes = r.bytes,
+                                     .stride = r.stride,
+                                     .sequence = r.sequence,
+                                     .timestamp = std::chrono::nanoseconds(r.timestamp),
+                                     .width = r.width,
+                                     .height = r.height,
+                                     .fourcc = r.fourcc
+                             });
+        }
+
+        if (realtime) {
+            // original timing, relative to the first frame set
+            const auto timestamp = frames[0].timestamp;
+            if (position == 1) {
+                start_time = std::chrono::steady_clock::now();
+                start_timestamp = timestamp;
+            }
+            std::this_thread::sleep_until(start_time + (timestamp - start_timestamp));
+        }
+
+        return true;
+    }
+
+    void SessionPlayer::rewind() {
+        position = 0;
+    }
+
+    void SessionPlayer::release() {
+        for (const auto &s: segments) {
+            if (s.start)
+                munmap(s.start, s.length);
+        }
+        segments.clear();
+        sets.clear();
+        position = 0;
+    }
+
+    bool SessionPlayer::isOpened() const {
+        return !sets.empty();
+    }
+
+    bool SessionPlayer::isOver() const {
+        return !loop && position >= sets.size();
+    }
+
+    std::vector<uint> SessionPlayer::getDevices() const {
+        std::vector<uint> ids;
+        if (sets.empty())
+            return ids;
+        for (const auto &[id, _]: sets[0]) {
+            ids.push_back(id);
+        }
+        return ids;
+    }
+
+    size_t SessionPlayer::getSize() const {
+        return sets.size();
+    }
+
+    void SessionPlayer::setRealtime(bool _realtime) {
+        realtime = _realtime;
+    }
+
+    void SessionPlayer::setLoop(bool _loop) {
+        loop = _loop;
+    }
+
+} // eox
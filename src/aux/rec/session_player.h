@@ -0,0 +1,113 @@
+//
+// Created by henryco on 2/9/24.
+//
+
+#ifndef STEREOX_SESSION_PLAYER_H
+#define STEREOX_SESSION_PLAYER_H
+
+#include <map>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <spdlog/logger.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include "session.h"
+#include "../v4l2/linux_stream.h"
+
+namespace eox::rec {
+
+    /**
+     * @class SessionPlayer
+     * @brief Plays recorded multi-camera session from disk.
+     *
+     * Segment files are memory mapped (read only), so frames are handed out as descriptors
+     * pointing directly into mapped memory, same as frames of eox::v4l2::LinuxStream.
+     * Frame descriptors stay valid until release(), frame data must not be modified.
+     */
+    class SessionPlayer {
+        static inline const auto log =
+                spdlog::stdout_color_mt("session_player");
+
+    private:
+        using mapped_segment = struct {
+            void *start;
+            size_t length;
+        };
+
+        // frame sets, each maps device_id -> record
+        std::vector<std::map<uint32_t, SessionRecord>> sets;
+        std::vector<mapped_segment> segments;
+        std::filesystem::path session;
+
+        std::chrono::steady_clock::time_point start_time;
+        std::chrono::nanoseconds start_timestamp{0};
+        size_t position = 0;
+
+        bool realtime = true;
+        bool loop = false;
+
+        const void *segment(uint32_t index);
+
+    public:
+        SessionPlayer() = default;
+
+        SessionPlayer(const SessionPlayer &other) = delete;
+
+        SessionPlayer &operator=(const SessionPlayer &other) = delete;
+
+        ~SessionPlayer();
+
+        /**
+         * @param path session directory (or path to its index file)
+         * @throws std::runtime_error if session cannot be read
+         */
+        void open(const std::string &path);
+
+        /**
+         * @brief Returns frames of the next recorded frame set.
+         *
+         * In realtime mode waits until the frame set is due according to original timing,
+         * otherwise returns immediately (as fast as possible).
+         *
+         * @param device_ids devices (in order) to read frames for
+         * @param frames output frame descriptors, one per device
+         * @return false if session is over (and loop is disabled) or set lacks some of devices
+         */
+        bool next(const std::vector<uint> &device_ids, std::vector<eox::v4l2::V4L2_Frame> &frames);
+
+        /**
+         * Restarts playback from the first frame set
+         */
+        void rewind();
+
+        void release();
+
+        [[nodiscard]] bool isOpened() const;
+
+        /**
+         * @return true if every frame set was played and loop is disabled (next() fails from now on)
+         */
+        [[nodiscard]] bool isOver() const;
+
+        /**
+         * @return ids of all the devices recorded in session
+         */
+        [[nodiscard]] std::vector<uint> getDevices() const;
+
+        [[nodiscard]] size_t getSize() const;
+
+        /**
+         * @param realtime true - original timing, false - as fast as possible
+         */
+        void setRealtime(bool realtime);
+
+        /**
+         * @param loop restart session from the beginning once it's over
+         */
+        void setLoop(bool loop);
+    };
+
+} // eox
+
+#endif //STEREOX_SESSION_PLAYER_H
@@ -0,0 +1,213 @@
+//
+// Created by henryco on 2/12/24.
+//
+
+#include "session_recorder.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+namespace eox::rec {
+
+    SessionRecorder::~SessionRecorder() {
+        release();
+    }
+
+    void SessionRecorder::open(const std::string &path, size_t _segment_size, size_t ring_size) {
+        release();
+
+        session = std::filesystem::path(path);
+        std::filesystem::create_directories(session);
+
+        const auto index_file = index_path(session);
+        log->debug("open session: {}", index_file.string());
+
+        index.open(index_file, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!index) {
+            log->error("Cannot create session index: {}", index_file.string());
+            throw std::runtime_error("Cannot create session index: " + index_file.string());
+        }
+
+        const SessionHeader header = {
+                .magic = SESSION_MAGIC,
+                .version = SESSION_VERSION,
+                .segment_size = _segment_size
+        };
+        index.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+        segment_size = _segment_size;
+        ring = std::make_unique<FrameRing>(ring_size);
+        dropped = 0;
+        written = 0;
+
+        openSegment(0);
+
+        alive = true;
+        writer = std::make_unique<std::thread>(&SessionRecorder::worker, this);
+
+        log->info("recording session: {}", session.string());
+    }
+
+    bool SessionRecorder::record(uint64_t set, uint device_id, const eox::v4l2::V4L2_Frame &frame) {
+        if (!alive)
+            return false;
+
+        const SessionRecord record = {
+                .set = set,
+                .offset = 0,
+                .timestamp = frame.timestamp.count(),
+                .device_id = device_id,
+                .sequence = frame.sequence,
+                .segment = 0,
+                .bytes = (uint32_t) frame.bytes,
+                .fourcc = frame.fourcc,
+                .width = frame.width,
+                .height = frame.height,
+                .stride = frame.stride
+        };
+
+        if (!ring->push(record, frame.data, frame.bytes)) {
+            // disk is too slow, drop frame instead of stalling capture
+            dropped++;
+            log->debug("frame dropped [{}], dropped total: {}", device_id, dropped.load());
+            return false;
+        }
+
+        signal.fetch_add(1, std::memory_order_release);
+        signal.notify_one();
+        return true;
+    }
+
+    void SessionRecorder::worker() {
+        const auto consumer = [this](const SessionRecord &record, const uint8_t *data) {
+            write(record, data);
+        };
+
+        while (true) {
+            const auto s = signal.load(std::memory_order_acquire);
+
+            ring->drain(consumer);
+
+            if (!alive) {
+                // flush the leftovers
+                ring->drain(consumer);
+                return;
+            }
+
+            if (ring->empty())
+                signal.wait(s, std::memory_order_acquire);
+        }
+    }
+
+    void SessionRecorder::write(const SessionRecord &record, const uint8_t *data) {
+        if (record.bytes > segment_size) {
+            log->warn("frame does not fit into segment: {} > {}", record.bytes, segment_size);
+            dropped++;
+            return;
+        }
+
+        if (segment_used + record.bytes > segment_size) {
+            closeSegment();
+            openSegment(segment_id + 1);
+        }
+
+        std::memcpy(segment + segment_used, data, record.bytes);
+
+        SessionRecord entry = record;
+        entry.segment = segment_id;
+        entry.offset = segment_used;
+        index.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+
+        segment_used += record.bytes;
+        written++;
+    }
+
+    void SessionRecorder::openSegment(uint32_t id) {
+        const auto file = segment_path(session, id);
+
+        segment_fd = ::open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (segment_fd == -1) {
+            log->error("Cannot create session segment: {}", file.string());
+            throw std::runtime_error("Cannot create session segment: " + file.string());
+        }
+
+        // preallocate whole segment up front, so writing never waits for block allocation
+        if (posix_fallocate(segment_fd, 0, (off_t) segment_size) != 0
+            && ftruncate(segment_fd, (off_t) segment_size) != 0) {
+            ::close(segment_fd);
+            segment_fd = -1;
+            log->error("Cannot allocate session segment: {}", file.string());
+            throw std::runtime_error("Cannot allocate session segment: " + file.string());
+        }
+
+        void *start = mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, segment_fd, 0);
+        if (start == MAP_FAILED) {
+            ::close(segment_fd);
+            segment_fd = -1;
+            log->error("Cannot map session segment: {}", file.string());
+            throw std::runtime_error("Cannot map session segment: " + file.string());
+        }
+
+        madvise(start, segment_size, MADV_SEQUENTIAL);
+
+        segment = static_cast<uint8_t *>(start);
+        segment_used = 0;
+        segment_id = id;
+
+        log->debug("segment opened: {}", file.string());
+    }
+
+    void SessionRecorder::closeSegment() {
+        if (segment_fd == -1)
+            return;
+
+        msync(segment, segment_size, MS_ASYNC);
+        munmap(segment, segment_size);
+
+        // cut off unused preallocated space
+        if (ftruncate(segment_fd, (off_t) segment_used) != 0)
+            log->warn("Cannot truncate segment: {}", segment_id);
+
+        ::close(segment_fd);
+        segment_fd = -1;
+        segment = nullptr;
+        index.flush();
+    }
+
+    void SessionRecorder::release() {
+        if (!writer)
+            return;
+
+        log->debug("release");
+
+        alive = false;
+        signal.fetch_add(1, std::memory_order_release);
+        signal.notify_one();
+
+        if (writer->joinable())
+            writer->join();
+        writer.reset();
+
+        closeSegment();
+        index.close();
+        ring.reset();
+
+        log->info("session recorded: {}, frames written: {}, dropped: {}",
+                  session.string(), written.load(), dropped.load());
+    }
+
+    bool SessionRecorder::isOpened() const {
+        return alive;
+    }
+
+    size_t SessionRecorder::getDropped() const {
+        return dropped;
+    }
+
+    size_t SessionRecorder::getWritten() const {
+        return written;
+    }
+
+} // eox
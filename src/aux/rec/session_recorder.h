@@ -0,0 +1,107 @@
+//
+// Created by henryco on 2/12/24.
+//
+
+#ifndef STEREOX_SESSION_RECORDER_H
+#define STEREOX_SESSION_RECORDER_H
+
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <fstream>
+#include <spdlog/logger.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include "session.h"
+#include "frame_ring.h"
+#include "../v4l2/linux_stream.h"
+
+namespace eox::rec {
+
+    /**
+     * @class SessionRecorder
+     * @brief Records raw (or MJPEG) frames of multiple devices into preallocated memory mapped segment files.
+     *
+     * Capture side only copies frame into in-memory lock-free ring and never waits for the disk,
+     * if the ring is full (disk is too slow) frame is dropped and counted.
+     * Dedicated writer thread moves frames from the ring into memory mapped segment file
+     * and appends index records (see eox::rec::SessionRecord), recorded session can be played
+     * with eox::rec::SessionPlayer.
+     */
+    class SessionRecorder {
+        static inline const auto log =
+                spdlog::stdout_color_mt("session_recorder");
+
+    private:
+        std::unique_ptr<FrameRing> ring;
+        std::unique_ptr<std::thread> writer;
+        std::filesystem::path session;
+        std::ofstream index;
+
+        std::atomic<uint64_t> signal = 0;
+        std::atomic<bool> alive = false;
+        std::atomic<size_t> dropped = 0;
+        std::atomic<size_t> written = 0;
+
+        // current segment, owned by writer thread
+        uint8_t *segment = nullptr;
+        size_t segment_size = 0;
+        size_t segment_used = 0;
+        uint32_t segment_id = 0;
+        int segment_fd = -1;
+
+        void worker();
+
+        void write(const SessionRecord &record, const uint8_t *data);
+
+        void openSegment(uint32_t id);
+
+        void closeSegment();
+
+    public:
+        SessionRecorder() = default;
+
+        SessionRecorder(const SessionRecorder &other) = delete;
+
+        SessionRecorder &operator=(const SessionRecorder &other) = delete;
+
+        ~SessionRecorder();
+
+        /**
+         * @brief Creates session directory and starts writer thread.
+         *
+         * @param path session directory (created if necessary)
+         * @param segment_size size of each preallocated segment file in bytes
+         * @param ring_size size of in-memory ring between capture and writer thread in bytes
+         *
+         * @throws std::runtime_error if session cannot be created
+         */
+        void open(const std::string &path, size_t segment_size, size_t ring_size);
+
+        /**
+         * @brief Enqueues frame for writing.
+         *
+         * @param set number of frame set (one capture call) frame belongs to
+         * @param device_id id of device
+         * @param frame frame to write, data is copied before return
+         * @return false if frame was dropped
+         *
+         * @note Never blocks, must be called from single thread
+         */
+        bool record(uint64_t set, uint device_id, const eox::v4l2::V4L2_Frame &frame);
+
+        /**
+         * Writes everything left in the ring, stops writer thread and closes files
+         */
+        void release();
+
+        [[nodiscard]] bool isOpened() const;
+
+        [[nodiscard]] size_t getDropped() const;
+
+        [[nodiscard]] size_t getWritten() const;
+    };
+
+} // eox
+
+#endif //STEREOX_SESSION_RECORDER_H
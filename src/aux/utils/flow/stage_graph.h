@@ -0,0 +1,203 @@
+//
+// Created by henryco on 2/17/24.
+//
+
+#ifndef STEREOX_STAGE_GRAPH_H
+#define STEREOX_STAGE_GRAPH_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <spdlog/logger.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include "../mailbox/bounded_queue.h"
+#include "../sched/thread_sched.h"
+
+namespace eox::util {
+
+    /**
+     * @class StageGraph
+     * @brief Pipelined runtime of named stages connected by bounded queues.
+     *
+     * Every stage runs on its own thread, so while frame N is processed by one stage,
+     * frame N+1 is already processed by the previous one: throughput approaches the speed of the slowest stage
+     * instead of the sum of all of them.
+     * Frames (T) are preallocated and recycled, frame leaving the last stage (or dropped by any stage)
+     * goes back to the free list, source waits for a free frame when every frame is in flight.
+     * Depth of the queue in front of each stage trades latency for throughput.
+     *
+     * Example Usage:
+     * @code
+     * StageGraph<Frame> graph;
+     * graph.stage("process", [](uint64_t id, Frame &frame) { return process(frame); }, 2);
+     * graph.stage("render", [](uint64_t id, Frame &frame) { return render(frame); });
+     * graph.start();
+     *
+     * // source thread
+     * graph.push([](uint64_t id, Frame &frame) { return capture(frame); });
+     * @endcode
+     */
+    template<typename T>
+    class StageGraph {
+        static inline const auto log =
+                spdlog::stdout_color_mt("stage_graph");
+
+    public:
+        /**
+         * @brief Processes the frame in place.
+         * Receives frame id (increasing in order of push) and the frame,
+         * returns false to drop the frame (it skips the rest of stages).
+         */
+        using stage_func = std::function<bool(uint64_t, T &)>;
+
+    private:
+        using packet = struct {
+            uint64_t id;
+            T *frame;
+        };
+
+        using stage_state = struct {
+            std::string name;
+            stage_func func;
+            std::unique_ptr<BoundedQueue<packet>> input;
+            std::thread thread;
+        };
+
+        std::vector<std::unique_ptr<stage_state>> stages;
+        std::vector<std::unique_ptr<T>> frames;
+        std::unique_ptr<BoundedQueue<packet>> available;
+        uint64_t next_id = 0;
+        std::atomic<bool> running = false;
+
+        void worker(size_t index) {
+            auto &self = *stages[index];
+            auto *output = index + 1 < stages.size() ? stages[index + 1]->input.get() : nullptr;
+            apply_thread_sched(thread_class::STAGE, self.name);
+
+            packet p{};
+            while (self.input->pop(p)) {
+                bool passed = false;
+                try {
+                    passed = self.func(p.id, *p.frame);
+                } catch (const std::exception &e) {
+                    log->error("stage [{}] failed on frame {}: {}", self.name, p.id, e.what());
+                }
+
+                // blocks while the next stage is busy and its queue is full (backpressure)
+                if (!(passed && output && output->push(p)))
+                    available->push(p);
+            }
+        }
+
+    public:
+        StageGraph() = default;
+
+        StageGraph(const StageGraph &other) = delete;
+
+        StageGraph &operator=(const StageGraph &other) = delete;
+
+        ~StageGraph() {
+            stop();
+        }
+
+        /**
+         * @brief Appends the stage, stages are executed in order of addition. Must be called before start().
+         * @param name name of the stage (logs)
+         * @param func stage function
+         * @param depth maximum number of frames waiting in front of the stage
+         */
+        void stage(std::string name, stage_func func, size_t depth = 1) {
+            stages.push_back(std::unique_ptr<stage_state>(new stage_state{
+                    .name = std::move(name),
+                    .func = std::move(func),
+                    .input = std::make_unique<BoundedQueue<packet>>(depth),
+                    .thread = {}
+            }));
+        }
+
+        /**
+         * Allocates frames and starts the stage threads
+         */
+        void start() {
+            if (running)
+                return;
+
+            // enough frames to keep every queue full while every stage (and the source) works on its own frame
+            size_t total = 1;
+            for (const auto &s: stages) {
+                total += s->input->capacity() + 1;
+            }
+
+            available = std::make_unique<BoundedQueue<packet>>(total);
+            frames.clear();
+            frames.reserve(total);
+            for (size_t i = 0; i < total; i++) {
+                frames.push_back(std::make_unique<T>());
+                available->push({.id = 0, .frame = frames.back().get()});
+            }
+
+            log->debug("start, stages: {}, frames: {}", stages.size(), total);
+
+            running = true;
+            for (size_t i = 0; i < stages.size(); i++) {
+                stages[i]->thread = std::thread(&StageGraph::worker, this, i);
+            }
+        }
+
+        /**
+         * @brief Feeds the graph with the next frame, called by the source thread.
+         * Blocks until there is a free frame (every frame is in flight) or the graph is stopped.
+         * @param source fills the frame, returns false to drop it
+         * @return false if frame was dropped or graph is stopped
+         */
+        bool push(const stage_func &source) {
+            packet p{};
+            if (!running || !available->pop(p))
+                return false;
+
+            p.id = next_id++;
+            bool passed = false;
+            try {
+                passed = source(p.id, *p.frame);
+            } catch (const std::exception &e) {
+                log->error("source failed on frame {}: {}", p.id, e.what());
+            }
+
+            if (passed && !stages.empty() && stages[0]->input->push(p))
+                return true;
+
+            available->push(p);
+            return false;
+        }
+
+        /**
+         * Stops and joins the stage threads, frames still waiting in the queues are discarded
+         */
+        void stop() {
+            if (!running)
+                return;
+
+            log->debug("stop");
+
+            available->close();
+            for (auto &s: stages) {
+                s->input->close();
+            }
+            for (auto &s: stages) {
+                if (s->thread.joinable())
+                    s->thread.join();
+            }
+            running = false;
+
+            log->debug("stopped");
+        }
+    };
+
+} // eox
+
+#endif //STEREOX_STAGE_GRAPH_H
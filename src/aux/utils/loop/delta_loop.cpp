@@ -3,9 +3,15 @@
 //
 
 #include "delta_loop.h"
+#include "../sched/thread_sched.h"
+#include "../trace/trace.h"
+#include "../metrics/metrics.h"
 
+#include <ctime>
+#include <cerrno>
 #include <memory>
 #include <utility>
+#include <algorithm>
 
 namespace eox::util {
 
@@ -36,6 +42,12 @@ namespace eox::util {
     }
 
     void DeltaLoop::worker() {
+        apply_thread_sched(thread_class::LOOP, "loop");
+
+        if (pacing == eox::data::DEADLINE) {
+            deadlineWorker();
+            return;
+        }
 
         auto loop_pre = std::chrono::high_resolution_clock::now();
         auto loop_post = std::chrono::high_resolution_clock::now();
@@ -70,11 +82,14 @@ namespace eox::util {
 
             loop_pre = std::chrono::high_resolution_clock::now();
 
-            runnable(
-                    ((float) delta.count()) / 1000000.f, // delta
-                    ((float) late.count()) / 1000000.f,  // latency
-                    fps / (float) iteration              // averaged fps
-                    );
+            {
+                EOX_TRACE_SPAN("loop::update");
+                runnable(
+                        ((float) delta.count()) / 1000000.f, // delta
+                        ((float) late.count()) / 1000000.f,  // latency
+                        fps / (float) iteration              // averaged fps
+                );
+            }
 
             loop_post = std::chrono::high_resolution_clock::now();
 
@@ -107,6 +122,157 @@ namespace eox::util {
         }
     }
 
+    void DeltaLoop::deadlineWorker() {
+        using clock = std::chrono::steady_clock;
+
+        auto deadline = clock::now();
+        auto previous = deadline;
+        auto fps = 0.f;
+        uint64_t iteration = 0;
+
+        auto &fps_gauge = metrics_gauge("eox_loop_fps", "Averaged frames per second of the loop");
+
+        while (alive) {
+            const auto now = clock::now();
+            const auto late = std::chrono::duration_cast<std::chrono::nanoseconds>(now - deadline);
+            const auto delta = std::chrono::duration_cast<std::chrono::nanoseconds>(now - previous);
+            previous = now;
+
+            // exponential moving average, does not reset and reacts to change within few frames
+            if (delta.count() > 0) {
+                const auto current = 1000000000.f / (float) delta.count();
+                fps = fps == 0 ? current : fps * .9f + current * .1f;
+                fps_gauge.set(fps);
+            }
+
+            {
+                EOX_TRACE_SPAN("loop::update");
+                runnable(
+                        ((float) delta.count()) / 1000000.f, // delta
+                        ((float) late.count()) / 1000000.f,  // latency (wake-up error)
+                        fps                                  // averaged fps
+                );
+            }
+
+            // no schedule, next iteration is due right away
+            if (frame.count() <= 0) {
+                deadline = clock::now();
+                continue;
+            }
+
+            deadline += frame;
+
+            const auto after = clock::now();
+            const bool missed = after > deadline;
+            if (missed) {
+                switch (overrun) {
+                    case eox::data::SKIP: {
+                        // keep the phase of the schedule, missed deadlines are dropped
+                        const auto behind = (after - deadline) / frame + 1;
+                        deadline += frame * behind;
+                        break;
+                    }
+                    case eox::data::CATCH_UP:
+                        // deadlines in the past do not sleep at all, but do not try to catch up forever
+                        deadline = std::max(deadline, after - frame * (long) CATCH_UP_MAX);
+                        break;
+                    case eox::data::SLIP:
+                        deadline = after;
+                        break;
+                }
+            }
+
+            recordJitter(late, missed);
+            if (++iteration % JITTER_SAMPLES == 0) {
+                const auto j = getJitter();
+                log->debug("jitter p50: {}ms, p90: {}ms, p99: {}ms, max: {}ms, overruns: {}",
+                           j.p50, j.p90, j.p99, j.max, j.overruns);
+            }
+
+            sleepUntil(deadline);
+        }
+    }
+
+    void DeltaLoop::sleepUntil(std::chrono::steady_clock::time_point deadline) {
+        // steady_clock is CLOCK_MONOTONIC, long sleeps are sliced so stop() does not wait for them
+        while (alive) {
+            const auto now = std::chrono::steady_clock::now();
+            if (now >= deadline)
+                return;
+
+            const auto until = std::min(deadline, now + SLEEP_SLICE);
+            const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(until.time_since_epoch()).count();
+            const timespec ts{
+                    .tv_sec = (time_t) (ns / 1000000000),
+                    .tv_nsec = (long) (ns % 1000000000)
+            };
+
+            int result;
+            do {
+                result = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+            } while (result == EINTR);
+        }
+    }
+
+    void DeltaLoop::recordJitter(std::chrono::nanoseconds error, bool overrun) {
+        static auto &wake_up = metrics_histogram(
+                "eox_loop_wake_up_seconds", "Wake-up error of the loop (lateness against deadline)");
+        static auto &missed = metrics_counter(
+                "eox_loop_overruns_total", "Iterations which missed their deadline");
+        wake_up.record(std::max<int64_t>(0, error.count()));
+        missed.add(overrun);
+
+        std::lock_guard<std::mutex> lock(jitter_mutex);
+        if (jitter.size() < JITTER_SAMPLES)
+            jitter.push_back(error.count());
+        else
+            jitter[jitter_next] = error.count();
+        jitter_next = (jitter_next + 1) % JITTER_SAMPLES;
+        overruns += overrun;
+    }
+
+    loop_jitter DeltaLoop::getJitter() const {
+        std::vector<int64_t> samples;
+        uint64_t missed;
+        {
+            std::lock_guard<std::mutex> lock(jitter_mutex);
+            samples = jitter;
+            missed = overruns;
+        }
+
+        if (samples.empty())
+            return {.p50 = 0, .p90 = 0, .p99 = 0, .max = 0, .samples = 0, .overruns = missed};
+
+        std::sort(samples.begin(), samples.end());
+        const auto percentile = [&samples](double p) {
+            const auto index = std::min(samples.size() - 1, (size_t) (p * (double) samples.size()));
+            return (float) samples[index] / 1000000.f;
+        };
+
+        return {
+                .p50 = percentile(.50),
+                .p90 = percentile(.90),
+                .p99 = percentile(.99),
+                .max = (float) samples.back() / 1000000.f,
+                .samples = samples.size(),
+                .overruns = missed
+        };
+    }
+
+    void DeltaLoop::setPacing(eox::data::Pacing _pacing) {
+        this->pacing = _pacing;
+    }
+
+    void DeltaLoop::setOverrun(eox::data::Overrun _overrun) {
+        this->overrun = _overrun;
+    }
+
+    void DeltaLoop::setConfig(const eox::data::loop_config &config) {
+        setPacing(config.pacing);
+        setOverrun(config.overrun);
+        setFps(config.fps);
+    }
+
     void DeltaLoop::start() {
         {
             std::unique_lock<std::mutex> lock(mutex);
@@ -134,6 +300,12 @@ namespace eox::util {
             log->debug("wait join");
 
             thread->join();
+
+            if (pacing == eox::data::DEADLINE && frame.count() > 0) {
+                const auto j = getJitter();
+                log->info("jitter p50: {}ms, p90: {}ms, p99: {}ms, max: {}ms, overruns: {}",
+                          j.p50, j.p90, j.p99, j.max, j.overruns);
+            }
         }
 
         log->debug("stopped");
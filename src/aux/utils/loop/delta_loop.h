@@ -6,6 +6,11 @@
 #define STEREOX_DELTA_LOOP_H
 
 #include <functional>
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <map>
 #include <thread>
 #include <atomic>
 #include <mutex>
@@ -13,8 +18,23 @@
 #include <spdlog/logger.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 
+#include "../../commons.h"
+
 namespace eox::util {
 
+    typedef struct {
+        // wake-up error (actual start - deadline) percentiles in ms
+        float p50;
+        float p90;
+        float p99;
+        float max;
+
+        // number of samples percentiles are computed from
+        size_t samples;
+
+        // number of iterations which missed their deadline
+        uint64_t overruns;
+    } loop_jitter;
 
     /**
      * @class DeltaLoop
@@ -26,6 +46,10 @@ namespace eox::util {
                 spdlog::stdout_color_mt("delta_loop");
 
     private:
+        static inline const size_t JITTER_SAMPLES = 1024;
+        static inline const size_t CATCH_UP_MAX = 4;
+        static inline const auto SLEEP_SLICE = std::chrono::milliseconds(100);
+
         std::chrono::nanoseconds frame;
         std::unique_ptr<std::thread> thread;
         std::function<void(float, float, float)> runnable;
@@ -34,6 +58,15 @@ namespace eox::util {
         std::condition_variable flag;
         std::mutex mutex;
 
+        eox::data::Pacing pacing = eox::data::DRIFT;
+        eox::data::Overrun overrun = eox::data::SKIP;
+
+        // ring of recent wake-up errors (ns)
+        std::vector<int64_t> jitter;
+        size_t jitter_next = 0;
+        uint64_t overruns = 0;
+        mutable std::mutex jitter_mutex;
+
     public:
 
         /**
@@ -95,6 +128,27 @@ namespace eox::util {
 
         float getFrameLength();
 
+        /**
+         * @brief Pacing of the loop, must be set before start(). Default: DRIFT.
+         */
+        void setPacing(eox::data::Pacing pacing);
+
+        /**
+         * @brief Overrun policy of DEADLINE pacing, must be set before start(). Default: SKIP.
+         */
+        void setOverrun(eox::data::Overrun overrun);
+
+        /**
+         * @brief Pacing, overrun policy and frame rate at once (i.e. from command line), must be set before start()
+         */
+        void setConfig(const eox::data::loop_config &config);
+
+        /**
+         * @return percentiles of wake-up error of recent iterations (DEADLINE pacing with fps > 0),
+         *         summary is logged on stop()
+         */
+        [[nodiscard]] loop_jitter getJitter() const;
+
     protected:
 
         /**
@@ -107,6 +161,18 @@ namespace eox::util {
 
         void worker();
 
+        /**
+         * Worker of DEADLINE pacing
+         */
+        void deadlineWorker();
+
+        /**
+         * Sleeps until absolute deadline (steady clock), wakes up earlier only when loop is stopped
+         */
+        void sleepUntil(std::chrono::steady_clock::time_point deadline);
+
+        void recordJitter(std::chrono::nanoseconds error, bool overrun);
+
     };
 
 } // eox
@@ -0,0 +1,111 @@
+//
+// Created by henryco on 2/17/24.
+//
+
+#ifndef STEREOX_BOUNDED_QUEUE_H
+#define STEREOX_BOUNDED_QUEUE_H
+
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <condition_variable>
+
+namespace eox::util {
+
+    /**
+     * @class BoundedQueue
+     * @brief Blocking FIFO queue with fixed capacity (multiple producers / multiple consumers).
+     *
+     * Producer waits while queue is full (backpressure), consumer waits while queue is empty.
+     * Storage is allocated once, so pushing and popping never allocates.
+     * Closing the queue wakes up everyone, afterwards both push and pop fail immediately (remaining items are left as is).
+     */
+    template<typename T>
+    class BoundedQueue {
+    private:
+        std::vector<T> buffer;
+        size_t head = 0;
+        size_t count = 0;
+        bool closed = false;
+
+        mutable std::mutex mutex;
+        std::condition_variable not_empty;
+        std::condition_variable not_full;
+
+    public:
+        /**
+         * @param capacity maximum number of items (at least 1)
+         */
+        explicit BoundedQueue(size_t capacity) : buffer(std::max<size_t>(capacity, 1)) {
+        }
+
+        BoundedQueue(const BoundedQueue &other) = delete;
+
+        BoundedQueue &operator=(const BoundedQueue &other) = delete;
+
+        /**
+         * Blocks until there is free space
+         * @return false if queue is closed (item is not added)
+         */
+        bool push(T item) {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_full.wait(lock, [this]() {
+                return closed || count < buffer.size();
+            });
+            if (closed)
+                return false;
+
+            buffer[(head + count) % buffer.size()] = std::move(item);
+            count++;
+            lock.unlock();
+
+            not_empty.notify_one();
+            return true;
+        }
+
+        /**
+         * Blocks until there is an item
+         * @return false if queue is closed
+         */
+        bool pop(T &out) {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_empty.wait(lock, [this]() {
+                return closed || count > 0;
+            });
+            if (closed)
+                return false;
+
+            out = std::move(buffer[head]);
+            head = (head + 1) % buffer.size();
+            count--;
+            lock.unlock();
+
+            not_full.notify_one();
+            return true;
+        }
+
+        /**
+         * Wakes up all waiting producers and consumers, queue cannot be used anymore
+         */
+        void close() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                closed = true;
+            }
+            not_empty.notify_all();
+            not_full.notify_all();
+        }
+
+        [[nodiscard]] size_t size() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return count;
+        }
+
+        [[nodiscard]] size_t capacity() const {
+            return buffer.size();
+        }
+    };
+
+} // eox
+
+#endif //STEREOX_BOUNDED_QUEUE_H
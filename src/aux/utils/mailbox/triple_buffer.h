@@ -0,0 +1,94 @@
+//
+// Created by henryco on 2/7/24.
+//
+
+#ifndef STEREOX_TRIPLE_BUFFER_H
+#define STEREOX_TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace eox::util {
+
+    /**
+     * @class TripleBuffer
+     * @brief Lock-free single producer / single consumer "latest value" mailbox.
+     *
+     * Producer always writes into its own back slot and publishes it by swapping it with the middle one,
+     * consumer swaps its front slot with the middle one only if something new was published.
+     * Neither side ever waits for the other, older unread values are simply overwritten.
+     *
+     * Example Usage:
+     * @code
+     * // producer thread
+     * mailbox.back() = produce();
+     * mailbox.publish();
+     *
+     * // consumer thread
+     * if (mailbox.update())
+     *     consume(mailbox.front());
+     * @endcode
+     */
+    template<typename T>
+    class TripleBuffer {
+    private:
+        static inline const uint8_t INDEX_MASK = 0b011;
+        static inline const uint8_t FRESH_BIT = 0b100;
+
+        T buffers[3];
+
+        // index of the middle (shared) slot + fresh flag
+        std::atomic<uint8_t> middle = 2;
+
+        // owned by producer
+        uint8_t back_index = 0;
+
+        // owned by consumer
+        uint8_t front_index = 1;
+
+    public:
+
+        /**
+         * @return slot owned by producer, write new value here before publish()
+         */
+        T &back() {
+            return buffers[back_index];
+        }
+
+        /**
+         * Makes value written into back() slot visible for the consumer
+         */
+        void publish() {
+            back_index = middle.exchange(back_index | FRESH_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+        }
+
+        /**
+         * @return true if there is published value not yet taken by consumer
+         */
+        [[nodiscard]] bool fresh() const {
+            return middle.load(std::memory_order_acquire) & FRESH_BIT;
+        }
+
+        /**
+         * Takes the newest published value (if any) into front() slot
+         *
+         * @return true if front() slot was updated
+         */
+        bool update() {
+            if (!fresh())
+                return false;
+            front_index = middle.exchange(front_index, std::memory_order_acq_rel) & INDEX_MASK;
+            return true;
+        }
+
+        /**
+         * @return slot owned by consumer, contains the newest value taken with update()
+         */
+        T &front() {
+            return buffers[front_index];
+        }
+    };
+
+} // eox
+
+#endif //STEREOX_TRIPLE_BUFFER_H
@@ -0,0 +1,275 @@
+//
+// Created by henryco on 2/20/24.
+//
+
+#include "metrics.h"
+
+#include <map>
+#include <bit>
+#include <cmath>
+#include <cerrno>
+#include <algorithm>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <spdlog/logger.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+namespace eox::util {
+
+    namespace {
+        const auto log = spdlog::stdout_color_mt("metrics");
+
+        const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+        template<typename T>
+        struct family {
+            std::string help;
+            std::map<std::string, std::unique_ptr<T>> series;
+        };
+
+        std::mutex registry_mutex;
+        std::map<std::string, family<Histogram>> histograms;
+        std::map<std::string, family<Counter>> counters;
+        std::map<std::string, family<Gauge>> gauges;
+
+        std::mutex server_mutex;
+        std::thread server;
+        std::atomic<bool> serving = false;
+        int server_fd = -1;
+        std::string dump_path;
+
+        template<typename T>
+        T &metric(std::map<std::string, family<T>> &map,
+                  const std::string &name,
+                  const std::string &help,
+                  const std::string &labels) {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            auto &f = map[name];
+            if (f.help.empty())
+                f.help = help;
+            auto &m = f.series[labels];
+            if (!m)
+                m = std::make_unique<T>();
+            return *m;
+        }
+
+        std::string series(const std::string &name, const std::string &labels, const std::string &extra = "") {
+            if (labels.empty() && extra.empty())
+                return name;
+            if (labels.empty())
+                return name + "{" + extra + "}";
+            if (extra.empty())
+                return name + "{" + labels + "}";
+            return name + "{" + labels + "," + extra + "}";
+        }
+
+        void serve() {
+            const std::string header = "HTTP/1.0 200 OK\r\n"
+                                       "Content-Type: text/plain; version=0.0.4\r\n"
+                                       "Connection: close\r\n\r\n";
+            char request[4096];
+            while (serving) {
+                const int client = accept(server_fd, nullptr, nullptr);
+                if (client < 0) {
+                    if (serving)
+                        log->warn("accept failed: {}", errno);
+                    continue;
+                }
+
+                // silent or stalled clients must not block the server thread (and metrics_stop() with it)
+                const timeval timeout = {.tv_sec = 1, .tv_usec = 0};
+                setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+                // request itself does not matter, every path gets the registry
+                if (recv(client, request, sizeof(request), 0) <= 0) {
+                    close(client);
+                    continue;
+                }
+
+                const auto response = header + metrics_text();
+                size_t sent = 0;
+                while (sent < response.size()) {
+                    const auto n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+                    if (n <= 0)
+                        break;
+                    sent += n;
+                }
+                close(client);
+            }
+        }
+    }
+
+    size_t Histogram::bucket(uint64_t value) {
+        if (value < SUB_BUCKETS)
+            return value;
+        const int exponent = 63 - std::countl_zero(value);
+        const auto sub = (value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+        return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+    }
+
+    uint64_t Histogram::value(size_t bucket) {
+        if (bucket < SUB_BUCKETS)
+            return bucket;
+        const int exponent = (int) (bucket / SUB_BUCKETS) + SUB_BUCKET_BITS - 1;
+        const auto sub = bucket % SUB_BUCKETS;
+        const auto width = 1ull << (exponent - SUB_BUCKET_BITS);
+        return ((SUB_BUCKETS + sub) << (exponent - SUB_BUCKET_BITS)) + width / 2;
+    }
+
+    uint64_t Histogram::quantile(const snapshot &s, double q) {
+        if (s.count == 0)
+            return 0;
+
+        const auto rank = std::max<uint64_t>(1, (uint64_t) std::ceil(q * (double) s.count));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < s.buckets.size(); i++) {
+            seen += s.buckets[i];
+            if (seen >= rank)
+                return std::min(value(i), s.max);
+        }
+        return s.max;
+    }
+
+    void Histogram::record(uint64_t nanoseconds) {
+        buckets[bucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+        auto current = max.load(std::memory_order_relaxed);
+        while (current < nanoseconds && !max.compare_exchange_weak(current, nanoseconds, std::memory_order_relaxed));
+    }
+
+    Histogram::snapshot Histogram::take() const {
+        snapshot s{.buckets = std::vector<uint64_t>(BUCKETS), .count = 0, .sum = 0, .max = 0};
+        for (size_t i = 0; i < BUCKETS; i++) {
+            s.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+            s.count += s.buckets[i];
+        }
+        // concurrent records might be seen partially (i.e. in buckets but not in sum yet)
+        s.sum = sum.load(std::memory_order_relaxed);
+        s.max = max.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    Histogram &metrics_histogram(const std::string &name, const std::string &help, const std::string &labels) {
+        return metric(histograms, name, help, labels);
+    }
+
+    Counter &metrics_counter(const std::string &name, const std::string &help, const std::string &labels) {
+        return metric(counters, name, help, labels);
+    }
+
+    Gauge &metrics_gauge(const std::string &name, const std::string &help, const std::string &labels) {
+        return metric(gauges, name, help, labels);
+    }
+
+    std::string metrics_text() {
+        std::ostringstream out;
+        out.precision(9);
+
+        std::lock_guard<std::mutex> lock(registry_mutex);
+
+        for (const auto &[name, f]: histograms) {
+            out << "# HELP " << name << " " << f.help << "\n";
+            out << "# TYPE " << name << " summary\n";
+            for (const auto &[labels, h]: f.series) {
+                const auto s = h->take();
+                for (const auto q: QUANTILES) {
+                    std::ostringstream quantile;
+                    quantile << "quantile=\"" << q << "\"";
+                    out << series(name, labels, quantile.str()) << " "
+                        << (double) Histogram::quantile(s, q) / 1e9 << "\n";
+                }
+                out << series(name + "_sum", labels) << " " << (double) s.sum / 1e9 << "\n";
+                out << series(name + "_count", labels) << " " << s.count << "\n";
+            }
+
+            out << "# HELP " << name << "_max " << "Maximum of " << name << "\n";
+            out << "# TYPE " << name << "_max gauge\n";
+            for (const auto &[labels, h]: f.series) {
+                out << series(name + "_max", labels) << " " << (double) h->take().max / 1e9 << "\n";
+            }
+        }
+
+        for (const auto &[name, f]: counters) {
+            out << "# HELP " << name << " " << f.help << "\n";
+            out << "# TYPE " << name << " counter\n";
+            for (const auto &[labels, c]: f.series) {
+                out << series(name, labels) << " " << c->value() << "\n";
+            }
+        }
+
+        for (const auto &[name, f]: gauges) {
+            out << "# HELP " << name << " " << f.help << "\n";
+            out << "# TYPE " << name << " gauge\n";
+            for (const auto &[labels, g]: f.series) {
+                out << series(name, labels) << " " << g->value() << "\n";
+            }
+        }
+
+        return out.str();
+    }
+
+    void metrics_start(int port, const std::string &dump) {
+        std::lock_guard<std::mutex> lock(server_mutex);
+        dump_path = dump;
+
+        if (port <= 0 || serving)
+            return;
+
+        server_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (server_fd < 0) {
+            log->error("cannot create metrics socket");
+            throw std::runtime_error("cannot create metrics socket");
+        }
+
+        const int reuse = 1;
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        if (bind(server_fd, (sockaddr *) &address, sizeof(address)) != 0 || listen(server_fd, 4) != 0) {
+            close(server_fd);
+            server_fd = -1;
+            log->error("cannot listen on 127.0.0.1:{}", port);
+            throw std::runtime_error("cannot listen on 127.0.0.1:" + std::to_string(port));
+        }
+
+        serving = true;
+        server = std::thread(serve);
+        log->info("metrics: http://127.0.0.1:{}/metrics", port);
+    }
+
+    void metrics_stop() {
+        std::lock_guard<std::mutex> lock(server_mutex);
+
+        if (serving) {
+            serving = false;
+            // wakes up blocking accept
+            shutdown(server_fd, SHUT_RDWR);
+            server.join();
+            close(server_fd);
+            server_fd = -1;
+        }
+
+        if (!dump_path.empty()) {
+            std::ofstream file(dump_path);
+            file << metrics_text();
+            log->info("metrics written into: {}", dump_path);
+            dump_path.clear();
+        }
+    }
+
+} // eox
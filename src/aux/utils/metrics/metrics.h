@@ -0,0 +1,165 @@
+//
+// Created by henryco on 2/20/24.
+//
+
+#ifndef STEREOX_METRICS_H
+#define STEREOX_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace eox::util {
+
+    /**
+     * @class Histogram
+     * @brief Lock-free log-linear (HDR style) histogram of latencies in nanoseconds.
+     *
+     * Every power of two is split into 32 linear sub-buckets, so any recorded value
+     * (1ns - hundreds of years) is kept with relative error below ~3%,
+     * recording is a handful of relaxed atomic increments.
+     */
+    class Histogram {
+    public:
+        static inline const int SUB_BUCKET_BITS = 5;
+        static inline const size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        static inline const size_t BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+        using snapshot = struct {
+            std::vector<uint64_t> buckets;
+            uint64_t count;
+            uint64_t sum;
+            uint64_t max;
+        };
+
+    private:
+        std::array<std::atomic<uint64_t>, BUCKETS> buckets{};
+        std::atomic<uint64_t> sum = 0;
+        std::atomic<uint64_t> max = 0;
+
+    public:
+        static size_t bucket(uint64_t value);
+
+        /**
+         * @return representative (middle) value of the bucket
+         */
+        static uint64_t value(size_t bucket);
+
+        /**
+         * @return value at quantile q (0 - 1) of the snapshot, 0 if empty
+         */
+        static uint64_t quantile(const snapshot &s, double q);
+
+        void record(uint64_t nanoseconds);
+
+        [[nodiscard]] snapshot take() const;
+    };
+
+    /**
+     * @class Counter
+     * @brief Monotonically increasing value
+     */
+    class Counter {
+    private:
+        std::atomic<uint64_t> total = 0;
+
+    public:
+        void add(uint64_t value = 1) {
+            total.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] uint64_t value() const {
+            return total.load(std::memory_order_relaxed);
+        }
+    };
+
+    /**
+     * @class Gauge
+     * @brief Value which goes up and down
+     */
+    class Gauge {
+    private:
+        std::atomic<double> current = 0;
+
+    public:
+        void set(double value) {
+            current.store(value, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] double value() const {
+            return current.load(std::memory_order_relaxed);
+        }
+    };
+
+    /**
+     * @brief Returns histogram of the registry (created on first use, never removed).
+     * Exported as summary (p50, p90, p99, p999, sum, count) in seconds, plus maximum.
+     * @param name name of the metric family
+     * @param help description of the metric family
+     * @param labels prometheus labels of the series, i.e.: stage="invoke"
+     */
+    Histogram &metrics_histogram(const std::string &name, const std::string &help, const std::string &labels = "");
+
+    Counter &metrics_counter(const std::string &name, const std::string &help, const std::string &labels = "");
+
+    Gauge &metrics_gauge(const std::string &name, const std::string &help, const std::string &labels = "");
+
+    /**
+     * @return whole registry in prometheus text exposition format
+     */
+    std::string metrics_text();
+
+    /**
+     * @brief Starts serving the registry over loopback HTTP (http://127.0.0.1:port/metrics)
+     * @param port 0 - do not serve
+     * @param dump file the registry is written into by metrics_stop() (empty - none)
+     */
+    void metrics_start(int port, const std::string &dump);
+
+    /**
+     * @brief Stops HTTP endpoint and dumps the registry to the file (if requested)
+     */
+    void metrics_stop();
+
+    /**
+     * @class ScopedLatency
+     * @brief Records the lifetime of the scope into the histogram
+     */
+    class ScopedLatency {
+    private:
+        Histogram &histogram;
+        std::chrono::steady_clock::time_point begin;
+
+    public:
+        explicit ScopedLatency(Histogram &_histogram)
+                : histogram(_histogram), begin(std::chrono::steady_clock::now()) {
+        }
+
+        ScopedLatency(const ScopedLatency &other) = delete;
+
+        ScopedLatency &operator=(const ScopedLatency &other) = delete;
+
+        ~ScopedLatency() {
+            histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - begin).count());
+        }
+    };
+
+} // eox
+
+#define EOX_METRICS_CONCAT_INNER(a, b) a##b
+#define EOX_METRICS_CONCAT(a, b) EOX_METRICS_CONCAT_INNER(a, b)
+
+/**
+ * Records latency of the rest of the scope as eox_stage_latency_seconds{stage="<stage>"}
+ */
+#define EOX_STAGE_LATENCY(stage)                                                                    \
+    static auto &EOX_METRICS_CONCAT(_eox_latency_, __LINE__) = eox::util::metrics_histogram(      \
+            "eox_stage_latency_seconds", "Latency of pipeline stages", "stage=\"" stage "\"");      \
+    const eox::util::ScopedLatency EOX_METRICS_CONCAT(_eox_latency_scope_, __LINE__)(              \
+            EOX_METRICS_CONCAT(_eox_latency_, __LINE__))
+
+#endif //STEREOX_METRICS_H
@@ -0,0 +1,207 @@
+//
+// Created by henryco on 2/18/24.
+//
+
+#include "thread_sched.h"
+
+#include <mutex>
+#include <sstream>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <spdlog/logger.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+namespace eox::util {
+
+    namespace {
+        const auto log = spdlog::stdout_color_mt("thread_sched");
+
+        std::mutex config_mutex;
+        std::map<std::string, thread_sched> classes;
+        bool configured = false;
+
+        // initial configuration of the process, applied to threads of classes which are not configured
+        cpu_set_t process_cpus;
+        int process_nice = 0;
+
+        std::string policy_name(int policy) {
+            switch (policy) {
+                case SCHED_FIFO:
+                    return "fifo";
+                case SCHED_RR:
+                    return "rr";
+                default:
+                    return "other";
+            }
+        }
+
+        std::string cpus_string(const cpu_set_t &set) {
+            std::string out;
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (!CPU_ISSET(cpu, &set))
+                    continue;
+                int last = cpu;
+                while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &set))
+                    last++;
+                if (!out.empty())
+                    out += ",";
+                out += last == cpu ? std::to_string(cpu) : std::to_string(cpu) + "-" + std::to_string(last);
+                cpu = last;
+            }
+            return out;
+        }
+
+        pid_t thread_id() {
+            return (pid_t) syscall(SYS_gettid);
+        }
+    }
+
+    std::vector<int> parse_cpus(const std::string &list) {
+        // input:  0-3,8 aka "0-3,8"
+        // output: [0, 1, 2, 3, 8]
+
+        std::vector<int> cpus;
+        std::istringstream stream(list);
+        std::string range;
+        while (std::getline(stream, range, ',')) {
+            if (range.empty())
+                continue;
+            const auto dash = range.find('-');
+            const int from = std::stoi(range.substr(0, dash));
+            const int to = dash == std::string::npos ? from : std::stoi(range.substr(dash + 1));
+            if (from < 0 || to < from || to >= CPU_SETSIZE) {
+                log->error("invalid cpu range: {}", range);
+                throw std::runtime_error("invalid cpu range: " + range);
+            }
+            for (int cpu = from; cpu <= to; cpu++)
+                cpus.push_back(cpu);
+        }
+        return cpus;
+    }
+
+    void parse_sched(const std::string &spec, thread_sched &sched) {
+        // input: "fifo:50", "rr:10", "nice:-5", "other"
+
+        const auto colon = spec.find(':');
+        const auto name = spec.substr(0, colon);
+        const auto value = colon == std::string::npos ? std::string() : spec.substr(colon + 1);
+
+        if (name == "fifo" || name == "rr") {
+            sched.policy = name == "fifo" ? SCHED_FIFO : SCHED_RR;
+            sched.priority = value.empty() ? 1 : std::stoi(value);
+            sched.nice = 0;
+        } else if (name == "nice") {
+            sched.policy = SCHED_OTHER;
+            sched.priority = 0;
+            sched.nice = value.empty() ? 0 : std::stoi(value);
+        } else if (name == "other") {
+            sched.policy = SCHED_OTHER;
+            sched.priority = 0;
+            sched.nice = 0;
+        } else {
+            log->error("invalid scheduling specification: {}", spec);
+            throw std::runtime_error("invalid scheduling specification: " + spec);
+        }
+    }
+
+    void configure_threads(const std::map<std::string, thread_sched> &config) {
+        std::lock_guard<std::mutex> lock(config_mutex);
+        classes = config;
+        configured = !classes.empty();
+
+        CPU_ZERO(&process_cpus);
+        sched_getaffinity(0, sizeof(process_cpus), &process_cpus);
+        process_nice = getpriority(PRIO_PROCESS, 0);
+
+        log->info("cpus available: {}", cpus_string(process_cpus));
+        if (!configured) {
+            log->info("threads are not pinned");
+            return;
+        }
+
+        for (const auto &[name, sched]: classes) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (const auto cpu: sched.cpus)
+                CPU_SET(cpu, &set);
+
+            log->info("threads [{}]: cpus: {}, policy: {}, priority: {}, nice: {}",
+                      name,
+                      sched.cpus.empty() ? cpus_string(process_cpus) : cpus_string(set),
+                      policy_name(sched.policy),
+                      sched.priority,
+                      sched.nice);
+        }
+    }
+
+    void apply_thread_sched(const std::string &thread_class, const std::string &name) {
+        pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+
+        thread_sched sched{.cpus = {}, .policy = SCHED_OTHER, .priority = 0, .nice = 0};
+        cpu_set_t set;
+        {
+            std::lock_guard<std::mutex> lock(config_mutex);
+            if (!configured)
+                return;
+
+            set = process_cpus;
+            sched.nice = process_nice;
+            const auto it = classes.find(thread_class);
+            if (it != classes.end())
+                sched = it->second;
+        }
+
+        if (!sched.cpus.empty()) {
+            CPU_ZERO(&set);
+            for (const auto cpu: sched.cpus)
+                CPU_SET(cpu, &set);
+        }
+
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+            log->warn("cannot set cpus: {} of thread [{}]", cpus_string(set), name);
+
+        sched_param param{.sched_priority = sched.policy == SCHED_OTHER ? 0 : sched.priority};
+        if (const int error = pthread_setschedparam(pthread_self(), sched.policy, &param); error != 0) {
+            log->warn("cannot set policy: {} of thread [{}]: {}", policy_name(sched.policy), name, strerror(error));
+        }
+
+        // nice level is per thread on linux
+        if (sched.policy == SCHED_OTHER && setpriority(PRIO_PROCESS, thread_id(), sched.nice) != 0)
+            log->warn("cannot set nice: {} of thread [{}]: {}", sched.nice, name, strerror(errno));
+
+        cpu_set_t actual;
+        CPU_ZERO(&actual);
+        pthread_getaffinity_np(pthread_self(), sizeof(actual), &actual);
+        log->debug("thread [{}] ({}): cpus: {}, policy: {}", name, thread_class, cpus_string(actual),
+                   policy_name(sched.policy));
+    }
+
+    ScopedAffinity::ScopedAffinity(const std::string &thread_class) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        {
+            std::lock_guard<std::mutex> lock(config_mutex);
+            const auto it = classes.find(thread_class);
+            if (!configured || it == classes.end() || it->second.cpus.empty())
+                return;
+            for (const auto cpu: it->second.cpus)
+                CPU_SET(cpu, &set);
+        }
+
+        CPU_ZERO(&previous);
+        if (pthread_getaffinity_np(pthread_self(), sizeof(previous), &previous) != 0)
+            return;
+        changed = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+
+    ScopedAffinity::~ScopedAffinity() {
+        if (changed)
+            pthread_setaffinity_np(pthread_self(), sizeof(previous), &previous);
+    }
+
+} // eox
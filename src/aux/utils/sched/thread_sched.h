@@ -0,0 +1,100 @@
+//
+// Created by henryco on 2/18/24.
+//
+
+#ifndef STEREOX_THREAD_SCHED_H
+#define STEREOX_THREAD_SCHED_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <sched.h>
+
+namespace eox::util {
+
+    /**
+     * Classes of threads which might be configured separately
+     */
+    namespace thread_class {
+        inline const std::string GUI = "gui";       // GTK main thread
+        inline const std::string LOOP = "loop";     // eox::util::DeltaLoop
+        inline const std::string POOL = "pool";     // eox::util::ThreadPool workers
+        inline const std::string STAGE = "stage";   // eox::util::StageGraph stages
+        inline const std::string DNN = "dnn";       // TFLite interpreter (and threads it spawns)
+    }
+
+    typedef struct {
+        /**
+         * cpus the thread is allowed to run on (empty - every cpu available to the process)
+         */
+        std::vector<int> cpus;
+
+        /**
+         * scheduling policy: SCHED_OTHER, SCHED_FIFO or SCHED_RR
+         */
+        int policy;
+
+        /**
+         * static priority of SCHED_FIFO and SCHED_RR (1 - 99)
+         */
+        int priority;
+
+        /**
+         * nice level of SCHED_OTHER (-20 - 19)
+         */
+        int nice;
+    } thread_sched;
+
+    using ThreadSched = thread_sched;
+
+    /**
+     * @brief Parses list of cpus, i.e.: "0-3,8,10-11"
+     */
+    std::vector<int> parse_cpus(const std::string &list);
+
+    /**
+     * @brief Parses scheduling specification into policy, priority and nice level,
+     * i.e.: "fifo:50", "rr:10", "nice:-5", "other"
+     */
+    void parse_sched(const std::string &spec, thread_sched &sched);
+
+    /**
+     * @brief Sets scheduling configuration of thread classes (called once at startup, before any thread starts).
+     * Logs resulting topology.
+     * Once anything is configured, threads of classes which are not configured get
+     * initial configuration of the process (instead of inheriting one of their parent thread).
+     */
+    void configure_threads(const std::map<std::string, thread_sched> &config);
+
+    /**
+     * @brief Applies configuration of thread class to the calling thread and names it.
+     * Failures (i.e. no permission for SCHED_FIFO) are logged, but never thrown.
+     * @param name name of the thread (at most 15 characters are visible)
+     */
+    void apply_thread_sched(const std::string &thread_class, const std::string &name);
+
+    /**
+     * @class ScopedAffinity
+     * @brief Moves calling thread to cpus of the thread class for the lifetime of the object.
+     *
+     * Used for the code which spawns threads of its own (i.e. TFLite interpreter):
+     * new threads inherit cpus of the thread they are created by.
+     */
+    class ScopedAffinity {
+    private:
+        cpu_set_t previous{};
+        bool changed = false;
+
+    public:
+        explicit ScopedAffinity(const std::string &thread_class);
+
+        ScopedAffinity(const ScopedAffinity &other) = delete;
+
+        ScopedAffinity &operator=(const ScopedAffinity &other) = delete;
+
+        ~ScopedAffinity();
+    };
+
+} // eox
+
+#endif //STEREOX_THREAD_SCHED_H
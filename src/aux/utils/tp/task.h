@@ -0,0 +1,296 @@
+//
+// Created by henryco on 2/16/24.
+//
+
+#ifndef STEREOX_TASK_H
+#define STEREOX_TASK_H
+
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <future>
+#include <cstddef>
+#include <optional>
+#include <variant>
+#include <exception>
+#include <type_traits>
+
+namespace eox::util {
+
+    /**
+     * @class TaskBase
+     * @brief Type-erased task, stored in the queues of eox::util::ThreadPool
+     */
+    class TaskBase {
+    public:
+        /**
+         * Executes the task and completes its future
+         */
+        virtual void run() = 0;
+
+        /**
+         * Task is never going to be executed, completes its future with broken promise error
+         */
+        virtual void cancel() = 0;
+
+    protected:
+        ~TaskBase() = default;
+    };
+
+    /**
+     * @class TaskState
+     * @brief Callable and result (completion slot) of a single task.
+     *
+     * Callable is stored inline (small-buffer), result is stored inline as well,
+     * states are recycled via per-type free list, so submitting a task allocates nothing
+     * once the free list is warmed up.
+     * State is shared by the task and its future, it goes back to the free list once both are done with it.
+     */
+    template<typename T>
+    class TaskState final : public TaskBase {
+    public:
+        static inline const size_t INLINE_CAPACITY = 64;
+        static inline const size_t FREE_LIST_MAX = 1024;
+
+    private:
+        using value_type = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+        struct free_list {
+            std::mutex mutex;
+            std::vector<TaskState *> states;
+
+            ~free_list() {
+                for (auto state: states)
+                    delete state;
+            }
+        };
+
+        alignas(std::max_align_t) unsigned char storage[INLINE_CAPACITY]{};
+        void *callable = nullptr;
+        void (*invoke)(TaskState &) = nullptr;
+        void (*dispose)(TaskState &) = nullptr;
+
+        std::optional<value_type> value;
+        std::exception_ptr error;
+        std::atomic<uint32_t> done = 0;
+        std::atomic<uint32_t> references = 0;
+
+        static free_list &pool() {
+            static free_list list;
+            return list;
+        }
+
+        template<typename F>
+        static void invoke_callable(TaskState &state) {
+            auto &f = *static_cast<F *>(state.callable);
+            if constexpr (std::is_void_v<T>) {
+                f();
+                state.value.emplace();
+            } else {
+                state.value.emplace(f());
+            }
+        }
+
+        template<typename F>
+        static void dispose_callable(TaskState &state) {
+            auto f = static_cast<F *>(state.callable);
+            if (state.callable == state.storage)
+                f->~F();
+            else
+                delete f;
+        }
+
+        /**
+         * Destroys callable (releasing everything it captured) and publishes the result
+         */
+        void complete() {
+            dispose(*this);
+            callable = nullptr;
+            done.store(1, std::memory_order_release);
+            done.notify_all();
+            release();
+        }
+
+        void recycle() {
+            value.reset();
+            error = nullptr;
+            done.store(0, std::memory_order_relaxed);
+
+            auto &list = pool();
+            {
+                std::lock_guard<std::mutex> lock(list.mutex);
+                if (list.states.size() < FREE_LIST_MAX) {
+                    list.states.push_back(this);
+                    return;
+                }
+            }
+            delete this;
+        }
+
+        TaskState() = default;
+
+        ~TaskState() = default;
+
+    public:
+        TaskState(const TaskState &other) = delete;
+
+        TaskState &operator=(const TaskState &other) = delete;
+
+        /**
+         * @return new state holding the callable, referenced by both task and future
+         */
+        template<typename F>
+        static TaskState *create(F &&func) {
+            using callable_type = std::decay_t<F>;
+
+            TaskState *state = nullptr;
+            {
+                auto &list = pool();
+                std::lock_guard<std::mutex> lock(list.mutex);
+                if (!list.states.empty()) {
+                    state = list.states.back();
+                    list.states.pop_back();
+                }
+            }
+            if (!state)
+                state = new TaskState();
+
+            if constexpr (sizeof(callable_type) <= INLINE_CAPACITY
+                          && alignof(callable_type) <= alignof(std::max_align_t)
+                          && std::is_nothrow_move_constructible_v<callable_type>) {
+                state->callable = new(state->storage) callable_type(std::forward<F>(func));
+            } else {
+                // too big for the inline storage, the only case when submission allocates
+                state->callable = new callable_type(std::forward<F>(func));
+            }
+
+            state->invoke = &invoke_callable<callable_type>;
+            state->dispose = &dispose_callable<callable_type>;
+            state->references.store(2, std::memory_order_relaxed);
+            return state;
+        }
+
+        void run() override {
+            try {
+                invoke(*this);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            complete();
+        }
+
+        void cancel() override {
+            error = std::make_exception_ptr(std::future_error(std::future_errc::broken_promise));
+            complete();
+        }
+
+        void release() {
+            if (references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                recycle();
+        }
+
+        [[nodiscard]] bool ready() const {
+            return done.load(std::memory_order_acquire) != 0;
+        }
+
+        void wait() const {
+            done.wait(0, std::memory_order_acquire);
+        }
+
+        /**
+         * @brief Moves the result out (or rethrows the exception of the task), task must be done.
+         */
+        T take() {
+            if (error)
+                std::rethrow_exception(error);
+            if constexpr (!std::is_void_v<T>)
+                return std::move(*value);
+        }
+    };
+
+    /**
+     * @class Future
+     * @brief Result of the task submitted to eox::util::ThreadPool, similar to std::future.
+     */
+    template<typename T>
+    class Future {
+    private:
+        TaskState<T> *state = nullptr;
+
+    public:
+        Future() = default;
+
+        explicit Future(TaskState<T> *_state) : state(_state) {
+        }
+
+        Future(Future &&other) noexcept: state(other.state) {
+            other.state = nullptr;
+        }
+
+        Future &operator=(Future &&other) noexcept {
+            if (this != &other) {
+                if (state)
+                    state->release();
+                state = other.state;
+                other.state = nullptr;
+            }
+            return *this;
+        }
+
+        Future(const Future &other) = delete;
+
+        Future &operator=(const Future &other) = delete;
+
+        ~Future() {
+            if (state)
+                state->release();
+        }
+
+        [[nodiscard]] bool valid() const {
+            return state != nullptr;
+        }
+
+        /**
+         * @return true if task is done (result is available)
+         */
+        [[nodiscard]] bool ready() const {
+            return state && state->ready();
+        }
+
+        /**
+         * Blocks until task is done
+         */
+        void wait() const {
+            if (state)
+                state->wait();
+        }
+
+        /**
+         * @brief Waits for the task and returns its result (or rethrows its exception).
+         * Future is not valid afterwards.
+         */
+        T get() {
+            if (!state)
+                throw std::future_error(std::future_errc::no_state);
+
+            state->wait();
+
+            auto s = state;
+            state = nullptr;
+
+            // state goes back to the pool even if task has thrown
+            struct guard {
+                TaskState<T> *s;
+
+                ~guard() {
+                    s->release();
+                }
+            } releaser{s};
+
+            return s->take();
+        }
+    };
+
+} // eox
+
+#endif //STEREOX_TASK_H
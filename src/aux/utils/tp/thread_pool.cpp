@@ -3,78 +3,184 @@
 //
 
 #include <iostream>
+#include <random>
+#include <algorithm>
 #include "thread_pool.h"
 #include "../globals/eox_globals.h"
+#include "../sched/thread_sched.h"
 
 namespace eox::util {
 
-    void ThreadPool::worker() {
-        while (true) {
+    void ThreadPool::worker(size_t index) {
+        current = this;
+        current_index = index;
+        apply_thread_sched(thread_class::POOL, "pool-" + std::to_string(index));
 
-            while (true) {
-                std::unique_lock<std::mutex> stateLock(mutex);
+        while (!stop) {
+            if (auto t = next(index)) {
+                // task state completes the future and goes back to the free list on its own
+                t->run();
+                continue;
+            }
 
-                if (stop) {
-                    stateLock.unlock();
-                    return;
-                }
+            // spin for a while, next task usually comes very soon (next stage of the same frame)
+            bool found = false;
+            for (size_t i = 0; i < SPIN_ROUNDS && !found && !stop; i++) {
+                std::this_thread::yield();
+                found = pending();
+            }
 
-                if (tasks.empty()) {
-                    stateLock.unlock();
-                    break;
-                }
+            if (!found)
+                park(index);
+        }
 
-                auto task = std::move(tasks.front());
-                tasks.pop();
-                stateLock.unlock();
+        current = nullptr;
+    }
 
-                if (task)
-                    task();
-            }
+    ThreadPool::task *ThreadPool::next(size_t index) {
+        if (index != EXTERNAL) {
+            if (auto t = workers[index]->deque.pop())
+                return t;
+        }
 
-            {
-                std::unique_lock<std::mutex> stopLock(mutex);
-                if (stop) {
-                    stopLock.unlock();
-                    return;
-                }
-
-                if (!tasks.empty()) {
-                    stopLock.unlock();
-                    continue;
-                }
-
-                flag.wait(stopLock);
-
-                if (stop) {
-                    stopLock.unlock();
-                    return;
-                }
-                stopLock.unlock();
-            }
+        if (injected_size.load(std::memory_order_acquire) > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (auto t = take_injected())
+                return t;
+        }
+
+        // start with random victim, so thieves do not fight over the same deque
+        static thread_local std::minstd_rand random(std::random_device{}());
+        const size_t n = workers.size();
+        const size_t offset = random();
+        for (size_t k = 0; k < n; k++) {
+            const size_t victim = (offset + k) % n;
+            if (victim == index)
+                continue;
+            if (auto t = workers[victim]->deque.steal())
+                return t;
         }
+
+        return nullptr;
     }
 
-    void ThreadPool::trigger() {
-        std::lock_guard<std::mutex> lock(mutex);
-        flag.notify_all();
+    bool ThreadPool::help() {
+        auto t = next(current == this ? current_index : EXTERNAL);
+        if (!t)
+            return false;
+        t->run();
+        return true;
     }
 
-    void ThreadPool::shutdown() {
-        log->debug("shutdown thread pool");
+    size_t ThreadPool::size() const {
+        return workers.size();
+    }
+
+    bool ThreadPool::pending() const {
+        if (injected_size.load(std::memory_order_seq_cst) > 0)
+            return true;
+        for (const auto &w: workers) {
+            if (!w->deque.empty())
+                return true;
+        }
+        return false;
+    }
+
+    void ThreadPool::park(size_t index) {
+        auto &self = *workers[index];
+        std::unique_lock<std::mutex> lock(idle_mutex);
+
+        // announce sleeping BEFORE the last check, so submitter either sees sleeper or we see the task
+        sleeping.fetch_add(1, std::memory_order_seq_cst);
+        if (stop || pending()) {
+            sleeping.fetch_sub(1, std::memory_order_seq_cst);
+            return;
+        }
+
+        self.woken = false;
+        idle.push_back(index);
+        self.flag.wait(lock, [this, &self]() {
+            return self.woken || stop;
+        });
+
+        if (!self.woken) {
+            // shutdown
+            idle.erase(std::find(idle.begin(), idle.end(), index));
+            sleeping.fetch_sub(1, std::memory_order_seq_cst);
+        }
+    }
+
+    void ThreadPool::wake() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_seq_cst) == 0)
+            return;
+
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        if (idle.empty())
+            return;
+
+        const auto index = idle.back();
+        idle.pop_back();
+        sleeping.fetch_sub(1, std::memory_order_seq_cst);
+
+        auto &w = *workers[index];
+        w.woken = true;
+        w.flag.notify_one();
+    }
+
+    void ThreadPool::inject(task *t) {
+        const size_t size = injected_size.load(std::memory_order_relaxed);
+        if (size == injected.size()) {
+            // full, unroll the ring into twice as large buffer
+            std::vector<task *> grown(std::max(INJECTED_CAPACITY, injected.size() * 2), nullptr);
+            for (size_t i = 0; i < size; i++)
+                grown[i] = injected[(injected_head + i) % injected.size()];
+            injected.swap(grown);
+            injected_head = 0;
+        }
+
+        injected[(injected_head + size) % injected.size()] = t;
+        injected_size.fetch_add(1, std::memory_order_seq_cst);
+    }
+
+    ThreadPool::task *ThreadPool::take_injected() {
+        if (injected_size.load(std::memory_order_relaxed) == 0)
+            return nullptr;
+
+        auto t = injected[injected_head];
+        injected[injected_head] = nullptr;
+        injected_head = (injected_head + 1) % injected.size();
+        injected_size.fetch_sub(1, std::memory_order_relaxed);
+        return t;
+    }
+
+    void ThreadPool::submit(task *t) {
+        // task spawned by the worker goes to its own deque
+        if (current == this && workers[current_index]->deque.push(t)) {
+            wake();
+            return;
+        }
 
         {
             std::lock_guard<std::mutex> lock(mutex);
-            stop = true;
-            flag.notify_all();
+            inject(t);
         }
 
-        while (!threads.empty()) {
+        wake();
+    }
 
-            log->debug("freeing pool");
+    void ThreadPool::shutdown() {
+        log->debug("shutdown thread pool");
+
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            stop = true;
+            for (auto &w: workers) {
+                w->flag.notify_all();
+            }
+        }
 
-            auto thread = std::move(threads.front());
-            threads.pop();
+        for (auto &thread: threads) {
 
             log->debug("pool wait");
 
@@ -82,6 +188,24 @@ namespace eox::util {
                 thread.join();
             }
         }
+        threads.clear();
+
+        // tasks never executed, their futures get broken promise
+        for (auto &w: workers) {
+            while (auto t = w->deque.pop())
+                t->cancel();
+        }
+        workers.clear();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (auto t = take_injected())
+                t->cancel();
+            injected_head = 0;
+        }
+
+        idle.clear();
+        sleeping = 0;
 
         log->debug("pool freed");
     }
@@ -100,39 +224,71 @@ namespace eox::util {
                                     eox::globals::THREAD_POOL_CORES_MAX);
         log->debug("start, requested: {}, given: {}", size, n_cores);
         shutdown();
+
+        workers.reserve(n_cores);
+        for (int i = 0; i < n_cores; ++i) {
+            workers.push_back(std::unique_ptr<worker_state>(new worker_state{
+                    .deque = WorkDeque<task *>(DEQUE_CAPACITY),
+                    .flag = {},
+                    .woken = false
+            }));
+        }
+
+        // containers touched on every submission/park are allocated up front
         {
             std::lock_guard<std::mutex> lock(mutex);
-            for (int i = 0; i < n_cores; ++i) {
-                threads.emplace(&ThreadPool::worker, this);
-            }
-            stop = false;
-            flag.notify_all();
+            if (injected.size() < INJECTED_CAPACITY)
+                injected.assign(INJECTED_CAPACITY, nullptr);
         }
+        idle.reserve(n_cores);
+
+        stop = false;
+        threads.reserve(n_cores);
+        for (int i = 0; i < n_cores; ++i) {
+            threads.emplace_back(&ThreadPool::worker, this, i);
+        }
+
         log->debug("started");
     }
 
+    TaskGroup::TaskGroup(ThreadPool &_pool) : pool(_pool) {
+    }
 
-    std::future<void> ThreadPool::execute(std::function<void()> func) {
-        auto le_promise = std::make_shared<std::promise<void>>();
-        auto le_future = le_promise->get_future();
+    TaskGroup::~TaskGroup() {
+        join();
+    }
 
-        auto lambda = [p = le_promise, func = std::move(func), this]() mutable {
-            try {
-                func();
-                p->set_value();
-            } catch (...) {
-                p->set_exception(std::current_exception());
-            }
-            this->trigger();
-        };
+    void TaskGroup::finish() {
+        finishing.fetch_add(1, std::memory_order_acq_rel);
+        pending.fetch_sub(1, std::memory_order_acq_rel);
+        // waiter re-checks for tasks to help with on every completion
+        pending.notify_all();
+        // last access to the group, waiter may destroy it right after
+        finishing.fetch_sub(1, std::memory_order_release);
+    }
 
-        {
-            std::lock_guard<std::mutex> lock(mutex);
-            tasks.emplace(std::move(lambda));
-            flag.notify_all();
+    void TaskGroup::join() {
+        for (;;) {
+            const auto n = pending.load(std::memory_order_acquire);
+            if (n == 0)
+                break;
+            if (pool.help())
+                continue;
+            pending.wait(n, std::memory_order_acquire);
         }
 
-        return le_future;
+        // pending is zero, but the last tasks may still be notifying, window is a few instructions long
+        while (finishing.load(std::memory_order_acquire) != 0)
+            std::this_thread::yield();
+    }
+
+    void TaskGroup::wait() {
+        join();
+        if (failed.exchange(false, std::memory_order_relaxed)) {
+            auto e = error;
+            error = nullptr;
+            std::rethrow_exception(e);
+        }
     }
 
-}
\ No newline at end of file
+}
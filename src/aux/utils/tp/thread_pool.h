@@ -7,15 +7,32 @@
 
 
 #include <mutex>
-#include <queue>
+#include <vector>
+#include <memory>
 #include <thread>
+#include <cstdint>
+#include <algorithm>
 #include <functional>
-#include <future>
+#include <condition_variable>
 #include <spdlog/logger.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 
+#include "work_deque.h"
+#include "task.h"
+
 namespace eox::util {
 
+    class TaskGroup;
+
+    /**
+     * @class ThreadPool
+     * @brief Work-stealing thread pool.
+     *
+     * Every worker owns Chase-Lev deque, tasks submitted from the worker itself go to its own deque,
+     * tasks submitted from outside go to the shared injection queue.
+     * Idle worker takes tasks from own deque first, then from injection queue, then steals from other workers.
+     * Submission wakes up at most one sleeping worker, completion of the task wakes up nobody.
+     */
     class ThreadPool {
     public:
 
@@ -27,30 +44,44 @@ namespace eox::util {
 
         void shutdown();
 
-        template<typename T>
-        std::future<T> execute(std::function<T()> func) {
-            auto le_promise = std::make_shared<std::promise<T>>();
-            auto le_future = le_promise->get_future();
+        /**
+         * @brief Submits the task, allocation free as long as callable fits into TaskState inline storage.
+         * @tparam T result type of the task
+         * @return future of the task result
+         */
+        template<typename T = void, typename F>
+        Future<T> execute(F &&func) {
+            auto state = TaskState<T>::create(std::forward<F>(func));
+            submit(state);
+            return Future<T>(state);
+        }
 
-            auto lambda = [p = le_promise, func = std::move(func), this]() mutable {
-                try {
-                    p->set_value(func());
-                } catch (...) {
-                    p->set_exception(std::current_exception());
-                }
-                this->trigger();
-            };
+        /**
+         * @brief Runs body(i) for every i in [begin, end), calling thread takes part in the work.
+         * Range is split into chunks of the grain size, handed out dynamically, so uneven chunks balance out.
+         * Exception thrown by the body is rethrown (after all chunks are done).
+         * @param grain number of consecutive indexes processed by single task
+         */
+        template<typename F>
+        void parallel_for(size_t begin, size_t end, F &&body, size_t grain = 1);
 
-            {
-                std::lock_guard<std::mutex> lock(mutex);
-                tasks.emplace(std::move(lambda));
-                flag.notify_all();
-            }
+        /**
+         * @brief Runs all functions in parallel and waits for all of them,
+         * first one is executed by calling thread.
+         */
+        template<typename F, typename... R>
+        void parallel_invoke(F &&first, R &&... rest);
 
-            return le_future;
-        }
+        /**
+         * @brief Executes single pending task on the calling thread (used by waiting threads to help out).
+         * @return false if there was nothing to execute
+         */
+        bool help();
 
-        std::future<void> execute(std::function<void()> func);
+        /**
+         * @return number of worker threads
+         */
+        [[nodiscard]] size_t size() const;
 
         void start(size_t size);
 
@@ -58,18 +89,176 @@ namespace eox::util {
         static inline const auto log =
                 spdlog::stdout_color_mt("thread_pool");
 
-        std::queue<std::function<void()>> tasks;
-        std::queue<std::thread> threads;
-        std::condition_variable flag;
+        static inline const size_t DEQUE_CAPACITY = 1024;
+        static inline const size_t SPIN_ROUNDS = 64;
+        static inline const size_t INJECTED_CAPACITY = 256;
+
+        // index of thread which is not a worker of this pool
+        static inline const size_t EXTERNAL = SIZE_MAX;
+
+        using task = TaskBase;
+
+        using worker_state = struct {
+            WorkDeque<task *> deque;
+            std::condition_variable flag;
+            bool woken;
+        };
+
+        // pool and index of the worker running on current thread (if any)
+        static inline thread_local ThreadPool *current = nullptr;
+        static inline thread_local size_t current_index = 0;
+
+        std::vector<std::unique_ptr<worker_state>> workers;
+        std::vector<std::thread> threads;
+
+        // injection queue, ring buffer growing on demand (so steady state never allocates)
+        std::vector<task *> injected;
+        size_t injected_head = 0;
+        std::atomic<size_t> injected_size = 0;
         std::mutex mutex;
 
+        // indexes of sleeping workers
+        std::vector<size_t> idle;
+        std::atomic<size_t> sleeping = 0;
+        std::mutex idle_mutex;
+
         std::atomic<bool> stop = true;
 
-        void worker();
+        void worker(size_t index);
+
+        void submit(task *t);
+
+        /**
+         * Appends task to the injection queue, must be called under the lock
+         */
+        void inject(task *t);
+
+        /**
+         * Takes the oldest task from the injection queue, must be called under the lock
+         */
+        task *take_injected();
 
-        void trigger();
+        /**
+         * @return next task for the worker: own deque, injection queue, stolen (in that order),
+         * external thread (EXTERNAL index) only takes from injection queue or steals
+         */
+        task *next(size_t index);
+
+        /**
+         * @return true if there is any task waiting to be executed
+         */
+        bool pending() const;
+
+        /**
+         * Parks the worker until it's woken up by submission (or shutdown)
+         */
+        void park(size_t index);
+
+        /**
+         * Wakes up single sleeping worker (if any)
+         */
+        void wake();
     };
 
+    /**
+     * @class TaskGroup
+     * @brief Set of tasks submitted to eox::util::ThreadPool and waited for all at once (fork-join).
+     *
+     * Waiting thread does not block while there are tasks it can execute,
+     * so waiting inside of the pool's task is fine too. Group waits for its tasks on destruction.
+     */
+    class TaskGroup {
+    private:
+        ThreadPool &pool;
+        std::atomic<uint32_t> pending = 0;
+
+        // tasks inside of finish(), group must outlive them (it usually lives on the waiter's stack)
+        std::atomic<uint32_t> finishing = 0;
+
+        std::atomic<bool> failed = false;
+        std::exception_ptr error;
+
+        void finish();
+
+        void join();
+
+    public:
+        explicit TaskGroup(ThreadPool &pool);
+
+        TaskGroup(const TaskGroup &other) = delete;
+
+        TaskGroup &operator=(const TaskGroup &other) = delete;
+
+        ~TaskGroup();
+
+        /**
+         * Submits the task, function object is stored in the task (no allocation if it's small enough)
+         */
+        template<typename F>
+        void run(F &&func) {
+            pending.fetch_add(1, std::memory_order_relaxed);
+            pool.execute([this, f = std::forward<F>(func)]() mutable {
+                try {
+                    f();
+                } catch (...) {
+                    // first exception wins
+                    if (!failed.exchange(true, std::memory_order_relaxed))
+                        error = std::current_exception();
+                }
+                finish();
+            });
+        }
+
+        /**
+         * @brief Waits for all submitted tasks, executing pending tasks of the pool meanwhile.
+         * Rethrows first exception thrown by any task of the group.
+         */
+        void wait();
+    };
+
+    template<typename F>
+    void ThreadPool::parallel_for(size_t begin, size_t end, F &&body, size_t grain) {
+        if (begin >= end)
+            return;
+
+        grain = std::max<size_t>(grain, 1);
+        const size_t chunks = (end - begin + grain - 1) / grain;
+        if (chunks == 1 || workers.empty()) {
+            for (size_t i = begin; i < end; i++)
+                body(i);
+            return;
+        }
+
+        std::atomic<size_t> next = begin;
+        auto work = [&next, &body, end, grain]() {
+            for (;;) {
+                const size_t from = next.fetch_add(grain, std::memory_order_relaxed);
+                if (from >= end)
+                    return;
+                const size_t to = std::min(end, from + grain);
+                for (size_t i = from; i < to; i++)
+                    body(i);
+            }
+        };
+
+        // group is destroyed (so it waits) before anything it refers to
+        TaskGroup group(*this);
+        const size_t helpers = std::min(chunks - 1, workers.size());
+        for (size_t k = 0; k < helpers; k++)
+            group.run(std::ref(work));
+
+        work();
+        group.wait();
+    }
+
+    template<typename F, typename... R>
+    void ThreadPool::parallel_invoke(F &&first, R &&... rest) {
+        TaskGroup group(*this);
+        (group.run(std::ref(rest)), ...);
+        first();
+        group.wait();
+    }
+
 }
 
 #endif //STEREOX_THREAD_POOL_H
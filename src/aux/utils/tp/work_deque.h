@@ -0,0 +1,118 @@
+//
+// Created by henryco on 2/15/24.
+//
+
+#ifndef STEREOX_WORK_DEQUE_H
+#define STEREOX_WORK_DEQUE_H
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+namespace eox::util {
+
+    /**
+     * @class WorkDeque
+     * @brief Fixed capacity Chase-Lev work-stealing deque of pointers.
+     *
+     * Owner thread pushes and pops at the bottom (LIFO, cache friendly),
+     * any other thread steals from the top (FIFO). Only steal() might be called concurrently.
+     *
+     * @see "Correct and Efficient Work-Stealing for Weak Memory Models", N. M. Lê et al.
+     */
+    template<typename T>
+    class WorkDeque {
+        static_assert(std::is_pointer_v<T>, "WorkDeque stores pointers only");
+
+    private:
+        alignas(64) std::atomic<int64_t> top = 0;
+        alignas(64) std::atomic<int64_t> bottom = 0;
+        std::vector<std::atomic<T>> buffer;
+        int64_t mask;
+
+    public:
+
+        /**
+         * @param capacity maximum number of items, rounded up to power of two
+         */
+        explicit WorkDeque(size_t capacity) {
+            size_t size = 1;
+            while (size < capacity)
+                size <<= 1;
+            buffer = std::vector<std::atomic<T>>(size);
+            mask = (int64_t) size - 1;
+        }
+
+        WorkDeque(const WorkDeque &other) = delete;
+
+        WorkDeque &operator=(const WorkDeque &other) = delete;
+
+        /**
+         * @brief Owner only.
+         * @return false if deque is full
+         */
+        bool push(T item) {
+            const int64_t b = bottom.load(std::memory_order_relaxed);
+            const int64_t t = top.load(std::memory_order_acquire);
+            if (b - t > mask)
+                return false;
+
+            buffer[b & mask].store(item, std::memory_order_relaxed);
+
+            // publish item to thieves
+            bottom.store(b + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * @brief Owner only, takes the most recently pushed item.
+         * @return nullptr if deque is empty
+         */
+        T pop() {
+            const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+
+            if (t > b) {
+                // empty
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            T item = buffer[b & mask].load(std::memory_order_relaxed);
+            if (t == b) {
+                // last item, race against thieves
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    item = nullptr;
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return item;
+        }
+
+        /**
+         * @brief Any thread, takes the oldest item.
+         * @return nullptr if deque is empty or item was taken by someone else
+         */
+        T steal() {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const int64_t b = bottom.load(std::memory_order_acquire);
+
+            if (t >= b)
+                return nullptr;
+
+            T item = buffer[t & mask].load(std::memory_order_relaxed);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return nullptr;
+            return item;
+        }
+
+        [[nodiscard]] bool empty() const {
+            return bottom.load(std::memory_order_seq_cst) <= top.load(std::memory_order_seq_cst);
+        }
+    };
+
+} // eox
+
+#endif //STEREOX_WORK_DEQUE_H
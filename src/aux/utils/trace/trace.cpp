@@ -0,0 +1,211 @@
+//
+// Created by henryco on 2/19/24.
+//
+
+#include "trace.h"
+
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <stdexcept>
+#include <condition_variable>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <spdlog/logger.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+namespace eox::util {
+
+    namespace {
+        const auto log = spdlog::stdout_color_mt("trace");
+
+        constexpr size_t RING_CAPACITY = 1 << 14;
+        constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(100);
+
+        typedef struct {
+            const char *name;
+            uint64_t begin;
+            uint64_t end;
+        } span_event;
+
+        /**
+         * Single producer (owner thread) / single consumer (collector) ring of spans
+         */
+        struct span_ring {
+            span_event events[RING_CAPACITY];
+            std::atomic<uint64_t> head = 0;
+            std::atomic<uint64_t> tail = 0;
+            std::atomic<uint64_t> dropped = 0;
+            pid_t tid = 0;
+            std::string name;
+            bool announced = false;
+        };
+
+        std::mutex registry_mutex;
+        std::vector<std::shared_ptr<span_ring>> registry;
+
+        std::mutex collector_mutex;
+        std::condition_variable collector_flag;
+        std::thread collector;
+        bool collecting = false;
+
+        FILE *file = nullptr;
+        bool first_event = true;
+        uint64_t origin = 0;
+
+        // ring of the thread stays registered after the thread is gone, until it is drained
+        thread_local std::shared_ptr<span_ring> local_ring;
+
+        span_ring &ring() {
+            if (local_ring)
+                return *local_ring;
+
+            local_ring = std::make_shared<span_ring>();
+            local_ring->tid = (pid_t) syscall(SYS_gettid);
+
+            char name[16] = {};
+            pthread_getname_np(pthread_self(), name, sizeof(name));
+            local_ring->name = name;
+
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            registry.push_back(local_ring);
+            return *local_ring;
+        }
+
+        void write_escaped(const char *str) {
+            for (const char *c = str; *c; c++) {
+                if (*c == '"' || *c == '\\')
+                    std::fputc('\\', file);
+                if ((unsigned char) *c >= 0x20)
+                    std::fputc(*c, file);
+            }
+        }
+
+        void write_separator() {
+            if (!first_event)
+                std::fputs(",\n", file);
+            first_event = false;
+        }
+
+        void drain(span_ring &r) {
+            if (!r.announced) {
+                write_separator();
+                std::fprintf(file, R"({"name":"thread_name","ph":"M","pid":%d,"tid":%d,"args":{"name":")",
+                             getpid(), r.tid);
+                write_escaped(r.name.empty() ? "thread" : r.name.c_str());
+                std::fputs("\"}}", file);
+                r.announced = true;
+            }
+
+            const auto tail = r.tail.load(std::memory_order_relaxed);
+            const auto head = r.head.load(std::memory_order_acquire);
+            for (auto i = tail; i < head; i++) {
+                const auto &e = r.events[i % RING_CAPACITY];
+                if (e.begin < origin)
+                    continue;
+
+                write_separator();
+                std::fprintf(file, R"({"name":")");
+                write_escaped(e.name);
+                std::fprintf(file, R"(","ph":"X","pid":%d,"tid":%d,"ts":%.3f,"dur":%.3f})",
+                             getpid(),
+                             r.tid,
+                             (double) (e.begin - origin) / 1000.,
+                             (double) (e.end - e.begin) / 1000.);
+            }
+            r.tail.store(head, std::memory_order_release);
+        }
+
+        void drain_all() {
+            std::vector<std::shared_ptr<span_ring>> rings;
+            {
+                std::lock_guard<std::mutex> lock(registry_mutex);
+                // rings of finished threads are released once drained
+                std::erase_if(registry, [](const auto &r) {
+                    return r.use_count() == 1 && r->tail == r->head;
+                });
+                rings = registry;
+            }
+
+            for (const auto &r: rings)
+                drain(*r);
+            std::fflush(file);
+        }
+
+        void collector_worker() {
+            std::unique_lock<std::mutex> lock(collector_mutex);
+            while (collecting) {
+                collector_flag.wait_for(lock, FLUSH_INTERVAL, []() { return !collecting; });
+                drain_all();
+            }
+        }
+    }
+
+    namespace trace_detail {
+        void record(const char *name, uint64_t begin, uint64_t end) {
+            auto &r = ring();
+            const auto head = r.head.load(std::memory_order_relaxed);
+            if (head - r.tail.load(std::memory_order_acquire) >= RING_CAPACITY) {
+                // collector is behind, never block the traced thread
+                r.dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            r.events[head % RING_CAPACITY] = {.name = name, .begin = begin, .end = end};
+            r.head.store(head + 1, std::memory_order_release);
+        }
+    }
+
+    void trace_start(const std::string &path) {
+        std::lock_guard<std::mutex> lock(collector_mutex);
+        if (collecting)
+            return;
+
+        file = std::fopen(path.c_str(), "w");
+        if (!file) {
+            log->error("cannot open trace file: {}", path);
+            throw std::runtime_error("cannot open trace file: " + path);
+        }
+
+        std::fputs("{\"traceEvents\":[\n", file);
+        first_event = true;
+        origin = trace_detail::now();
+        collecting = true;
+        collector = std::thread(collector_worker);
+        trace_detail::enabled.store(true, std::memory_order_relaxed);
+
+        log->info("tracing into: {}", path);
+    }
+
+    void trace_stop() {
+        {
+            std::lock_guard<std::mutex> lock(collector_mutex);
+            if (!collecting)
+                return;
+            trace_detail::enabled.store(false, std::memory_order_relaxed);
+            collecting = false;
+        }
+        collector_flag.notify_all();
+        collector.join();
+
+        uint64_t dropped = 0;
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            for (const auto &r: registry)
+                dropped += r->dropped.exchange(0);
+        }
+
+        std::fputs("\n],\"displayTimeUnit\":\"ms\"}\n", file);
+        std::fclose(file);
+        file = nullptr;
+
+        if (dropped > 0)
+            log->warn("trace stopped, spans dropped: {}", dropped);
+        else
+            log->info("trace stopped");
+    }
+
+} // eox
@@ -0,0 +1,87 @@
+//
+// Created by henryco on 2/19/24.
+//
+
+#ifndef STEREOX_TRACE_H
+#define STEREOX_TRACE_H
+
+#include <ctime>
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+namespace eox::util {
+
+    namespace trace_detail {
+        inline std::atomic<bool> enabled = false;
+
+        inline uint64_t now() {
+            timespec ts{};
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return (uint64_t) ts.tv_sec * 1'000'000'000ull + (uint64_t) ts.tv_nsec;
+        }
+
+        /**
+         * Appends complete span to the ring buffer of the calling thread (dropped if ring is full)
+         */
+        void record(const char *name, uint64_t begin, uint64_t end);
+    }
+
+    /**
+     * @brief Starts collecting spans into Chrome trace-event JSON file
+     * (chrome://tracing, ui.perfetto.dev).
+     * Every thread writes its spans into its own lock-free ring buffer,
+     * rings are drained into the file by the collector thread.
+     */
+    void trace_start(const std::string &path);
+
+    /**
+     * @brief Stops collecting, flushes remaining spans and closes the file
+     */
+    void trace_stop();
+
+    [[nodiscard]] inline bool trace_enabled() {
+        return trace_detail::enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @class TraceSpan
+     * @brief Records the lifetime of the scope as a single span.
+     * Use EOX_TRACE_SPAN macro instead, so spans are gone once tracing is compiled out.
+     */
+    class TraceSpan {
+    private:
+        const char *name;
+        uint64_t begin = 0;
+
+    public:
+        /**
+         * @param _name static string (string literal), it is read long after the span is gone
+         */
+        explicit TraceSpan(const char *_name) : name(_name) {
+            if (trace_enabled())
+                begin = trace_detail::now();
+        }
+
+        TraceSpan(const TraceSpan &other) = delete;
+
+        TraceSpan &operator=(const TraceSpan &other) = delete;
+
+        ~TraceSpan() {
+            if (begin != 0)
+                trace_detail::record(name, begin, trace_detail::now());
+        }
+    };
+
+} // eox
+
+#define EOX_TRACE_CONCAT_INNER(a, b) a##b
+#define EOX_TRACE_CONCAT(a, b) EOX_TRACE_CONCAT_INNER(a, b)
+
+#ifdef STEREOX_TRACE
+#define EOX_TRACE_SPAN(name) const eox::util::TraceSpan EOX_TRACE_CONCAT(_eox_trace_span_, __LINE__)(name)
+#else
+#define EOX_TRACE_SPAN(name) ((void) 0)
+#endif
+
+#endif //STEREOX_TRACE_H
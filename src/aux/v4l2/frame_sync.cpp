@@ -0,0 +1,122 @@
+//
+// Created by henryco on 2/5/24.
+//
+
+#include "frame_sync.h"
+#include "../utils/metrics/metrics.h"
+
+#include <algorithm>
+
+namespace eox::v4l2 {
+
+    FrameSync::FrameSync(size_t devices, std::chrono::nanoseconds tolerance, size_t depth)
+            : queues(devices),
+              tolerance(tolerance),
+              depth(std::max(depth, (size_t) 1)) {
+    }
+
+    void FrameSync::reset(size_t devices) {
+        queues.clear();
+        queues.resize(devices);
+        skew = std::chrono::nanoseconds(0);
+        dropped = 0;
+    }
+
+    void FrameSync::drop(size_t device) {
+        static auto &drops = eox::util::metrics_counter(
+                "eox_frame_sync_dropped_total", "Frames dropped without being matched into a tuple");
+
+        auto &queue = queues[device];
+        const auto frame = queue.front();
+        queue.pop_front();
+        dropped++;
+        drops.add();
+        dropCallback(device, frame);
+    }
+
+    void FrameSync::push(size_t device, const V4L2_Frame &frame) {
+        auto &queue = queues.at(device);
+        while (queue.size() >= depth) {
+            drop(device);
+        }
+        queue.push_back(frame);
+    }
+
+    bool FrameSync::match(std::vector<V4L2_Frame> &tuple) {
+        static auto &skews = eox::util::metrics_histogram(
+                "eox_frame_skew_seconds", "Difference between the oldest and the newest frame of matched tuple");
+
+        if (queues.empty())
+            return false;
+
+        while (true) {
+            // newest head of all the queues
+            auto newest = std::chrono::nanoseconds::min();
+            for (const auto &queue: queues) {
+                if (queue.empty())
+                    return false;
+                newest = std::max(newest, queue.front().timestamp);
+            }
+
+            // heads older than (newest - tolerance) can not be matched with anything anymore
+            bool changed = false;
+            for (size_t i = 0; i < queues.size(); i++) {
+                auto &queue = queues[i];
+                while (!queue.empty() && queue.front().timestamp < newest - tolerance) {
+                    drop(i);
+                    changed = true;
+                }
+            }
+
+            if (!changed)
+                break;
+        }
+
+        auto oldest = std::chrono::nanoseconds::max();
+        auto newest = std::chrono::nanoseconds::min();
+
+        tuple.clear();
+        tuple.reserve(queues.size());
+        for (auto &queue: queues) {
+            const auto &frame = queue.front();
+            oldest = std::min(oldest, frame.timestamp);
+            newest = std::max(newest, frame.timestamp);
+            tuple.push_back(frame);
+            queue.pop_front();
+        }
+
+        skew = newest - oldest;
+        skews.record(skew.count());
+        return true;
+    }
+
+    std::vector<size_t> FrameSync::missing() const {
+        std::vector<size_t> indexes;
+        for (size_t i = 0; i < queues.size(); i++) {
+            if (queues[i].empty())
+                indexes.push_back(i);
+        }
+        return indexes;
+    }
+
+    void FrameSync::onDrop(std::function<void(size_t, const V4L2_Frame &)> callback) {
+        dropCallback = std::move(callback);
+    }
+
+    void FrameSync::setTolerance(std::chrono::nanoseconds _tolerance) {
+        tolerance = _tolerance;
+    }
+
+    std::chrono::nanoseconds FrameSync::getTolerance() const {
+        return tolerance;
+    }
+
+    std::chrono::nanoseconds FrameSync::getSkew() const {
+        return skew;
+    }
+
+    size_t FrameSync::getDropped() const {
+        return dropped;
+    }
+
+} // eox
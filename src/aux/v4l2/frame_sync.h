@@ -0,0 +1,96 @@
+//
+// Created by henryco on 2/5/24.
+//
+
+#ifndef STEREOX_FRAME_SYNC_H
+#define STEREOX_FRAME_SYNC_H
+
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <functional>
+
+#include "linux_stream.h"
+
+namespace eox::v4l2 {
+
+    /**
+     * @class FrameSync
+     * @brief Pairs frames of multiple devices using kernel capture timestamps.
+     *
+     * Every device has its own small queue of dequeued (not yet decoded) frames.
+     * A tuple is emitted once the oldest frame of every queue fits within the skew tolerance.
+     * Frames which can not be matched anymore (older than the newest head minus tolerance)
+     * are dropped instead of waiting for them, dropped frames are passed to the drop callback
+     * so the kernel buffer can be given back to the driver.
+     * Skew of every matched tuple and dropped frames are exported as metrics
+     * (eox_frame_skew_seconds, eox_frame_sync_dropped_total).
+     */
+    class FrameSync {
+    private:
+        std::vector<std::deque<V4L2_Frame>> queues;
+        std::function<void(size_t, const V4L2_Frame &)> dropCallback = [](size_t, const V4L2_Frame &) {};
+        std::chrono::nanoseconds tolerance;
+        std::chrono::nanoseconds skew{0};
+        size_t depth;
+        size_t dropped = 0;
+
+        void drop(size_t device);
+
+    public:
+
+        /**
+         * @param devices number of devices to synchronize
+         * @param tolerance maximum allowed difference between timestamps of frames in one tuple
+         * @param depth maximum number of frames waiting in each device queue
+         */
+        explicit FrameSync(size_t devices = 0,
+                           std::chrono::nanoseconds tolerance = std::chrono::milliseconds(5),
+                           size_t depth = 2);
+
+        /**
+         * Clears all queues (without calling drop callback) and sets new number of devices
+         */
+        void reset(size_t devices);
+
+        /**
+         * Puts frame into device queue, if queue is full the oldest frame is dropped
+         */
+        void push(size_t device, const V4L2_Frame &frame);
+
+        /**
+         * @brief Tries to compose synchronized tuple out of queued frames.
+         *
+         * @param tuple output frames, one per device (in order of devices)
+         * @return true if tuple is matched, false if more frames are required (see missing())
+         */
+        bool match(std::vector<V4L2_Frame> &tuple);
+
+        /**
+         * @return indexes of devices with empty queues, those require more frames to match
+         */
+        [[nodiscard]] std::vector<size_t> missing() const;
+
+        /**
+         * Callback is called for every frame removed from queue without being matched
+         */
+        void onDrop(std::function<void(size_t, const V4L2_Frame &)> callback);
+
+        void setTolerance(std::chrono::nanoseconds tolerance);
+
+        [[nodiscard]] std::chrono::nanoseconds getTolerance() const;
+
+        /**
+         * @return difference between the oldest and the newest frame of the last matched tuple
+         */
+        [[nodiscard]] std::chrono::nanoseconds getSkew() const;
+
+        /**
+         * @return total number of dropped frames
+         */
+        [[nodiscard]] size_t getDropped() const;
+    };
+
+} // eox
+
+#endif //STEREOX_FRAME_SYNC_H
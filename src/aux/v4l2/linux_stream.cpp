@@ -0,0 +1,256 @@
+//
+// Created by henryco on 2/3/24.
+//
+
+#include "linux_stream.h"
+#include "linux_video.h"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+
+namespace eox::v4l2 {
+
+    LinuxStream::~LinuxStream() {
+        release();
+    }
+
+    void LinuxStream::open(uint device_id, uint width, uint height, uint fps, uint32_t fourcc, uint n_buffers) {
+        release();
+
+        device = device_id;
+        const std::string name = "/dev/video" + std::to_string(device_id);
+
+        log->debug("open [{}]", name);
+
+        fd = ::open(name.c_str(), O_RDWR | O_NONBLOCK);
+        if (fd == -1) {
+            log->error("Cannot open video device: {}", name);
+            throw std::runtime_error("Cannot open video device: " + name);
+        }
+
+        try {
+
+            {
+                v4l2_capability capability{};
+                if (xioctl(fd, VIDIOC_QUERYCAP, &capability) == -1) {
+                    log->error("Cannot query device capabilities: {}", name);
+                    throw std::runtime_error("Cannot query device capabilities: " + name);
+                }
+
+                const auto caps = (capability.capabilities & V4L2_CAP_DEVICE_CAPS)
+                                  ? capability.device_caps
+                                  : capability.capabilities;
+
+                if (!(caps & V4L2_CAP_VIDEO_CAPTURE) || !(caps & V4L2_CAP_STREAMING)) {
+                    log->error("Device does not support streaming capture: {}", name);
+                    throw std::runtime_error("Device does not support streaming capture: " + name);
+                }
+            }
+
+            {
+                v4l2_format fmt{};
+                fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                fmt.fmt.pix.width = width;
+                fmt.fmt.pix.height = height;
+                fmt.fmt.pix.pixelformat = fourcc;
+                fmt.fmt.pix.field = V4L2_FIELD_ANY;
+
+                if (xioctl(fd, VIDIOC_S_FMT, &fmt) == -1) {
+                    log->error("Cannot set video format: {}", name);
+                    throw std::runtime_error("Cannot set video format: " + name);
+                }
+
+                format = fmt.fmt.pix;
+
+                if (format.pixelformat != fourcc)
+                    log->warn("[{}] requested pixel format is not supported, driver selected another one", name);
+                if (format.width != width || format.height != height)
+                    log->warn("[{}] requested {}x{}, got {}x{}", name, width, height, format.width, format.height);
+            }
+
+            if (fps > 0) {
+                v4l2_streamparm param{};
+                param.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                param.parm.capture.timeperframe.numerator = 1;
+                param.parm.capture.timeperframe.denominator = fps;
+                if (xioctl(fd, VIDIOC_S_PARM, &param) == -1)
+                    log->warn("[{}] cannot set frame rate: {}", name, fps);
+            }
+
+            {
+                v4l2_requestbuffers request{};
+                request.count = n_buffers;
+                request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                request.memory = V4L2_MEMORY_MMAP;
+
+                if (xioctl(fd, VIDIOC_REQBUFS, &request) == -1 || request.count < 2) {
+                    log->error("Device does not support memory mapping: {}", name);
+                    throw std::runtime_error("Device does not support memory mapping: " + name);
+                }
+
+                log->debug("[{}] requested buffers: {}, given: {}", name, n_buffers, request.count);
+
+                buffers.reserve(request.count);
+                for (uint i = 0; i < request.count; i++) {
+                    v4l2_buffer buffer{};
+                    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                    buffer.memory = V4L2_MEMORY_MMAP;
+                    buffer.index = i;
+
+                    if (xioctl(fd, VIDIOC_QUERYBUF, &buffer) == -1) {
+                        log->error("Cannot query buffer: {} [{}]", i, name);
+                        throw std::runtime_error("Cannot query buffer: " + name);
+                    }
+
+                    void *start = mmap(nullptr, buffer.length, PROT_READ | PROT_WRITE,
+                                       MAP_SHARED, fd, buffer.m.offset);
+                    if (start == MAP_FAILED) {
+                        log->error("Cannot map buffer: {} [{}]", i, name);
+                        throw std::runtime_error("Cannot map buffer: " + name);
+                    }
+
+                    buffers.push_back({.start = start, .length = buffer.length});
+                }
+            }
+
+            for (uint i = 0; i < buffers.size(); i++) {
+                v4l2_buffer buffer{};
+                buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                buffer.memory = V4L2_MEMORY_MMAP;
+                buffer.index = i;
+                if (xioctl(fd, VIDIOC_QBUF, &buffer) == -1) {
+                    log->error("Cannot queue buffer: {} [{}]", i, name);
+                    throw std::runtime_error("Cannot queue buffer: " + name);
+                }
+            }
+
+            v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            if (xioctl(fd, VIDIOC_STREAMON, &type) == -1) {
+                log->error("Cannot start streaming: {}", name);
+                throw std::runtime_error("Cannot start streaming: " + name);
+            }
+            streaming = true;
+
+        } catch (...) {
+            release();
+            throw;
+        }
+
+        log->debug("opened [{}] {}x{}", name, format.width, format.height);
+    }
+
+    bool LinuxStream::read(V4L2_Frame &frame, int timeout_ms) {
+        if (fd == -1 || !streaming)
+            return false;
+
+        v4l2_buffer buffer{};
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+
+        while (xioctl(fd, VIDIOC_DQBUF, &buffer) == -1) {
+            if (errno != EAGAIN) {
+                log->warn("[{}] cannot dequeue buffer: {}", device, std::strerror(errno));
+                return false;
+            }
+
+            // nothing is ready yet, wait for the driver
+            pollfd p = {.fd = fd, .events = POLLIN, .revents = 0};
+            const int r = poll(&p, 1, timeout_ms);
+            if (r == -1 && errno == EINTR)
+                continue;
+            if (r <= 0) {
+                log->warn("[{}] frame timeout", device);
+                return false;
+            }
+        }
+
+        frame = {
+                .index = buffer.index,
+                .data = buffers[buffer.index].start,
+                .bytes = buffer.bytesused,
+                .stride = format.bytesperline,
+                .sequence = buffer.sequence,
+                .timestamp = std::chrono::seconds(buffer.timestamp.tv_sec)
+                             + std::chrono::microseconds(buffer.timestamp.tv_usec),
+                .width = format.width,
+                .height = format.height,
+                .fourcc = format.pixelformat
+        };
+
+        return true;
+    }
+
+    bool LinuxStream::requeue(const V4L2_Frame &frame) {
+        if (fd == -1 || !streaming)
+            return false;
+
+        v4l2_buffer buffer{};
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.index = frame.index;
+
+        if (xioctl(fd, VIDIOC_QBUF, &buffer) == -1) {
+            log->warn("[{}] cannot queue buffer: {}", device, frame.index);
+            return false;
+        }
+        return true;
+    }
+
+    void LinuxStream::release() {
+        if (fd == -1)
+            return;
+
+        log->debug("release [{}]", device);
+
+        if (streaming) {
+            v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            if (xioctl(fd, VIDIOC_STREAMOFF, &type) == -1)
+                log->warn("[{}] cannot stop streaming", device);
+            streaming = false;
+        }
+
+        for (const auto &buffer: buffers) {
+            munmap(buffer.start, buffer.length);
+        }
+        buffers.clear();
+
+        {
+            // free kernel buffers
+            v4l2_requestbuffers request{};
+            request.count = 0;
+            request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            request.memory = V4L2_MEMORY_MMAP;
+            xioctl(fd, VIDIOC_REQBUFS, &request);
+        }
+
+        ::close(fd);
+        fd = -1;
+    }
+
+    bool LinuxStream::isOpened() const {
+        return fd != -1 && streaming;
+    }
+
+    uint LinuxStream::getWidth() const {
+        return format.width;
+    }
+
+    uint LinuxStream::getHeight() const {
+        return format.height;
+    }
+
+    uint32_t LinuxStream::getFourcc() const {
+        return format.pixelformat;
+    }
+
+    size_t LinuxStream::getBuffersCount() const {
+        return buffers.size();
+    }
+
+} // eox
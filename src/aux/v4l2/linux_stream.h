@@ -0,0 +1,136 @@
+//
+// Created by henryco on 2/3/24.
+//
+
+#ifndef STEREOX_LINUX_STREAM_H
+#define STEREOX_LINUX_STREAM_H
+
+#include <linux/videodev2.h>
+#include <chrono>
+#include <vector>
+#include <spdlog/logger.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+namespace eox::v4l2 {
+
+    typedef struct {
+        /**
+         * index of kernel buffer, required to give the buffer back (VIDIOC_QBUF)
+         */
+        uint index;
+
+        /**
+         * pointer to mmap'ed kernel buffer, valid until buffer is re-queued
+         */
+        void *data;
+
+        /**
+         * number of bytes actually occupied by the frame (important for compressed formats)
+         */
+        size_t bytes;
+
+        /**
+         * number of bytes per line (row stride), meaningful only for uncompressed formats
+         */
+        uint stride;
+
+        /**
+         * frame sequence number assigned by the driver
+         */
+        uint32_t sequence;
+
+        /**
+         * kernel capture timestamp (usually CLOCK_MONOTONIC)
+         */
+        std::chrono::nanoseconds timestamp;
+
+        uint width;
+        uint height;
+        uint32_t fourcc;
+    } v4l2_frame;
+
+    typedef v4l2_frame V4L2_Frame;
+
+    /**
+     * @class LinuxStream
+     * @brief Native V4L2 streaming capture using memory mapped kernel buffers.
+     *
+     * Frames are handed out as pointers to mmap'ed driver buffers (no copy involved).
+     * Every frame obtained with read() has to be given back to the driver with requeue(),
+     * otherwise the device will eventually run out of buffers and stall.
+     */
+    class LinuxStream {
+        static inline const auto log =
+                spdlog::stdout_color_mt("linux_stream");
+
+    private:
+        using mapped_buffer = struct {
+            void *start;
+            size_t length;
+        };
+
+        std::vector<mapped_buffer> buffers;
+        v4l2_pix_format format{};
+        bool streaming = false;
+        uint device = 0;
+        int fd = -1;
+
+    public:
+        LinuxStream() = default;
+
+        LinuxStream(const LinuxStream &other) = delete;
+
+        LinuxStream &operator=(const LinuxStream &other) = delete;
+
+        ~LinuxStream();
+
+        /**
+         * @brief Opens device, negotiates format, maps kernel buffers and starts streaming.
+         *
+         * @param device_id index of the device (/dev/video{device_id})
+         * @param width requested frame width
+         * @param height requested frame height
+         * @param fps requested frame rate (0 - driver default)
+         * @param fourcc requested pixel format (see V4L2_PIX_FMT_*)
+         * @param buffers number of kernel buffers to request (driver may adjust it)
+         *
+         * @throws std::runtime_error if device cannot be opened or does not support mmap streaming
+         */
+        void open(uint device_id, uint width, uint height, uint fps, uint32_t fourcc, uint buffers);
+
+        /**
+         * @brief Dequeues next filled buffer (VIDIOC_DQBUF).
+         *
+         * @param frame output frame descriptor, points directly into mmap'ed memory
+         * @param timeout_ms maximum time to wait for the frame
+         * @return true if frame was dequeued, false on timeout or error
+         *
+         * @note This is blocking operation
+         */
+        bool read(V4L2_Frame &frame, int timeout_ms = 1000);
+
+        /**
+         * @brief Gives buffer back to the driver (VIDIOC_QBUF).
+         * After this call frame data must not be accessed anymore.
+         */
+        bool requeue(const V4L2_Frame &frame);
+
+        /**
+         * Stops streaming, unmaps buffers and closes the device.
+         */
+        void release();
+
+        [[nodiscard]] bool isOpened() const;
+
+        [[nodiscard]] uint getWidth() const;
+
+        [[nodiscard]] uint getHeight() const;
+
+        [[nodiscard]] uint32_t getFourcc() const;
+
+        [[nodiscard]] size_t getBuffersCount() const;
+    };
+
+} // eox
+
+#endif //STEREOX_LINUX_STREAM_H
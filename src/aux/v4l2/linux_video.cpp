@@ -10,39 +10,94 @@
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <map>
+#include <mutex>
+#include <cerrno>
+#include <algorithm>
+
+namespace {
+
+    typedef struct {
+        int file_descriptor;
+        bool queried;
+        std::vector<eox::v4l2::V4L2_QueryCtrl> controls;
+    } device_handle;
+
+    std::mutex handles_mutex;
+    std::map<uint, device_handle> handles;
+
+    /**
+     * Returns cached device handle (opens device if necessary), handles_mutex must be locked
+     */
+    device_handle *acquire_device(uint device_id) {
+        const auto found = handles.find(device_id);
+        if (found != handles.end())
+            return &found->second;
+
+        const std::string device = "/dev/video" + std::to_string(device_id);
+        const int file_descriptor = open(device.c_str(), O_RDWR);
+
+        if (file_descriptor == -1) {
+            std::cerr << "Cannot open video device: " << device << std::endl;
+            return nullptr;
+        }
 
-std::vector<eox::v4l2::V4L2_QueryCtrl> eox::v4l2::get_camera_props(uint id) {
-    std::vector<eox::v4l2::V4L2_QueryCtrl> properties;
+        return &handles.emplace(device_id, device_handle{
+                .file_descriptor = file_descriptor,
+                .queried = false,
+                .controls = {}
+        }).first->second;
+    }
 
-    const std::string device = "/dev/video" + std::to_string(id);
-    const int file_descriptor = open(device.c_str(), O_RDWR);
+    /**
+     * Closes cached device handle, handles_mutex must be locked
+     */
+    void close_device(uint device_id) {
+        const auto found = handles.find(device_id);
+        if (found == handles.end())
+            return;
+        close(found->second.file_descriptor);
+        handles.erase(found);
+    }
 
-    if (file_descriptor == -1) {
-        std::cerr << "Cannot open video device: " << device << std::endl;
-        return {};
+    /**
+     * Drops handle of device which is gone (e.g. unplugged), so next call opens it again
+     */
+    void check_device(uint device_id) {
+        if (errno == ENODEV || errno == EBADF)
+            close_device(device_id);
     }
 
-    try {
+    /**
+     * @return true if control has 32-bit value which can be read back
+     */
+    bool readable(const eox::v4l2::V4L2_QueryCtrl &control) {
+        if (control.flags & V4L2_CTRL_FLAG_WRITE_ONLY)
+            return false;
+        switch (control.type) {
+            case V4L2_CTRL_TYPE_INTEGER:
+            case V4L2_CTRL_TYPE_BOOLEAN:
+            case V4L2_CTRL_TYPE_MENU:
+            case V4L2_CTRL_TYPE_INTEGER_MENU:
+            case V4L2_CTRL_TYPE_BITMASK:
+                return true;
+            default:
+                return false;
+        }
+    }
 
-        eox::v4l2::V4L2_QueryCtrl queryctrl;
+    bool query_controls(device_handle &handle, uint device_id) {
+        std::vector<eox::v4l2::V4L2_QueryCtrl> controls;
+
+        eox::v4l2::V4L2_QueryCtrl queryctrl{};
         queryctrl.id = V4L2_CTRL_FLAG_NEXT_CTRL;
 
-        while (0 == ioctl(file_descriptor, VIDIOC_QUERYCTRL, &queryctrl)) {
+        while (0 == eox::v4l2::xioctl(handle.file_descriptor, VIDIOC_QUERYCTRL, &queryctrl)) {
             if (!(queryctrl.flags & V4L2_CTRL_FLAG_DISABLED)) {
 
-                if (queryctrl.type != V4L2_CTRL_TYPE_CTRL_CLASS) {
-                    eox::v4l2::V4L2_Control ctr = {.id = queryctrl.id};
-                    if (ioctl(file_descriptor, VIDIOC_G_CTRL, &ctr) == -1) {
-                        std::cerr << "Cannot retrieve value for control: "
-                                  << ctr.id << " [" << device << "]"
-                                  << std::endl;
-                    }
-                    queryctrl.value = ctr.value;
-                }
-
                 // TODO: query menu items name
 
-                properties.push_back(queryctrl);
+                queryctrl.value = 0;
+                controls.push_back(queryctrl);
             }
 
             queryctrl.id |= V4L2_CTRL_FLAG_NEXT_CTRL;
@@ -50,16 +105,82 @@ std::vector<eox::v4l2::V4L2_QueryCtrl> eox::v4l2::get_camera_props(uint id) {
 
         if (errno != EINVAL) {
             std::cerr << "fails for reasons other than reaching the end of the control list" << std::endl;
-            close(file_descriptor);
-            return {};
+            check_device(device_id);
+            return false;
         }
 
-    } catch (...) {
-        close(file_descriptor);
-        throw;
+        handle.controls = std::move(controls);
+        handle.queried = true;
+        return true;
+    }
+}
+
+int eox::v4l2::xioctl(int fd, unsigned long request, void *arg) {
+    int r;
+    do {
+        // ioctl might be interrupted by signal, just retry
+        r = ioctl(fd, request, arg);
+    } while (r == -1 && errno == EINTR);
+    return r;
+}
+
+std::vector<eox::v4l2::V4L2_QueryCtrl> eox::v4l2::get_camera_props(uint id) {
+    std::lock_guard<std::mutex> lock(handles_mutex);
+
+    auto handle = acquire_device(id);
+    if (!handle)
+        return {};
+
+    // control descriptors do not change, so they are enumerated only once
+    if (!handle->queried && !query_controls(*handle, id))
+        return {};
+
+    auto properties = handle->controls;
+
+    std::vector<v4l2_ext_control> values;
+    std::vector<size_t> positions;
+    values.reserve(properties.size());
+    positions.reserve(properties.size());
+    for (size_t i = 0; i < properties.size(); i++) {
+        if (!readable(properties[i]))
+            continue;
+        values.push_back({.id = properties[i].id});
+        positions.push_back(i);
+    }
+
+    if (values.empty())
+        return properties;
+
+    v4l2_ext_controls request{};
+    request.which = V4L2_CTRL_WHICH_CUR_VAL;
+    request.count = values.size();
+    request.controls = values.data();
+
+    if (xioctl(handle->file_descriptor, VIDIOC_G_EXT_CTRLS, &request) == 0) {
+        // all the values at once
+        for (size_t k = 0; k < values.size(); k++) {
+            properties[positions[k]].value = values[k].value;
+        }
+        return properties;
+    }
+
+    if (errno == ENODEV) {
+        std::cerr << "Video device is gone: /dev/video" << id << std::endl;
+        check_device(id);
+        return {};
+    }
+
+    // batch rejected as a whole, read values one by one
+    for (const auto i: positions) {
+        eox::v4l2::V4L2_Control ctr = {.id = properties[i].id};
+        if (xioctl(handle->file_descriptor, VIDIOC_G_CTRL, &ctr) == -1) {
+            std::cerr << "Cannot retrieve value for control: "
+                      << ctr.id << " [/dev/video" << id << "]"
+                      << std::endl;
+        }
+        properties[i].value = ctr.value;
     }
 
-    close(file_descriptor);
     return properties;
 }
 
@@ -80,34 +201,49 @@ bool eox::v4l2::set_camera_prop(uint device_id, eox::v4l2::V4L2_Control control)
 }
 
 std::vector<bool> eox::v4l2::set_camera_prop(uint device_id, std::vector<eox::v4l2::V4L2_Control> controls) {
-    const std::string device = "/dev/video" + std::to_string(device_id);
-    const int file_descriptor = open(device.c_str(), O_RDWR);
-
     std::vector<bool> results(controls.size());
+    if (controls.empty())
+        return results;
+
+    std::lock_guard<std::mutex> lock(handles_mutex);
 
-    if (file_descriptor == -1) {
-        std::cerr << "Cannot open video device: " << device << std::endl;
+    const auto handle = acquire_device(device_id);
+    if (!handle)
         return results;
+
+    std::vector<v4l2_ext_control> values;
+    values.reserve(controls.size());
+    for (const auto &control: controls) {
+        values.push_back({.id = control.id, .value = control.value});
     }
 
-    try {
+    v4l2_ext_controls request{};
+    request.which = V4L2_CTRL_WHICH_CUR_VAL;
+    request.count = values.size();
+    request.controls = values.data();
 
-        for (int i = 0; i < controls.size(); ++i) {
-            auto &control = controls[i];
-            if (ioctl(file_descriptor, VIDIOC_S_CTRL, &control) == -1) {
-                std::cerr << "Cannot set control value: " << control.id << std::endl;
-                results[i] = false;
-            } else {
-                results[i] = true;
-            }
-        }
+    if (xioctl(handle->file_descriptor, VIDIOC_S_EXT_CTRLS, &request) == 0) {
+        std::fill(results.begin(), results.end(), true);
+        return results;
+    }
+
+    if (errno == ENODEV) {
+        std::cerr << "Video device is gone: /dev/video" << device_id << std::endl;
+        check_device(device_id);
+        return results;
+    }
 
-    } catch (...) {
-        close(file_descriptor);
-        throw;
+    // batch rejected as a whole (e.g. contains read only control), set controls one by one
+    for (int i = 0; i < controls.size(); ++i) {
+        auto &control = controls[i];
+        if (xioctl(handle->file_descriptor, VIDIOC_S_CTRL, &control) == -1) {
+            std::cerr << "Cannot set control value: " << control.id << std::endl;
+            results[i] = false;
+        } else {
+            results[i] = true;
+        }
     }
 
-    close(file_descriptor);
     return results;
 }
 
@@ -116,7 +252,7 @@ void eox::v4l2::reset_defaults(uint device_id) {
     std::vector<eox::v4l2::V4L2_Control> controls;
 
     for (const auto &prop: props) {
-        if (prop.type == 6)
+        if (!readable(prop) || (prop.flags & V4L2_CTRL_FLAG_READ_ONLY))
             continue;
         controls.push_back({
                                    .id = prop.id,
@@ -127,6 +263,19 @@ void eox::v4l2::reset_defaults(uint device_id) {
     set_camera_prop(device_id, controls);
 }
 
+void eox::v4l2::release_device(uint device_id) {
+    std::lock_guard<std::mutex> lock(handles_mutex);
+    close_device(device_id);
+}
+
+void eox::v4l2::release_devices() {
+    std::lock_guard<std::mutex> lock(handles_mutex);
+    for (const auto &[id, handle]: handles) {
+        close(handle.file_descriptor);
+    }
+    handles.clear();
+}
+
 void eox::v4l2::write_control(std::ostream &os, const eox::v4l2::V4L2_Control &control) {
     const eox::v4l2::serial_v4l2_control serial = { .id = control.id, .value = control.value };
     const auto data = reinterpret_cast<const char *>(&serial);
@@ -24,6 +24,11 @@ namespace eox::v4l2 {
     typedef struct v4l2_queryctrl_ext V4L2_QueryCtrl;
     typedef struct v4l2_control V4L2_Control;
 
+    /**
+     * @brief ioctl wrapper, retries the call if it was interrupted by a signal.
+     */
+    int xioctl(int fd, unsigned long request, void *arg);
+
     /**
      * @brief Retrieves camera properties for a given camera ID.
      *
@@ -34,6 +39,9 @@ namespace eox::v4l2 {
      *
      * @note This function requires the v4l2 library to be installed.
      * In general it is already installed in most of linux distributions.
+     *
+     * @note Device handle and control descriptors are cached (see release_device()),
+     * current values of all the controls are read with single VIDIOC_G_EXT_CTRLS call.
      */
     std::vector<eox::v4l2::V4L2_QueryCtrl> get_camera_props(uint device_id);
 
@@ -71,6 +79,9 @@ namespace eox::v4l2 {
      * @param controls A vector of `V4L2_Control` objects representing the camera properties to be set.
      * @return Vector of booleans representing results of setting each of properties.
      *
+     * @note All the controls are set with single VIDIOC_S_EXT_CTRLS call,
+     * if device rejects the batch, controls are set one by one.
+     *
      * @see eox::v4l2::V4L2_Control
      */
     std::vector<bool> set_camera_prop(uint device_id, std::vector<V4L2_Control> controls);
@@ -85,6 +96,22 @@ namespace eox::v4l2 {
      */
     void reset_defaults(uint device_id);
 
+    /**
+     * @brief Closes cached handle of the device and drops its cached control descriptors.
+     *
+     * Device handles used for controls are opened once and kept open,
+     * so controls can be changed without re-opening device every time.
+     * Next call for the device opens it again.
+     *
+     * @param device_id The ID of the video device.
+     */
+    void release_device(uint device_id);
+
+    /**
+     * @brief Closes all the cached device handles.
+     */
+    void release_devices();
+
     /**
      * @brief Writes the V4L2 control to the output stream.
      *
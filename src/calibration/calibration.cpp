@@ -11,6 +11,9 @@
 void eox::UiCalibration::update(float delta, float latency, float _fps) {
     this->FPS = _fps;
 
+    // buffers handed out during previous frame are free again
+    pool.recycle();
+
     auto captured = camera.capture();
     if (captured.empty()) {
         // nothing captured at all
@@ -26,12 +29,12 @@ void eox::UiCalibration::update(float delta, float latency, float _fps) {
                           && c_conf.output_height != c_conf.height) {
 
         // copying mat to gpu
-        std::vector<cv::UMat> u_frames;
+        std::vector<cv::UMat *> u_frames;
         u_frames.reserve(captured.size());
         for (const auto &mat: captured) {
-            cv::UMat frame;
+            auto &frame = pool.umat(mat.size(), mat.type());
             mat.copyTo(frame);
-            u_frames.push_back(frame);
+            u_frames.push_back(&frame);
         }
 
         // up/downscale
@@ -40,24 +43,26 @@ void eox::UiCalibration::update(float delta, float latency, float _fps) {
             const auto new_size = cv::Size(c_conf.output_width, c_conf.output_height);
             const auto type = c_conf.output_width < c_conf.width ? cv::INTER_AREA : cv::INTER_LANCZOS4;
             for (auto &frame: u_frames) {
-                cv::UMat u_dst;
-                cv::resize(frame, u_dst, new_size, 0, 0, type);
-                frame = u_dst;
+                auto &u_dst = pool.umat(new_size, frame->type());
+                cv::resize(*frame, u_dst, new_size, 0, 0, type);
+                frame = &u_dst;
             }
         }
 
         // denoising
         if (config.denoise) {
             for (auto &frame: u_frames) {
-                cv::UMat u_dst;
-                cv::fastNlMeansDenoisingColored(frame, u_dst);
-                frame = u_dst;
+                auto &u_dst = pool.umat(frame->size(), frame->type());
+                cv::fastNlMeansDenoisingColored(*frame, u_dst);
+                frame = &u_dst;
             }
         }
 
         // back to regular mat
         for (int i = 0; i < u_frames.size(); i++) {
-            u_frames[i].copyTo(captured[i]);
+            auto &mat = pool.mat(u_frames[i]->size(), u_frames[i]->type());
+            u_frames[i]->copyTo(mat);
+            captured[i] = mat;
         }
     }
 
@@ -69,35 +74,25 @@ void eox::UiCalibration::update(float delta, float latency, float _fps) {
         return;
     }
 
-    // find squares on checkerboard (async)
-    std::vector<std::future<eox::ocv::Squares>> futures;
-    futures.reserve(captured.size());
-    for (const auto &frame: captured) {
-        futures.push_back(executor->execute<eox::ocv::Squares>([&frame, this]() {
-            return eox::ocv::find_squares(
-                    frame,
-                    config.calibration.columns,
-                    config.calibration.rows,
-                    config.calibration.quality);
-        }));
-    }
+    // find squares on checkerboard (in parallel)
+    std::vector<eox::ocv::Squares> squares(captured.size());
+    executor->parallel_for(0, captured.size(), [this, &captured, &squares](size_t i) {
+        squares[i] = eox::ocv::find_squares(
+                captured[i],
+                config.calibration.columns,
+                config.calibration.rows,
+                config.calibration.quality);
+    });
 
     int found = 0;
     std::vector<cv::Mat> frames;
-    frames.reserve(futures.size());
-
-    std::vector<eox::ocv::Squares> squares;
-    squares.reserve(futures.size());
-
-    // get results of square finding tasks
-    for (auto &future: futures) {
-        const auto s = future.get();
+    frames.reserve(squares.size());
+    for (const auto &s: squares) {
         frames.push_back(s.result);
-        squares.push_back(s);
         found += s.found;
     }
 
-    if (found != futures.size()) {
+    if (found != squares.size()) {
         // not every frame has squares found
 
         timer.reset();
@@ -137,23 +132,26 @@ void eox::UiCalibration::update(float delta, float latency, float _fps) {
         // or there is only one camera, OR not every camera is pre-calibrated.
         // In any case we need to calibrate each camera first
 
-        calibrated_solo.reserve(props.size());
-        for (const auto &prop: props) {
-            const auto &c_id = prop.id;
-            const auto result = eox::ocv::calibrate_solo(
-                    image_points[c_id],
+        // cameras are independent, so calibrate them in parallel
+        calibrated_solo.resize(props.size());
+        executor->parallel_for(0, props.size(), [this, &props, &calibrated_solo](size_t i) {
+            const auto &c_id = props[i].id;
+            calibrated_solo[i] = eox::ocv::calibrate_solo(
+                    image_points.at(c_id),
                     c_id,
                     config.camera[0].output_width,
                     config.camera[0].output_height,
                     config.calibration.rows,
                     config.calibration.columns
             );
-            log->info("RMS[{}]: {}", c_id, result.rms);
-            log->info("MRE[{}]: {}", c_id, result.mre);
+        });
+
+        for (const auto &result: calibrated_solo) {
+            log->info("RMS[{}]: {}", result.uid, result.rms);
+            log->info("MRE[{}]: {}", result.uid, result.mre);
             for (const auto &err: result.per_view_errors) {
                 log->debug("-> {}", err);
             }
-            calibrated_solo.push_back(result);
         }
     } else {
 
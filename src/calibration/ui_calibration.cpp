@@ -51,7 +51,10 @@ namespace eox {
             camera.setThreadPool(executor);
             camera.setHomogeneous(props[0].homogeneous);
             camera.setFast(props[0].fast);
+            camera.setAsync(props[0].async);
+            camera.setDecodeSize(cv::Size(props[0].output_width, props[0].output_height));
             camera.setApi(props[0].api);
+            camera.setBackend(props[0].backend);
 
             {
                 // loading camera parameters from files
@@ -59,7 +62,7 @@ namespace eox {
                 {
                     log->debug("using camera hardware defaults");
                     for (const auto &prop: props) {
-                        eox::v4l2::reset_defaults(prop.index);
+                        camera.resetDefaults(prop.id);
                     }
                 }
 
@@ -179,7 +182,7 @@ namespace eox {
         {
             // Stable FPS worker loop
             deltaLoop.setFunc([this](float d, float l, float f) { update(d, l, f); });
-            deltaLoop.setFps(0);
+            deltaLoop.setConfig(config.loop);
             deltaLoop.start();
         }
 
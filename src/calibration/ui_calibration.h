@@ -15,6 +15,7 @@
 #include "../aux/commons.h"
 #include "../aux/utils/timer/timer.h"
 #include "../aux/ocv/cv_utils.h"
+#include "../aux/ocv/frame_pool.h"
 
 namespace eox {
 
@@ -31,6 +32,9 @@ namespace eox {
         eox::xgtk::GLImage glImage;
         eox::utils::Timer timer;
 
+        // temporary buffers of each frame
+        eox::ocv::FramePool pool;
+
         double progress = 0;
         bool active = false;
         float FPS = 0;
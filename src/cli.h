@@ -10,6 +10,10 @@
 #include <spdlog/spdlog.h>
 #include "aux/commons.h"
 #include "aux/utils/globals/eox_globals.h"
+#include "aux/utils/sched/thread_sched.h"
+#include "aux/utils/trace/trace.h"
+#include "aux/utils/metrics/metrics.h"
+#include <opencv2/core/persistence.hpp>
 #include <filesystem>
 
 namespace eox::cli {
@@ -70,6 +74,77 @@ namespace eox::cli {
         return map;
     }
 
+    std::map<std::string, eox::util::thread_sched> parse_threads(
+            const std::vector<std::string> &configs,
+            const std::vector<std::string> &affinity_str_vec,
+            const std::vector<std::string> &sched_str_vec) {
+        // files:    {"type": "eox::threads", "pool": {"cpus": "2-7", "sched": "nice:-5"}, ...}
+        // affinity: pool:2-7 loop:1 aka ["pool:2-7", "loop:1"]
+        // sched:    loop:fifo:50 pool:nice:-5 aka ["loop:fifo:50", "pool:nice:-5"]
+        // command line takes precedence over the files
+
+        const std::vector<std::string> names = {
+                eox::util::thread_class::GUI,
+                eox::util::thread_class::LOOP,
+                eox::util::thread_class::POOL,
+                eox::util::thread_class::STAGE,
+                eox::util::thread_class::DNN,
+        };
+
+        std::map<std::string, eox::util::thread_sched> map;
+        for (const auto &path: configs) {
+            if (std::filesystem::path(path).extension().string() != ".json")
+                continue;
+
+            cv::FileStorage fs(path, cv::FileStorage::READ);
+
+            std::string type;
+            fs["type"] >> type;
+            if ("eox::threads" != type) {
+                fs.release();
+                continue;
+            }
+
+            for (const auto &name: names) {
+                const auto node = fs[name];
+                if (node.empty())
+                    continue;
+
+                std::string cpus, sched;
+                node["cpus"] >> cpus;
+                node["sched"] >> sched;
+
+                auto &config = map[name];
+                if (!cpus.empty())
+                    config.cpus = eox::util::parse_cpus(cpus);
+                if (!sched.empty())
+                    eox::util::parse_sched(sched, config);
+            }
+            fs.release();
+        }
+
+        for (const auto &affinity_str: affinity_str_vec) {
+            const auto colon = affinity_str.find(':');
+            if (colon == std::string::npos)
+                continue;
+            map[affinity_str.substr(0, colon)].cpus = eox::util::parse_cpus(affinity_str.substr(colon + 1));
+        }
+
+        for (const auto &sched_str: sched_str_vec) {
+            const auto colon = sched_str.find(':');
+            if (colon == std::string::npos)
+                continue;
+            eox::util::parse_sched(sched_str.substr(colon + 1), map[sched_str.substr(0, colon)]);
+        }
+
+        for (const auto &[name, _]: map) {
+            if (std::find(names.begin(), names.end(), name) == names.end())
+                throw std::runtime_error("unknown thread class: " + name);
+        }
+
+        return map;
+    }
+
     eox::data::basic_config parse(int &argc, char **&argv) {
         argparse::ArgumentParser program(
                 "stereox",
@@ -92,6 +167,29 @@ namespace eox::cli {
                 .help("set number of maximum concurrent jobs")
                 .default_value(4)
                 .scan<'i', int>();
+        program.add_argument("--affinity")
+                .help("pin threads to cpus (pairs class:cpus i.e.: 'pool:2-7 loop:1 dnn:8-15 gui:0'), "
+                      "classes: [gui, loop, pool, stage, dnn]")
+                .default_value(std::vector<std::string>{})
+                .nargs(argparse::nargs_pattern::any)
+                .append();
+        program.add_argument("--sched")
+                .help("scheduling policy of threads (class:policy[:value] i.e.: 'loop:fifo:50 pool:nice:-5'), "
+                      "policies: [other, nice, fifo, rr]")
+                .default_value(std::vector<std::string>{})
+                .nargs(argparse::nargs_pattern::any)
+                .append();
+        program.add_argument("--trace")
+                .help("write trace spans into Chrome trace-event JSON file (chrome://tracing, ui.perfetto.dev)")
+                .default_value(std::string(""));
+        program.add_argument("--metrics")
+                .help("serve latency histograms, counters and gauges (prometheus text format) "
+                      "on http://127.0.0.1:<port>/metrics (0 - disabled)")
+                .default_value(0)
+                .scan<'i', int>();
+        program.add_argument("--metrics-dump")
+                .help("write metrics (prometheus text format) into the file at exit")
+                .default_value(std::string(""));
         program.add_argument("-d", "--device")
                 .help("list of devices coma separated (pairs id:index i.e.: '0:2,1:4' )")
                 .nargs(argparse::nargs_pattern::any)
@@ -138,6 +236,17 @@ namespace eox::cli {
         program.add_argument("--fast")
                 .help("enable fast mode, faster frame grabbing with the cost of lack of synchronization between devices")
                 .flag();
+        program.add_argument("--async")
+                .help("capture frames on dedicated thread, so capturing overlaps with processing of previous frames")
+                .flag();
+        program.add_argument("--gray")
+                .help("capture luma only (single channel frames), color is restored only for visualization")
+                .flag();
+        program.add_argument("--roi")
+                .help("decode only region of interest of the frames: x y width height (pose module)")
+                .nargs(4)
+                .default_value(std::vector<int>{0, 0, 0, 0})
+                .scan<'i', int>();
         program.add_argument("--denoise")
                 .help("perform de-noising filter")
                 .flag();
@@ -145,6 +254,49 @@ namespace eox::cli {
                 .help("set the backend API for video capturing (see: cv::CAP_*)")
                 .default_value((int) cv::CAP_V4L2)
                 .scan<'i', int>();
+        program.add_argument("--backend")
+                .help("set the video capturing backend [ocv, mmap, playback] "
+                      "(mmap: native V4L2 zero-copy streaming, requires V4L2 api; playback: recorded session)")
+                .choices("ocv", "mmap", "playback")
+                .default_value(std::string("ocv"));
+        program.add_argument("--session")
+                .help("recorded session directory for playback backend (device ids select recorded streams)")
+                .default_value(std::string(""));
+        program.add_argument("--playback-pacing")
+                .help("playback pacing [original, fast] (fast: as fast as possible, ignoring original timing)")
+                .choices("original", "fast")
+                .default_value(std::string("original"));
+        program.add_argument("--playback-loop")
+                .help("restart playback once recorded session is over")
+                .flag();
+        program.add_argument("--record")
+                .help("record captured frames (lossless, as delivered by device) into session directory")
+                .default_value(std::string(""));
+        program.add_argument("--segment")
+                .help("size (MB) of each preallocated segment file of recorded session")
+                .default_value(1024)
+                .scan<'i', int>();
+        program.add_argument("--ring")
+                .help("size (MB) of in-memory buffer between capture and disk writer of recorder")
+                .default_value(256)
+                .scan<'i', int>();
+        program.add_argument("--tolerance")
+                .help("maximum timestamp skew (ms) between synchronized frames for mmap backend (0 - half of frame period)")
+                .default_value(0.0f)
+                .scan<'g', float>();
+        program.add_argument("--loop-pacing")
+                .help("pacing of the main loop [drift, deadline] "
+                      "(deadline: sleeps until absolute deadlines, reports wake-up jitter on exit)")
+                .choices("drift", "deadline")
+                .default_value(std::string("drift"));
+        program.add_argument("--loop-overrun")
+                .help("what deadline pacing does when iteration misses its deadline [skip, catch-up, slip]")
+                .choices("skip", "catch-up", "slip")
+                .default_value(std::string("skip"));
+        program.add_argument("--loop-fps")
+                .help("maximum iterations per second of the main loop (0 - as fast as possible)")
+                .default_value(0)
+                .scan<'i', int>();
 
 
         // Calibration config
@@ -202,6 +354,12 @@ namespace eox::cli {
                 .help("pattern matching algorithm [bm, sgbm]")
                 .choices("bm", "sgbm")
                 .default_value("bm");
+        stereo.add_argument("--depth")
+                .help("queue depth in front of each pipeline stage [rectify, match, reproject, render], "
+                      "single value applies to every stage (deeper - higher throughput, but higher latency)")
+                .default_value(std::vector<std::string>{"1"})
+                .nargs(argparse::nargs_pattern::any)
+                .append();
         program.add_subparser(stereo);
 
 
@@ -211,7 +369,30 @@ namespace eox::cli {
                 3D pose estimation module.
                 Use pose -h for help.
         )desc");
-        // TODO
+        pose.add_argument("-i", "--inference")
+                .help("inference backend [gpu, xnnpack, reference], "
+                      "falls back to the next one if not available (gpu -> xnnpack -> reference)")
+                .choices("gpu", "xnnpack", "reference")
+                .default_value(std::string("gpu"));
+        pose.add_argument("--detector-threads")
+                .help("cpu threads of pose detector model (xnnpack and reference backends)")
+                .default_value(2)
+                .scan<'i', int>();
+        pose.add_argument("--landmark-threads")
+                .help("cpu threads of pose landmark model (xnnpack and reference backends)")
+                .default_value(4)
+                .scan<'i', int>();
+        pose.add_argument("--poses")
+                .help("maximum number of tracked people")
+                .default_value(1)
+                .scan<'i', int>();
+        pose.add_argument("--landmark-instances")
+                .help("number of landmark model instances, landmarks of tracked people are inferred in parallel")
+                .default_value(1)
+                .scan<'i', int>();
+        pose.add_argument("--segmentation")
+                .help("show segmented frame (everything but tracked people masked out), landmarks only otherwise")
+                .flag();
         program.add_subparser(pose);
 
 
@@ -233,6 +414,12 @@ namespace eox::cli {
 
         const auto scale = program.get<float>("--scale");
         const auto codec = program.get<std::string>("--codec");
+        const auto backend_name = to_lower_case(program.get<std::string>("--backend"));
+        const auto backend = backend_name == "mmap"
+                             ? eox::data::Backend::MMAP
+                             : backend_name == "playback"
+                               ? eox::data::Backend::PLAYBACK
+                               : eox::data::Backend::OCV;
         const auto devices = parse_devices(
                 program.get<std::vector<std::string>>("--device")
         );
@@ -245,6 +432,8 @@ namespace eox::cli {
         if (o_h <= 0)
             o_h = program.get<int>("--height");
 
+        const auto roi = program.get<std::vector<int>>("--roi");
+
         std::vector<eox::data::camera_properties> props;
         props.reserve(devices.size());
         for (const auto &[id, index]: devices) {
@@ -264,10 +453,37 @@ namespace eox::cli {
                                               codec[3]},
                                     .fast = program.get<bool>("--fast"),
                                     .homogeneous = program.get<bool>("--homogeneous"),
-                                    .api = program.get<int>("--api")
+                                    .api = program.get<int>("--api"),
+                                    .backend = backend,
+                                    .tolerance = program.get<float>("--tolerance"),
+                                    .async = program.get<bool>("--async"),
+                                    .session = program.get<std::string>("--session"),
+                                    .realtime = to_lower_case(program.get<std::string>("--playback-pacing")) != "fast",
+                                    .loop = program.get<bool>("--playback-loop"),
+                                    .record = program.get<std::string>("--record"),
+                                    .segment_size = program.get<int>("--segment"),
+                                    .ring_size = program.get<int>("--ring"),
+                                    .gray = program.get<bool>("--gray"),
+                                    .roi = {roi[0],
+                                            roi[1],
+                                            roi[2],
+                                            roi[3]}
                             });
         }
 
+        const auto overrun_name = to_lower_case(program.get<std::string>("--loop-overrun"));
+        const eox::data::loop_config loop = {
+                .pacing = to_lower_case(program.get<std::string>("--loop-pacing")) == "deadline"
+                          ? eox::data::Pacing::DEADLINE
+                          : eox::data::Pacing::DRIFT,
+                .overrun = overrun_name == "slip"
+                           ? eox::data::Overrun::SLIP
+                           : overrun_name == "catch-up"
+                             ? eox::data::Overrun::CATCH_UP
+                             : eox::data::Overrun::SKIP,
+                .fps = std::max(program.get<int>("--loop-fps"), 0)
+        };
+
         const auto configs = program.get<std::vector<std::string>>("--config");
         std::vector<std::string> new_configs;
         std::string work_dir;
@@ -282,6 +498,18 @@ namespace eox::cli {
             new_configs.push_back(path);
         }
 
+        // before any worker thread starts
+        eox::util::configure_threads(parse_threads(
+                new_configs,
+                program.get<std::vector<std::string>>("--affinity"),
+                program.get<std::vector<std::string>>("--sched")
+        ));
+
+        if (const auto trace = program.get<std::string>("--trace"); !trace.empty())
+            eox::util::trace_start(trace);
+
+        eox::util::metrics_start(program.get<int>("--metrics"), program.get<std::string>("--metrics-dump"));
+
         if (program.is_subcommand_used("calibration")) {
             const auto &instance = program.at<argparse::ArgumentParser>("calibration");
 
@@ -297,6 +525,7 @@ namespace eox::cli {
                     .configs = new_configs,
                     .camera = props,
                     .module = "calibration",
+                    .loop = loop,
                     .calibration = {
                             .columns = instance.get<int>("--columns"),
                             .rows = instance.get<int>("--rows"),
@@ -318,6 +547,12 @@ namespace eox::cli {
 
             const auto algo = instance.get<std::string>("--algorithm");
 
+            int depth[4];
+            const auto depths = instance.get<std::vector<std::string>>("--depth");
+            for (int i = 0; i < 4; i++) {
+                depth[i] = depths.empty() ? 1 : std::max(std::stoi(depths[std::min<size_t>(i, depths.size() - 1)]), 1);
+            }
+
             return {
                     .denoise = program.get<bool>("--denoise"),
                     .scale = scale,
@@ -326,18 +561,27 @@ namespace eox::cli {
                     .camera = props,
                     .groups = groups,
                     .module = "stereo",
+                    .loop = loop,
                     .stereo = {
                             .algorithm = to_lower_case(algo) == "sgbm"
                                          ? eox::data::Algorithm::SGBM
                                          : eox::data::Algorithm::BM,
-                            .confidence = instance.get<bool>("--confidence")
+                            .confidence = instance.get<bool>("--confidence"),
+                            .depth = {depth[0], depth[1], depth[2], depth[3]}
                     }
             };
         }
 
         if (program.is_subcommand_used("pose")) {
             const auto &instance = program.at<argparse::ArgumentParser>("pose");
-            // TODO
+
+            const auto inference_name = to_lower_case(instance.get<std::string>("--inference"));
+            const auto inference = inference_name == "reference"
+                                   ? eox::data::Inference::REFERENCE
+                                   : inference_name == "xnnpack"
+                                     ? eox::data::Inference::XNNPACK
+                                     : eox::data::Inference::GPU;
+
             return {
                     .denoise = program.get<bool>("--denoise"),
                     .scale = scale,
@@ -345,6 +589,20 @@ namespace eox::cli {
                     .configs = new_configs,
                     .camera = props,
                     .module = "pose",
+                    .loop = loop,
+                    .pose = {
+                            .detector = {
+                                    .backend = inference,
+                                    .threads = std::max(instance.get<int>("--detector-threads"), 1)
+                            },
+                            .landmark = {
+                                    .backend = inference,
+                                    .threads = std::max(instance.get<int>("--landmark-threads"), 1)
+                            },
+                            .poses = std::max(instance.get<int>("--poses"), 1),
+                            .landmark_instances = std::max(instance.get<int>("--landmark-instances"), 1),
+                            .segmentation = instance.get<bool>("--segmentation")
+                    }
             };
         }
 
@@ -353,7 +611,8 @@ namespace eox::cli {
                 .scale = scale,
                 .work_dir = work_dir,
                 .configs = new_configs,
-                .camera = props
+                .camera = props,
+                .loop = loop
         };
     }
 
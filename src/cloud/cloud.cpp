@@ -3,113 +3,169 @@
 //
 
 #include "ui_points_cloud.h"
+#include "../aux/utils/trace/trace.h"
+#include "../aux/utils/metrics/metrics.h"
 
 #include <opencv2/photo.hpp>
 
 namespace eox {
 
-    using frame_container = struct {
-        std::map<ts::device_id, cv::Mat> frames;
-    };
-
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "UnusedParameter"
 
     void UiPointsCloud::update(float delta, float late, float fps) {
         FPS = fps;
 
+        // source of the stage graph, blocks while every frame is still in flight
+        graph.push([this](uint64_t id, cloud_frame &frame) {
+            return capture(frame);
+        });
+    }
+
+#pragma clang diagnostic pop
+
+    template<typename F>
+    void UiPointsCloud::forEachGroup(cloud_frame &frame, F &&func) {
+        // device groups are independent, so process them in parallel (one task per group)
+        executor->parallel_for(0, frame.active.size(), [&frame, &func](size_t i) {
+            EOX_TRACE_SPAN("cloud::group");
+            const auto &[g_id, group] = frame.active[i];
+            func(g_id, *group);
+
+            // frame goes to the next stage (other thread, other OpenCL queue) only when it's done
+            cv::ocl::finish();
+        });
+    }
+
+    bool UiPointsCloud::capture(cloud_frame &frame) {
+        EOX_TRACE_SPAN("cloud::capture");
+        // buffers handed out when this frame was used last time are free again
+        for (auto &[_, group]: frame.groups) {
+            group.pool.recycle();
+            group.frames.clear();
+            group.output.clear();
+        }
+        frame.active.clear();
+
         auto captured = camera.captureWithId();
         if (captured.empty()) {
             log->debug("nothing captured, skip");
-            return;
+            return false;
         }
 
-        std::map<ts::group_id, frame_container> frames;
-        for (const auto &[d_id, frame]: captured) {
-            auto group_id = deviceGroupMap.at(d_id);
-            auto &container = frames[group_id];
-            container.frames.emplace(d_id, frame);
-        }
+        // frames are uploaded right away, camera might reuse captured buffers on the next capture
+        const auto &c_conf = config.camera[0];
+        for (const auto &[d_id, mat]: captured) {
+            const auto g_id = deviceGroupMap.at(d_id);
+            auto &group = frame.groups[g_id];
+            if (group.frames.empty())
+                frame.active.emplace_back(g_id, &group);
 
-        // vector with output frames (goes to render)
-        std::vector<cv::Mat> _frames;
-
-        // iterating over each device group (main magic here)
-        for (const auto &[g_id, container]: frames) {
-
-            // unpacking frames container
-            std::vector<cv::UMat> frames_pair;
-            frames_pair.reserve(container.frames.size());
-            for (const auto &[d_id, frame]: container.frames) {
-                cv::UMat dst;
-                frame.copyTo(dst);
-                frames_pair.push_back(dst);
-            }
+            auto *dst = &group.pool.umat(mat.size(), mat.type());
+            mat.copyTo(*dst);
 
             // up/downscale
-            const auto &c_conf = config.camera[0];
             if (c_conf.output_width != c_conf.width
                 && c_conf.output_height != c_conf.height) {
                 const auto new_size = cv::Size(c_conf.output_width, c_conf.output_height);
                 const auto type = c_conf.output_width < c_conf.width ? cv::INTER_AREA : cv::INTER_CUBIC;
-                for (auto &frame: frames_pair) {
-                    cv::UMat u_dst;
-                    cv::resize(frame, u_dst, new_size, 0, 0, type);
-                    frame = u_dst;
-                }
+                auto &u_dst = group.pool.umat(new_size, dst->type());
+                cv::resize(*dst, u_dst, new_size, 0, 0, type);
+                dst = &u_dst;
             }
 
-            // unpacking rectification maps to GPU matrices
+            group.frames.push_back(dst);
+        }
+
+        // frame goes to the rectify stage (other thread, other OpenCL queue) only when it's done
+        cv::ocl::finish();
+        return true;
+    }
+
+    bool UiPointsCloud::rectify(cloud_frame &frame) {
+        EOX_TRACE_SPAN("cloud::rectify");
+        forEachGroup(frame, [this](ts::group_id g_id, group_frame &group) {
+            auto &pool = group.pool;
+
+            // unpacking rectification maps to GPU matrices (only once, they never change)
             const auto &rect = packages.at(g_id).rectification;
-            cv::UMat L_MAP1, L_MAP2, R_MAP1, R_MAP2;
-            rect.L_MAP1.copyTo(L_MAP1);
-            rect.L_MAP2.copyTo(L_MAP2);
-            rect.R_MAP1.copyTo(R_MAP1);
-            rect.R_MAP2.copyTo(R_MAP2);
+            auto &maps = rectificationMaps.at(g_id);
+            if (maps[0].empty()) {
+                rect.L_MAP1.copyTo(maps[0]);
+                rect.L_MAP2.copyTo(maps[1]);
+                rect.R_MAP1.copyTo(maps[2]);
+                rect.R_MAP2.copyTo(maps[3]);
+            }
+            const cv::UMat &L_MAP1 = maps[0], &L_MAP2 = maps[1], &R_MAP1 = maps[2], &R_MAP2 = maps[3];
 
-            // unpacking left and right frames to GPU matrices
-            cv::UMat &frame_l = frames_pair[0];
-            cv::UMat &frame_r = frames_pair[1];
+            // left and right frames of the group
+            cv::UMat &frame_l = *group.frames[0];
+            cv::UMat &frame_r = *group.frames[1];
 
             // remapping frames according to stereo rectification
-            cv::UMat source_l, source_r;
-            cv::remap(frame_l, source_l, L_MAP1, L_MAP2, cv::INTER_LINEAR);
-            cv::remap(frame_r, source_r, R_MAP1, R_MAP2, cv::INTER_LINEAR);
-
-            // convert from BGR to Grayscale
-            cv::UMat gray_l, gray_r;
-            cv::cvtColor(source_l, gray_l, cv::COLOR_BGR2GRAY);
-            cv::cvtColor(source_r, gray_r, cv::COLOR_BGR2GRAY);
+            group.source_l = &pool.umat(L_MAP1.size(), frame_l.type());
+            group.source_r = &pool.umat(R_MAP1.size(), frame_r.type());
+            cv::remap(frame_l, *group.source_l, L_MAP1, L_MAP2, cv::INTER_LINEAR);
+            cv::remap(frame_r, *group.source_r, R_MAP1, R_MAP2, cv::INTER_LINEAR);
+
+            const auto size = group.source_l->size();
+
+            // convert from BGR to Grayscale (unless frames were captured as luma only)
+            group.gray_l = group.source_l;
+            group.gray_r = group.source_r;
+            if (group.source_l->channels() != 1) {
+                group.gray_l = &pool.umat(size, CV_8UC1);
+                group.gray_r = &pool.umat(size, CV_8UC1);
+                cv::cvtColor(*group.source_l, *group.gray_l, cv::COLOR_BGR2GRAY);
+                cv::cvtColor(*group.source_r, *group.gray_r, cv::COLOR_BGR2GRAY);
+            }
 
             // denoising, might be very resource intensive
             if (config.denoise) {
-                cv::UMat filtered_l, filtered_r;
-                cv::fastNlMeansDenoising(gray_l, filtered_l);
-                cv::fastNlMeansDenoising(source_r, filtered_r);
-                gray_l = filtered_l;
-                gray_r = filtered_r;
+                auto &filtered_l = pool.umat(size, CV_8UC1);
+                auto &filtered_r = pool.umat(size, group.source_r->type());
+                cv::fastNlMeansDenoising(*group.gray_l, filtered_l);
+                cv::fastNlMeansDenoising(*group.source_r, filtered_r);
+                group.gray_l = &filtered_l;
+                group.gray_r = &filtered_r;
             }
+        });
+        return true;
+    }
+
+    bool UiPointsCloud::match(cloud_frame &frame) {
+        EOX_TRACE_SPAN("cloud::match");
+        forEachGroup(frame, [this](ts::group_id g_id, group_frame &group) {
+            auto &pool = group.pool;
+            auto &gray_l = *group.gray_l;
+            auto &gray_r = *group.gray_r;
+            const auto size = gray_l.size();
 
             // computing disparity map
-            cv::UMat disparity, disparity_raw;
+            cv::UMat *disparity, *disparity_raw;
             if (config.stereo.confidence) {
-                cv::UMat disparity_l;
-                cv::UMat disparity_r;
+                auto &disparity_l = pool.umat(size, CV_16S);
+                auto &disparity_r = pool.umat(size, CV_16S);
 
-                matchers.at(g_id).first->compute(gray_l, gray_r, disparity_l);
-                matchers.at(g_id).second->compute(gray_r, gray_l, disparity_r);
+                {
+                    EOX_STAGE_LATENCY("stereo_match");
+                    matchers.at(g_id).first->compute(gray_l, gray_r, disparity_l);
+                    matchers.at(g_id).second->compute(gray_r, gray_l, disparity_r);
+                }
 
                 // Filter Speckles
                 //cv::filterSpeckles(disparity_l, 0, 32, 25);
                 //cv::filterSpeckles(disparity_r, 0, 32, 25);
 
-                disparity_raw = disparity_l;
+                disparity_raw = &disparity_l;
 
                 if (wlsFilters.at(g_id)->getLambda() != 0) {
+                    EOX_STAGE_LATENCY("wls_filter");
+                    disparity = &pool.umat(size, CV_16S);
                     wlsFilters.at(g_id)->filter(
                             disparity_l,
                             gray_l,
-                            disparity,
+                            *disparity,
                             disparity_r,
                             cv::Rect(),
                             gray_r
@@ -119,16 +175,22 @@ namespace eox {
                 }
             } else {
 
-                matchers.at(g_id).first->compute(gray_l, gray_r, disparity_raw);
+                disparity_raw = &pool.umat(size, CV_16S);
+                {
+                    EOX_STAGE_LATENCY("stereo_match");
+                    matchers.at(g_id).first->compute(gray_l, gray_r, *disparity_raw);
+                }
 
                 // Filter Speckles
                 //cv::filterSpeckles(disparity_raw, 0, 32, 25);
 
                 if (wlsFilters.at(g_id)->getLambda() != 0) {
+                    EOX_STAGE_LATENCY("wls_filter");
+                    disparity = &pool.umat(size, CV_16S);
                     wlsFilters.at(g_id)->filter(
-                            disparity_raw,
+                            *disparity_raw,
                             gray_l,
-                            disparity
+                            *disparity
                     );
                 } else {
                     disparity = disparity_raw;
@@ -136,19 +198,36 @@ namespace eox {
             }
 
             // converting to CV_16F
-            if ((disparity.depth() & CV_MAT_DEPTH_MASK) == CV_16S) {
-                cv::UMat temp;
-                disparity.convertTo(temp, CV_32F, 1. / 16.);
-                disparity = temp;
+            if ((disparity->depth() & CV_MAT_DEPTH_MASK) == CV_16S) {
+                auto &temp = pool.umat(size, CV_32F);
+                disparity->convertTo(temp, CV_32F, 1. / 16.);
+                disparity = &temp;
             }
 
+            group.disparity = disparity;
+            group.disparity_raw = disparity_raw;
+        });
+        return true;
+    }
+
+    bool UiPointsCloud::reproject(cloud_frame &frame) {
+        EOX_TRACE_SPAN("cloud::reproject");
+        forEachGroup(frame, [this](ts::group_id g_id, group_frame &group) {
+            auto &pool = group.pool;
+            const auto &rect = packages.at(g_id).rectification;
+            const auto &source_l = *group.source_l;
+            const auto size = source_l.size();
+
 
             // ! ! !
             // NOTE, SHOULD USE [ disparity ] matrix for further computation
             // ! ! !
 
-            cv::UMat points_cloud;
-            cv::reprojectImageTo3D(disparity, points_cloud, rect.Q, true);
+            group.points_cloud = &pool.umat(size, CV_32FC3);
+            {
+                EOX_STAGE_LATENCY("reproject");
+                cv::reprojectImageTo3D(*group.disparity, *group.points_cloud, rect.Q, true);
+            }
 
             // ! ! !
             // NOTE, SHOULD USE [ points_cloud ] matrix for further computation
@@ -156,44 +235,72 @@ namespace eox {
 
 
             // Convert the disparity values to a range that can be represented in 8-bit format
-            cv::UMat normalized_disp, normalized_raw, normalized_point;
-            cv::normalize(disparity, normalized_disp, 0, 255, cv::NORM_MINMAX, CV_8U);
-            cv::normalize(disparity_raw, normalized_raw, 0, 255, cv::NORM_MINMAX, CV_8U);
+            auto &normalized_disp = pool.umat(size, CV_8U);
+            auto &normalized_raw = pool.umat(size, CV_8U);
+            auto &normalized_point = pool.umat(size, CV_8UC3);
+            cv::normalize(*group.disparity, normalized_disp, 0, 255, cv::NORM_MINMAX, CV_8U);
+            cv::normalize(*group.disparity_raw, normalized_raw, 0, 255, cv::NORM_MINMAX, CV_8U);
 
             {
-                cv::UMat depth, temp;
-                cv::extractChannel(points_cloud, depth, 2);
+                auto &depth = pool.umat(size, CV_32F);
+                auto &temp = pool.umat(size, CV_8U);
+                cv::extractChannel(*group.points_cloud, depth, 2);
                 eox::ocv::clamp(depth, 0, 255);
                 depth.convertTo(temp, CV_8U);
                 cv::applyColorMap(temp, normalized_point, cv::COLORMAP_JET);
             }
 
             // converting back to BGR
-            cv::UMat bgr_l, bgr_disparity, bgr_raw;
+            auto &bgr_disparity = pool.umat(size, CV_8UC3);
+            auto &bgr_raw = pool.umat(size, CV_8UC3);
             cv::cvtColor(normalized_disp, bgr_disparity, cv::COLOR_GRAY2BGR);
             cv::cvtColor(normalized_raw, bgr_raw, cv::COLOR_GRAY2BGR);
 
+            // luma only frames, color is needed only for visualization
+            group.bgr_l = group.source_l;
+            if (source_l.channels() == 1) {
+                group.bgr_l = &pool.umat(size, CV_8UC3);
+                cv::cvtColor(source_l, *group.bgr_l, cv::COLOR_GRAY2BGR);
+            }
+
             // converting back to regular cv::Mat
-            cv::Mat left, raw, disp, point;
-            source_l.copyTo(left);
+            auto &left = pool.mat(size, CV_8UC3);
+            auto &raw = pool.mat(size, CV_8UC3);
+            auto &disp = pool.mat(size, CV_8UC3);
+            auto &point = pool.mat(size, CV_8UC3);
+            group.bgr_l->copyTo(left);
             bgr_raw.copyTo(raw);
             bgr_disparity.copyTo(disp);
             normalized_point.copyTo(point);
 
-            // saving results to global vector of frames (goes to render output)
-            _frames.push_back(left);
-            _frames.push_back(raw);
-            _frames.push_back(disp);
-            _frames.push_back(point);
+            // saving results to vector of frames of the group (goes to render output)
+            group.output.push_back(left);
+            group.output.push_back(raw);
+            group.output.push_back(disp);
+            group.output.push_back(point);
+        });
+        return true;
+    }
+
+    bool UiPointsCloud::render(cloud_frame &frame) {
+        EOX_TRACE_SPAN("cloud::render");
+        // vector with output frames (goes to render), in order of groups
+        std::vector<cv::Mat> _frames;
+        for (const auto &[g_id, group]: frame.active) {
+            _frames.insert(_frames.end(), group->output.begin(), group->output.end());
 
             // assign to member properties
-            points[g_id] = ocv::PointCloud(disparity, points_cloud, source_l);
+            // (pool does not reuse buffers while point cloud keeps them)
+            points.at(g_id) = ocv::PointCloud(*group->disparity, *group->points_cloud, *group->bgr_l);
         }
 
         if (aux) {
             glImage.setFrames(_frames);
         } else {
             for (const auto &[_, p]: points) {
+                if (p.points.empty())
+                    continue;
+
                 // TODO FIXME, works only for one group
                 cv::Mat pos, col;
                 p.points.copyTo(pos);
@@ -203,8 +310,7 @@ namespace eox {
         }
 
         refresh();
+        return true;
     }
 
-#pragma clang diagnostic pop
-
-}
\ No newline at end of file
+}
@@ -146,7 +146,11 @@ namespace eox {
             camera.setThreadPool(executor);
             camera.setHomogeneous(props[0].homogeneous);
             camera.setFast(props[0].fast);
+            camera.setAsync(props[0].async);
+            camera.setDecodeSize(cv::Size(props[0].output_width, props[0].output_height));
+            camera.setGray(props[0].gray);
             camera.setApi(props[0].api);
+            camera.setBackend(props[0].backend);
 
             {
                 log->debug("using camera hardware defaults");
@@ -179,6 +183,12 @@ namespace eox {
                     deviceGroupMap.emplace(solo.uid, id);
             }
 
+            // per group state exists up front, so groups processed in parallel never modify the maps
+            for (const auto &[id, package]: packages) {
+                rectificationMaps.try_emplace(id);
+                points.try_emplace(id);
+            }
+
 
             if (config.camera[0].homogeneous) {
                 // homogeneous camera configuration, but it applies only for device groups
@@ -830,9 +840,19 @@ namespace eox {
         }
 
         {
-            // Stable FPS worker loop
+            // stages run concurrently, each on its own frame
+            const auto &depth = config.stereo.depth;
+            graph.stage("rectify", [this](uint64_t id, cloud_frame &frame) { return rectify(frame); }, depth[0]);
+            graph.stage("match", [this](uint64_t id, cloud_frame &frame) { return match(frame); }, depth[1]);
+            graph.stage("reproject", [this](uint64_t id, cloud_frame &frame) { return reproject(frame); }, depth[2]);
+            graph.stage("render", [this](uint64_t id, cloud_frame &frame) { return render(frame); }, depth[3]);
+            graph.start();
+        }
+
+        {
+            // Stable FPS worker loop (source of the stage graph)
             deltaLoop.setFunc([this](float d, float l, float f) { update(d, l, f); });
-            deltaLoop.setFps(0);
+            deltaLoop.setConfig(config.loop);
             deltaLoop.start();
         }
     }
@@ -851,6 +871,8 @@ namespace eox {
     UiPointsCloud::~UiPointsCloud() {
         log->debug("terminate stereo");
 
+        // unblocks the loop waiting for a free frame
+        graph.stop();
         deltaLoop.stop();
         camera.release();
 
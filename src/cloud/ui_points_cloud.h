@@ -5,6 +5,7 @@
 #ifndef STEREOX_UI_POINTS_CLOUD_H
 #define STEREOX_UI_POINTS_CLOUD_H
 
+#include <array>
 #include <opencv2/ximgproc/disparity_filter.hpp>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <opencv2/core/ocl.hpp>
@@ -16,6 +17,8 @@
 #include "../aux/ocv/cv_utils.h"
 #include "../aux/gtk/gtk_control.h"
 #include "../aux/ocv/point_cloud.h"
+#include "../aux/ocv/frame_pool.h"
+#include "../aux/utils/flow/stage_graph.h"
 
 namespace eox {
 
@@ -25,6 +28,26 @@ namespace eox {
                 spdlog::stdout_color_mt("ui_cloud");
 
     private:
+        // buffers of single device group within the frame (pointers refer to the buffers of the pool)
+        typedef struct {
+            eox::ocv::FramePool pool;
+            std::vector<cv::UMat *> frames;
+            cv::UMat *source_l, *source_r;
+            cv::UMat *gray_l, *gray_r;
+            cv::UMat *disparity, *disparity_raw;
+            cv::UMat *points_cloud;
+            cv::UMat *bgr_l;
+            std::vector<cv::Mat> output;
+        } group_frame;
+
+        // frame traveling through the stage graph, reused for many captures
+        typedef struct {
+            std::map<ts::group_id, group_frame> groups;
+
+            // groups captured in this frame
+            std::vector<std::pair<ts::group_id, group_frame *>> active;
+        } cloud_frame;
+
         std::shared_ptr<eox::util::ThreadPool> executor;
         eox::xgtk::GLVoxelArea voxelArea;
         eox::data::basic_config config;
@@ -47,6 +70,12 @@ namespace eox {
         // map of group -> point_cloud
         std::map<ts::group_id, eox::ocv::PointCloud> points;
 
+        // map of group -> rectification maps (L_MAP1, L_MAP2, R_MAP1, R_MAP2) uploaded to GPU
+        std::map<ts::group_id, std::array<cv::UMat, 4>> rectificationMaps;
+
+        // capture -> rectify -> match -> reproject -> render
+        eox::util::StageGraph<cloud_frame> graph;
+
         std::vector<std::unique_ptr<eox::gtk::GtkControl>> controls;
         float FPS = 0;
 
@@ -60,6 +89,39 @@ namespace eox {
 
         void update(float delta, float late, float fps);
 
+    private:
+        /**
+         * Runs func(group_id, group_frame) for every captured group of the frame in parallel,
+         * function touches only state of its own group
+         */
+        template<typename F>
+        void forEachGroup(cloud_frame &frame, F &&func);
+
+        /**
+         * Source stage: captures and uploads the frames (scaled to output size)
+         */
+        bool capture(cloud_frame &frame);
+
+        /**
+         * Remaps frames according to stereo rectification, converts them to grayscale
+         */
+        bool rectify(cloud_frame &frame);
+
+        /**
+         * Computes (filtered) disparity map
+         */
+        bool match(cloud_frame &frame);
+
+        /**
+         * Computes points cloud and visualization frames
+         */
+        bool reproject(cloud_frame &frame);
+
+        /**
+         * Hands results over to the renderer
+         */
+        bool render(cloud_frame &frame);
+
     protected:
         void onRefresh() override;
     };
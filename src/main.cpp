@@ -3,6 +3,9 @@
 #include <opencv2/core/ocl.hpp>
 #include "calibration/ui_calibration.h"
 #include "aux/utils/errors/error_reporter.h"
+#include "aux/utils/sched/thread_sched.h"
+#include "aux/utils/trace/trace.h"
+#include "aux/utils/metrics/metrics.h"
 #include "cli.h"
 #include "cloud/ui_points_cloud.h"
 #include "pose/ui_pose.h"
@@ -21,6 +24,7 @@ int main(int argc, char **argv) {
 
     try {
         const auto configuration = eox::cli::parse(argc, argv);
+        eox::util::apply_thread_sched(eox::util::thread_class::GUI, "gtk");
 
         int n_argc = 1;
         const auto app = Gtk::Application::create(
@@ -44,7 +48,11 @@ int main(int argc, char **argv) {
 
         window->init(configuration);
         window->show();
-        return app->run(*window);
+        const auto code = app->run(*window);
+        window.reset();
+        eox::util::trace_stop();
+        eox::util::metrics_stop();
+        return code;
 
     } catch (const std::exception &e) {
         ErrorReporter::printStackTrace(e);
@@ -3,185 +3,309 @@
 //
 
 #include "pose_pipeline.h"
+#include "../aux/dnn/dnn_preprocess.h"
+#include "../aux/dnn/dnn_segmentation.h"
+#include "../aux/utils/trace/trace.h"
+#include "../aux/utils/metrics/metrics.h"
+
+#include <cmath>
+#include <algorithm>
 
 namespace eox {
 
+    PoseSegmentation::PoseSegmentation(const float *_logits)
+            : logits(std::make_shared<const std::vector<float>>(_logits, _logits + 128 * 128)) {
+    }
+
+    bool PoseSegmentation::empty() const {
+        return !logits;
+    }
+
+    const float *PoseSegmentation::raw() const {
+        return logits ? logits->data() : nullptr;
+    }
+
+    const float *PoseSegmentation::get() const {
+        if (!logits)
+            return nullptr;
+
+        if (!probabilities) {
+            auto values = std::make_shared<std::vector<float>>(logits->size());
+            for (size_t i = 0; i < logits->size(); i++)
+                (*values)[i] = 1.f / (1.f + std::exp(-(*logits)[i]));
+            probabilities = std::move(values);
+        }
+        return probabilities->data();
+    }
+
     void PosePipeline::init() {
-        filters.clear();
+        tracks.clear();
+        initialized = true;
+    }
+
+    std::vector<eox::sig::VelocityFilter> PosePipeline::createFilters() const {
+        std::vector<eox::sig::VelocityFilter> filters;
         filters.reserve(117); // 39 * (x,y,z) == 39 * 3 == 117
         for (int i = 0; i < 117; i++) {
             filters.emplace_back(f_win_size, f_v_scale, f_fps);
         }
-        initialized = true;
+        return filters;
     }
 
     PosePipelineOutput PosePipeline::pass(const cv::Mat &frame) {
-        cv::Mat segmentation;
-        return pass(frame, segmentation);
+        return first(inference(frame, nullptr, nullptr));
     }
 
     PosePipelineOutput PosePipeline::pass(const cv::Mat &frame, cv::Mat &segmented) {
-        return inference(frame, segmented, nullptr);
+        return first(inference(frame, &segmented, nullptr));
     }
 
     PosePipelineOutput PosePipeline::pass(const cv::Mat &frame, cv::Mat &segmented, cv::Mat &debug) {
-        return inference(frame, segmented, &debug);
+        return first(inference(frame, &segmented, &debug));
     }
 
-    PosePipelineOutput PosePipeline::inference(const cv::Mat &frame, cv::Mat &segmented, cv::Mat *debug) {
-        constexpr float MARGIN = 30;
-        constexpr float FIX_X = 0;
-        constexpr float FIX_Y = 10;
+    PosePipelineOutput PosePipeline::pass(const cv::Mat &frame, cv::Mat *segmented, cv::Mat *debug) {
+        return first(inference(frame, segmented, debug));
+    }
+
+    std::vector<PosePipelineOutput> PosePipeline::passAll(const cv::Mat &frame) {
+        return inference(frame, nullptr, nullptr);
+    }
+
+    std::vector<PosePipelineOutput> PosePipeline::passAll(const cv::Mat &frame, cv::Mat &segmented) {
+        return inference(frame, &segmented, nullptr);
+    }
+
+    std::vector<PosePipelineOutput> PosePipeline::passAll(const cv::Mat &frame, cv::Mat &segmented, cv::Mat &debug) {
+        return inference(frame, &segmented, &debug);
+    }
+
+    std::vector<PosePipelineOutput> PosePipeline::passAll(const cv::Mat &frame, cv::Mat *segmented, cv::Mat *debug) {
+        return inference(frame, segmented, debug);
+    }
+
+    PosePipelineOutput PosePipeline::first(const std::vector<PosePipelineOutput> &outputs) {
+        if (!outputs.empty())
+            return outputs[0];
+
+        PosePipelineOutput output;
+        output.present = false;
+        output.score = 0;
+        output.id = 0;
+        return output;
+    }
+
+    void PosePipeline::acquire(const eox::dnn::PoseDetections &detections, const cv::Mat &frame) {
+        // detections are taken once, stale ones only when there is no track to confuse them with
+        if (detections.frame == used_detections)
+            return;
+        if (!tracks.empty() && frame_id - detections.frame > DETECTION_AGE)
+            return;
+        used_detections = detections.frame;
+
+        for (auto detected: detections.poses) {
+            if (tracks.size() >= max_poses)
+                break;
+            if (detected.score < threshold_detector)
+                continue;
+
+            auto &body = detected.body;
+            body.w = body.w * frame.cols + MARGIN;
+            body.h = body.h * frame.rows + MARGIN;
+            body.c.x = body.c.x * frame.cols + FIX_X;
+            body.c.y = body.c.y * frame.rows + FIX_Y;
+            body.x = body.c.x - body.w / 2.f;
+            body.y = body.c.y - body.h / 2.f;
+
+            // person is already tracked
+            const bool tracked = std::any_of(tracks.begin(), tracks.end(), [&body](const PoseTrack &track) {
+                return eox::dnn::iou(track.roi, body) > TRACK_IOU;
+            });
+            if (tracked)
+                continue;
+
+            tracks.push_back({
+                    .id = next_track_id++,
+                    .roi = body,
+                    .filters = createFilters(),
+                    .alive = true,
+            });
+        }
+    }
+
+    std::vector<PosePipelineOutput> PosePipeline::inference(const cv::Mat &frame, cv::Mat *segmented, cv::Mat *debug) {
+        EOX_TRACE_SPAN("pose::inference");
 
         if (!initialized) {
             init();
         }
 
-        PosePipelineOutput output;
-        cv::Mat source;
+        frame_id++;
 
-        if (prediction) {
-            // crop using roi
-            roi = eox::dnn::clamp_roi(roi, frame.cols, frame.rows);
-            source = frame(cv::Rect(roi.x, roi.y, roi.w, roi.h));
+        // new people: detector runs on its own thread, this frame is searched while landmarks are inferred
+        // with the newest finished detections (of one of the previous frames), nothing here waits for it
+        bool searching = false;
+        if (tracks.size() < max_poses) {
+            detector.submit(frame, frame_id);
+            detector.update();
+            acquire(detector.front(), frame);
+            searching = true;
         }
 
-        if (!prediction) {
-            // using pose detector
-            auto detections = detector.inference(frame);
+        std::vector<PosePipelineOutput> outputs;
 
-            if (detections.empty() || detections[0].score < threshold_detector) {
-                output.present = false;
-                output.score = 0;
+        if (tracks.empty()) {
+            if (debug)
+                frame.copyTo(*debug);
+            return outputs;
+        }
 
-                if (debug)
-                    frame.copyTo(*debug);
+        // roi of every track (predicted from landmarks of the previous frame or detected) is rotated and not clamped,
+        // it is warped straight into the landmark tensor, parts outside of the frame are zero padded
+        // rois used for this frame (tracks get the predicted ones)
+        std::vector<eox::dnn::RoI> rois;
+        rois.reserve(tracks.size());
+        for (const auto &track: tracks)
+            rois.push_back(track.roi);
+
+        {
+            // batched: one invoke per landmark instance
+            EOX_TRACE_SPAN("pose::landmark");
+            pose.inference(frame, rois, results, segmented != nullptr);
+        }
+        const auto now = timestamp();
 
-                return output;
-            }
+        // segmentation of every tracked person (only if requested), people are copied in one by one
+        if (segmented) {
+            segmented->create(frame.size(), frame.type());
+            segmented->setTo(0);
+        }
 
-            auto &detected = detections[0];
+        bool lost = false;
+        for (size_t t = 0; t < tracks.size(); t++) {
+            auto &track = tracks[t];
+            const auto &result = results[t];
 
-            auto &body = detected.body;
-            body.x *= frame.cols;
-            body.y *= frame.rows;
-            body.w *= frame.cols;
-            body.h *= frame.rows;
-
-            body.x += FIX_X - (MARGIN / 2.f);
-            body.y += FIX_Y - (MARGIN / 2.f);
-            body.w += (MARGIN / 2.f);
-            body.h += (MARGIN / 2.f);
-
-            auto &face = detected.face;
-            face.x *= frame.cols;
-            face.y *= frame.rows;
-            face.w *= frame.cols;
-            face.h *= frame.rows;
-
-            roi = eox::dnn::clamp_roi(body, frame.cols, frame.rows);
-            source = frame(cv::Rect(roi.x, roi.y, roi.w, roi.h));
-
-            for (auto &filter: filters) {
-                filter.reset();
+            if (result.score <= threshold_pose) {
+                track.alive = false;
+                lost = true;
+                continue;
             }
-        }
 
-        auto result = pose.inference(source);
-        const auto now = timestamp();
+            // normalized roi -> frame
+            const auto &roi = track.roi;
+            float m[6];
+            eox::dnn::roi_transform(roi.c.x, roi.c.y, roi.w, roi.h, roi.r, 1, m);
 
-        if (result.score > threshold_pose) {
             eox::dnn::Landmark landmarks[39];
             for (int i = 0; i < 39; i++) {
+                const auto &lm = result.landmarks_norm[i];
                 landmarks[i] = {
-                        // turning x,y into common (global) coordinates
-                        .x = (result.landmarks_norm[i].x * roi.w) + roi.x,
-                        .y = (result.landmarks_norm[i].y * roi.h) + roi.y,
+                        // turning x,y into common (global) coordinates, through the rotation of the roi
+                        .x = m[0] * lm.x + m[1] * lm.y + m[2],
+                        .y = m[3] * lm.x + m[4] * lm.y + m[5],
 
                         // z is still normalized (in range of 0 and 1)
-                        .z = result.landmarks_norm[i].z,
+                        .z = lm.z,
 
-                        .v = result.landmarks_norm[i].v,
-                        .p = result.landmarks_norm[i].p,
+                        .v = lm.v,
+                        .p = lm.p,
                 };
             }
 
             // temporal filtering (low pass based on velocity)
-            for (int i = 0; i < 39; i++) {
-                const auto idx = i * 3;
+            {
+                EOX_TRACE_SPAN("pose::filter");
+                EOX_STAGE_LATENCY("velocity_filter");
+                for (int i = 0; i < 39; i++) {
+                    const auto idx = i * 3;
 
-                auto fx = filters.at(idx + 0).filter(now, landmarks[i].x);
-                auto fy = filters.at(idx + 1).filter(now, landmarks[i].y);
-                auto fz = filters.at(idx + 2).filter(now, landmarks[i].z);
+                    auto fx = track.filters.at(idx + 0).filter(now, landmarks[i].x);
+                    auto fy = track.filters.at(idx + 1).filter(now, landmarks[i].y);
+                    auto fz = track.filters.at(idx + 2).filter(now, landmarks[i].z);
 
-                landmarks[i].x = fx;
-                landmarks[i].y = fy;
-                landmarks[i].z = fz;
+                    landmarks[i].x = fx;
+                    landmarks[i].y = fy;
+                    landmarks[i].z = fz;
+                }
             }
 
-            performSegmentation(result.segmentation, frame, segmented);
-
-            if (debug) {
-                segmented.copyTo(*debug);
-                drawJoints(landmarks, *debug);
-                drawLandmarks(landmarks, result.landmarks_3d,*debug);
-                drawRoi(*debug);
-            }
+            if (segmented)
+                performSegmentation(result.segmentation, roi, frame, *segmented);
 
             // predict new roi
-            roi = roiPredictor
+            track.roi = roiPredictor
                     .setMargin(MARGIN)
                     .setFixX(FIX_X)
                     .setFixY(FIX_Y)
                     .forward(eox::dnn::roiFromPoseLandmarks39(landmarks));
-            prediction = true;
 
             // output
             {
+                auto &output = outputs.emplace_back();
                 for (int i = 0; i < 39; i++) {
                     output.ws_landmarks[i] = result.landmarks_3d[i];
                     output.landmarks[i] = landmarks[i];
                 }
 
-                for (int i = 0; i < 128 * 128; i++)
-                    output.segmentation[i] = result.segmentation[i];
+                // probabilities are computed on the first access
+                if (segmented)
+                    output.segmentation = PoseSegmentation(result.segmentation);
 
                 output.score = result.score;
                 output.present = true;
+                output.id = track.id;
             }
+        }
 
-        } else {
-
-            // retry but without prediction
-            if (prediction) {
-                prediction = false;
-                return inference(frame, segmented, debug);
+        // tracks converging onto the same person, older one is kept (tracks are ordered by age)
+        for (size_t i = 0; i < tracks.size(); i++) {
+            for (size_t j = i + 1; j < tracks.size() && tracks[i].alive; j++) {
+                if (tracks[j].alive && eox::dnn::iou(tracks[i].roi, tracks[j].roi) > TRACK_IOU) {
+                    tracks[j].alive = false;
+                    std::erase_if(outputs, [id = tracks[j].id](const PosePipelineOutput &o) {
+                        return o.id == id;
+                    });
+                }
             }
+        }
+
+        std::erase_if(tracks, [](const PoseTrack &track) {
+            return !track.alive;
+        });
+
+        // tracking is lost, detector starts searching this frame right away (without a second pass here)
+        if (lost && !searching && tracks.size() < max_poses)
+            detector.submit(frame, frame_id);
 
-            // still nothing
-            if (debug) {
+        if (debug) {
+            if (outputs.empty() || !segmented)
                 frame.copyTo(*debug);
-                drawRoi(*debug);
+            else
+                segmented->copyTo(*debug);
+
+            for (const auto &output: outputs) {
+                drawJoints(output.landmarks, *debug);
+                drawLandmarks(output.landmarks, output.ws_landmarks, *debug);
             }
+            for (const auto &roi: rois)
+                drawRoi(roi, *debug);
         }
 
-        return output;
+        return outputs;
     }
 
-    void PosePipeline::performSegmentation(float *segmentation_array, const cv::Mat &frame, cv::Mat &out) const {
-        cv::Mat segmentation(128, 128, CV_32F, segmentation_array);
-        cv::Mat segmentation_mask;
+    void PosePipeline::performSegmentation(const float *logits, const eox::dnn::RoI &roi,
+                                           const cv::Mat &frame, cv::Mat &segmented) {
+        EOX_TRACE_SPAN("pose::segmentation");
 
-        cv::threshold(segmentation, segmentation_mask, 0.5, 1., cv::THRESH_BINARY);
-        cv::resize(segmentation_mask, segmentation_mask, cv::Size(roi.w, roi.h));
+        // mask -> frame, through the rotation of the roi
+        float transform[6];
+        eox::dnn::roi_transform(roi.c.x, roi.c.y, roi.w, roi.h, roi.r, 128, transform);
 
-        segmentation_mask.convertTo(segmentation_mask, CV_32FC1, 255.);
-        segmentation_mask.convertTo(segmentation_mask, CV_8UC1);
-
-        cv::Mat segmentation_frame = cv::Mat::zeros(frame.rows, frame.cols, CV_8UC1);
-        segmentation_mask.copyTo(segmentation_frame(cv::Rect(roi.x, roi.y, roi.w, roi.h)));
-
-        cv::bitwise_and(frame, frame, out, segmentation_frame);
+        // fused: only the bounding box of the roi is visited, mask is thresholded in logit space
+        eox::dnn::segment_to_frame(frame.data, frame.step[0], segmented.data, segmented.step[0],
+                                   frame.cols, frame.rows, (int) frame.elemSize(), logits, 128, transform);
     }
 
     void PosePipeline::drawJoints(const eox::dnn::Landmark landmarks[39], cv::Mat &output) const {
@@ -239,14 +363,22 @@ namespace eox {
         }
     }
 
-    void PosePipeline::drawRoi(cv::Mat &output) const {
-        const auto p1 = cv::Point(roi.x, roi.y);
-        const auto p2 = cv::Point(roi.x + roi.w, roi.y + roi.h);
+    void PosePipeline::drawRoi(const eox::dnn::RoI &roi, cv::Mat &output) const {
+        float m[6];
+        eox::dnn::roi_transform(roi.c.x, roi.c.y, roi.w, roi.h, roi.r, 1, m);
+
+        // corners of the rotated roi
+        const float corners[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+        cv::Point points[4];
+        for (int i = 0; i < 4; i++) {
+            const auto u = corners[i][0];
+            const auto v = corners[i][1];
+            points[i] = cv::Point(m[0] * u + m[1] * v + m[2], m[3] * u + m[4] * v + m[5]);
+        }
+
         cv::Scalar color(0, 255, 0);
-        cv::line(output, p1, cv::Point(roi.x + roi.w, roi.y), color, 2);
-        cv::line(output, p1, cv::Point(roi.x, roi.y + roi.h), color, 2);
-        cv::line(output, p2, cv::Point(roi.x, roi.y + roi.h), color, 2);
-        cv::line(output, p2, cv::Point(roi.x + roi.w, roi.y), color, 2);
+        for (int i = 0; i < 4; i++)
+            cv::line(output, points[i], points[(i + 1) % 4], color, 2);
     }
 
     std::chrono::nanoseconds PosePipeline::timestamp() const {
@@ -272,25 +404,47 @@ namespace eox {
 
     void PosePipeline::setFilterWindowSize(int size) {
         f_win_size = size;
-        for (auto &filter: filters) {
-            filter.setWindowSize(size);
+        for (auto &track: tracks) {
+            for (auto &filter: track.filters) {
+                filter.setWindowSize(size);
+            }
         }
     }
 
     void PosePipeline::setFilterVelocityScale(float scale) {
         f_v_scale = scale;
-        for (auto &filter: filters) {
-            filter.setVelocityScale(scale);
+        for (auto &track: tracks) {
+            for (auto &filter: track.filters) {
+                filter.setVelocityScale(scale);
+            }
         }
     }
 
     void PosePipeline::setFilterTargetFps(int fps) {
         f_fps = fps;
-        for (auto &filter: filters) {
-            filter.setTargetFps(fps);
+        for (auto &track: tracks) {
+            for (auto &filter: track.filters) {
+                filter.setTargetFps(fps);
+            }
         }
     }
 
+    void PosePipeline::setInference(const eox::data::inference_config &detector_config,
+                                    const eox::data::inference_config &landmark_config,
+                                    size_t landmark_instances) {
+        detector.setInference(detector_config);
+        pose.setInference(landmark_config, landmark_instances);
+    }
+
+    void PosePipeline::setMaxPoses(size_t max) {
+        max_poses = std::max<size_t>(max, 1);
+        detector.setMaxDetections(max_poses);
+    }
+
+    size_t PosePipeline::getMaxPoses() const {
+        return max_poses;
+    }
+
     float PosePipeline::getFilterVelocityScale() const {
         return f_v_scale;
     }
@@ -5,17 +5,51 @@
 #ifndef STEREOX_POSE_PIPELINE_H
 #define STEREOX_POSE_PIPELINE_H
 
+#include <memory>
 #include <vector>
 #include <spdlog/logger.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 
 #include "../aux/sig/velocity_filter.h"
-#include "../aux/dnn/blaze_pose.h"
+#include "../aux/dnn/blaze_pose_pool.h"
 #include "../aux/dnn/roi/pose_roi.h"
-#include "../aux/dnn/pose_detector.h"
+#include "../aux/dnn/async_pose_detector.h"
 
 namespace eox {
 
+    /**
+     * @class PoseSegmentation
+     * @brief Segmentation of the person, 128x128 over the rotated roi of the track.
+     *
+     * Holds raw logits, probabilities are computed on the first access to them (not thread safe).
+     * Empty unless segmentation was requested (see PosePipeline::pass with segmented frame).
+     */
+    class PoseSegmentation {
+    private:
+        std::shared_ptr<const std::vector<float>> logits;
+        mutable std::shared_ptr<const std::vector<float>> probabilities;
+
+    public:
+        PoseSegmentation() = default;
+
+        /**
+         * @param logits 1D 128x128 array of raw logits (copied)
+         */
+        explicit PoseSegmentation(const float *logits);
+
+        [[nodiscard]] bool empty() const;
+
+        /**
+         * @return 1D 128x128 array of raw logits, nullptr if empty
+         */
+        [[nodiscard]] const float *raw() const;
+
+        /**
+         * @return 1D 128x128 array of probabilities [0,1], nullptr if empty
+         */
+        [[nodiscard]] const float *get() const;
+    };
+
     using PosePipelineOutput = struct {
 
         /**
@@ -29,9 +63,9 @@ namespace eox {
         eox::dnn::Coord3d ws_landmarks[39];
 
         /**
-         * segmentation array
+         * segmentation of the person, empty unless requested
          */
-        float segmentation[128 * 128];
+        PoseSegmentation segmentation;
 
         /**
          * presence flag
@@ -42,6 +76,31 @@ namespace eox {
          * presence score
          */
         float score;
+
+        /**
+         * id of the track (person), stays the same while the person is tracked
+         */
+        uint64_t id;
+    };
+
+    using PoseTrack = struct {
+
+        /**
+         * id of the track, never reused
+         */
+        uint64_t id;
+
+        /**
+         * rotated roi for the next frame (detected or predicted from landmarks)
+         */
+        eox::dnn::RoI roi;
+
+        /**
+         * 39 * (x,y,z) landmark filters
+         */
+        std::vector<eox::sig::VelocityFilter> filters;
+
+        bool alive;
     };
 
     class PosePipeline {
@@ -50,13 +109,29 @@ namespace eox {
                 spdlog::stdout_color_mt("pose_pipeline");
 
     private:
-        std::vector<eox::sig::VelocityFilter> filters;
+        static inline const float MARGIN = 30;
+        static inline const float FIX_X = 0;
+        static inline const float FIX_Y = 10;
+
+        // tracks overlapping more than that are the same person
+        static inline const float TRACK_IOU = 0.5;
+
+        // detections of older frames than that are not matched against live tracks (people moved since),
+        // with nobody tracked the newest detections are taken whatever their age (detector may be slower than that)
+        static inline const uint64_t DETECTION_AGE = 2;
+
+        std::vector<PoseTrack> tracks;
+        std::vector<eox::dnn::PoseOutput> results;
         eox::dnn::PoseRoi roiPredictor;
-        eox::dnn::PoseDetector detector;
-        eox::dnn::BlazePose pose;
+        eox::dnn::AsyncPoseDetector detector;
+        eox::dnn::BlazePosePool pose;
 
-        bool prediction = false;
-        eox::dnn::RoI roi;
+        size_t max_poses = 1;
+        uint64_t next_track_id = 1;
+
+        // id of the current frame and of the frame detections were last taken from
+        uint64_t frame_id = 0;
+        uint64_t used_detections = 0;
 
         bool initialized = false;
 
@@ -71,12 +146,41 @@ namespace eox {
     public:
         void init();
 
+        /**
+         * @brief Landmarks only, segmentation is skipped
+         */
         PosePipelineOutput pass(const cv::Mat &frame);
 
+        /**
+         * @param segmented frame with everything but tracked people masked out (requests segmentation)
+         */
         PosePipelineOutput pass(const cv::Mat &frame, cv::Mat &segmented);
 
         PosePipelineOutput pass(const cv::Mat &frame, cv::Mat &segmented, cv::Mat &debug);
 
+        /**
+         * @param segmented segmented frame, nullptr - segmentation is skipped
+         * @param debug debug image, nullptr - nothing is drawn
+         */
+        PosePipelineOutput pass(const cv::Mat &frame, cv::Mat *segmented, cv::Mat *debug);
+
+        /**
+         * @brief Landmarks only, segmentation is skipped
+         * @return every tracked person (at most getMaxPoses()), ordered by age of the track
+         */
+        std::vector<PosePipelineOutput> passAll(const cv::Mat &frame);
+
+        std::vector<PosePipelineOutput> passAll(const cv::Mat &frame, cv::Mat &segmented);
+
+        std::vector<PosePipelineOutput> passAll(const cv::Mat &frame, cv::Mat &segmented, cv::Mat &debug);
+
+        /**
+         * @param segmented segmented frame, nullptr - segmentation is skipped
+         * @param debug debug image (landmarks and rois drawn over segmented frame, or over the frame itself),
+         *              nullptr - nothing is drawn
+         */
+        std::vector<PosePipelineOutput> passAll(const cv::Mat &frame, cv::Mat *segmented, cv::Mat *debug);
+
         void setPresenceThreshold(float threshold);
 
         void setPoseThreshold(float threshold);
@@ -89,6 +193,21 @@ namespace eox {
 
         void setFilterTargetFps(int fps);
 
+        /**
+         * @brief Selects inference backends of detector and landmark models (before the first pass)
+         * @param landmark_instances number of landmark interpreters, landmarks of tracked people run in parallel
+         */
+        void setInference(const eox::data::inference_config &detector_config,
+                          const eox::data::inference_config &landmark_config,
+                          size_t landmark_instances = 1);
+
+        /**
+         * @brief Maximum number of tracked people (before the first pass), 1 by default
+         */
+        void setMaxPoses(size_t max);
+
+        [[nodiscard]] size_t getMaxPoses() const;
+
         [[nodiscard]] float getFilterVelocityScale() const;
 
         [[nodiscard]] int getFilterWindowSize() const;
@@ -102,15 +221,31 @@ namespace eox {
         [[nodiscard]] float getPresenceThreshold() const;
 
     protected:
-        [[nodiscard]] PosePipelineOutput inference(const cv::Mat &frame, cv::Mat &segmented, cv::Mat *debug);
+        /**
+         * @param segmented segmentation is computed only if present
+         */
+        [[nodiscard]] std::vector<PosePipelineOutput> inference(const cv::Mat &frame, cv::Mat *segmented, cv::Mat *debug);
+
+        /**
+         * Starts tracks of detected people which are not tracked yet
+         */
+        void acquire(const eox::dnn::PoseDetections &detections, const cv::Mat &frame);
+
+        [[nodiscard]] std::vector<eox::sig::VelocityFilter> createFilters() const;
+
+        /**
+         * Copies pixels of the frame covered by segmentation of the roi into the segmented frame
+         */
+        static void performSegmentation(const float *logits, const eox::dnn::RoI &roi,
+                                        const cv::Mat &frame, cv::Mat &segmented);
 
-        void performSegmentation(float segmentation_array[128 * 128], const cv::Mat &frame, cv::Mat &out) const;
+        [[nodiscard]] static PosePipelineOutput first(const std::vector<PosePipelineOutput> &outputs);
 
         void drawJoints(const eox::dnn::Landmark landmarks[39], cv::Mat &output) const;
 
         void drawLandmarks(const eox::dnn::Landmark landmarks[39], const eox::dnn::Coord3d ws3d[39], cv::Mat &output) const;
 
-        void drawRoi(cv::Mat &output) const;
+        void drawRoi(const eox::dnn::RoI &roi, cv::Mat &output) const;
 
         [[nodiscard]] std::chrono::nanoseconds timestamp() const;
     };
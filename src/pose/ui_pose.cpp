@@ -22,11 +22,20 @@ namespace eox {
         {
             pipeline.setDetectorThreshold(0.5f);
             pipeline.setPoseThreshold(0.5f);
+            pipeline.setInference(configuration.pose.detector, configuration.pose.landmark,
+                                  configuration.pose.landmark_instances);
+            pipeline.setMaxPoses(configuration.pose.poses);
+            segmentation = configuration.pose.segmentation;
             pipeline.init();
         }
 
         {
-            glImage.init((int) props.size(), props[0].output_width, props[0].output_height, {"DEMO"}, GL_BGR);
+            const auto &roi = props[0].roi;
+            const bool cropped = roi[2] > 0 && roi[3] > 0;
+            glImage.init((int) props.size(),
+                         cropped ? roi[2] : props[0].output_width,
+                         cropped ? roi[3] : props[0].output_height,
+                         {"DEMO"}, GL_BGR);
             glImage.scale(configuration.scale);
             glImage.setFrame(frame);
         }
@@ -35,7 +44,10 @@ namespace eox {
             camera.setProperties(props);
             camera.setHomogeneous(props[0].homogeneous);
             camera.setFast(props[0].fast);
+            camera.setAsync(props[0].async);
+            camera.setDecodeRegion(cv::Rect(props[0].roi[0], props[0].roi[1], props[0].roi[2], props[0].roi[3]));
             camera.setApi(props[0].api);
+            camera.setBackend(props[0].backend);
             camera.open();
         }
 
@@ -186,7 +198,7 @@ namespace eox {
         {
             // Stable FPS worker loop
             deltaLoop.setFunc([this](float d, float l, float f) { update(d, l, f); });
-//            deltaLoop.setFps(30);
+            deltaLoop.setConfig(configuration.loop);
             deltaLoop.start();
         }
     }
@@ -203,8 +215,9 @@ namespace eox {
 
         frame = captured[0];
 
-        cv::Mat output, segmentation;
-        pipeline.pass(frame, segmentation, output);
+        // segmented frame is the background of debug output, computed only if it's going to be shown
+        cv::Mat output, segmented;
+        pipeline.passAll(frame, segmentation ? &segmented : nullptr, &output);
         glImage.setFrame(output);
 
         refresh();
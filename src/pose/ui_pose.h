@@ -30,6 +30,7 @@ namespace eox {
         cv::Mat frame;
 
         float FPS = 0;
+        bool segmentation = false;
 
     public:
         ~UiPose() override;